@@ -0,0 +1,201 @@
+#ifndef ACTIVATION_FUNCTIONS_H
+#define ACTIVATION_FUNCTIONS_H
+
+#include <algorithm>
+#include <cmath>
+
+// Activation functions of the neurons. Every neuron starts with "automatic": linear for input and output
+// neurons and tanh otherwise. The tanh approximations are branch free rational functions, so batches of them
+// are vectorized by the compiler:
+//   rational_tanh   [13/6] rational approximation, max. absolute error 2.7e-7 (double), 4.2e-7 (float)
+//   fast_tanh       [5/4] continued fraction of tanh, max. absolute error 1.4e-3
+
+namespace neural_nets
+{
+	enum class activation_function
+	{
+		automatic,
+		linear,
+		tanh,
+		logistic,
+		relu,
+		softsign,
+		rational_tanh,
+		fast_tanh
+	};
+
+	inline char const *get_activation_name(activation_function activation_)
+	{
+		static char const *names[] = { "automatic", "linear", "tanh", "logistic", "relu", "softsign", "rational_tanh", "fast_tanh" };
+		return names[static_cast<size_t>(activation_)];
+	}
+
+	namespace detail
+	{
+		namespace activations
+		{
+			template <typename T>
+			T clamp(T const &x_, T const &limit_) { return std::min(limit_, std::max(-limit_, x_)); }
+
+			// Numerator (odd, divided by x) and denominator of the [13/6] approximation as polynomials in x^2
+			template <typename T>
+			T rational_tanh_numerator(T const &s_)
+			{
+				T p = T(-2.76076847742355e-16);
+				p = p*s_ + T(2.00018790482477e-13);
+				p = p*s_ + T(-8.60467152213735e-11);
+				p = p*s_ + T(5.12229709037114e-08);
+				p = p*s_ + T(1.48572235717979e-05);
+				p = p*s_ + T(6.37261928875436e-04);
+				return p*s_ + T(4.89352455891786e-03);
+			}
+
+			template <typename T>
+			T rational_tanh_numerator_derivative(T const &s_)
+			{
+				T p = T(6 * -2.76076847742355e-16);
+				p = p*s_ + T(5 * 2.00018790482477e-13);
+				p = p*s_ + T(4 * -8.60467152213735e-11);
+				p = p*s_ + T(3 * 5.12229709037114e-08);
+				p = p*s_ + T(2 * 1.48572235717979e-05);
+				return p*s_ + T(6.37261928875436e-04);
+			}
+
+			template <typename T>
+			T rational_tanh_denominator(T const &s_)
+			{
+				T q = T(1.19825839466702e-06);
+				q = q*s_ + T(1.18534705686654e-04);
+				q = q*s_ + T(2.26843463243900e-03);
+				return q*s_ + T(4.89352518554385e-03);
+			}
+
+			template <typename T>
+			T rational_tanh_denominator_derivative(T const &s_)
+			{
+				T q = T(3 * 1.19825839466702e-06);
+				q = q*s_ + T(2 * 1.18534705686654e-04);
+				return q*s_ + T(2.26843463243900e-03);
+			}
+
+			template <typename T> T rational_tanh_limit() { return T(7.90531110763549805); }
+			template <typename T> T fast_tanh_limit() { return T(3.65); }
+
+			template <typename T>
+			T rational_tanh(T const &x_)
+			{
+				T x = clamp(x_, rational_tanh_limit<T>()), s = x*x;
+				return x*rational_tanh_numerator(s) / rational_tanh_denominator(s);
+			}
+
+			template <typename T>
+			T rational_tanh_derivative(T const &x_)
+			{
+				if (std::abs(x_) >= rational_tanh_limit<T>()) {
+					return T(0);
+				}
+				T s = x_*x_, p = rational_tanh_numerator(s), q = rational_tanh_denominator(s);
+				return p / q + 2 * s*(rational_tanh_numerator_derivative(s)*q - p*rational_tanh_denominator_derivative(s)) / (q*q);
+			}
+
+			template <typename T>
+			T fast_tanh(T const &x_)
+			{
+				T x = clamp(x_, fast_tanh_limit<T>()), s = x*x;
+				return clamp(x*(T(945) + s*(T(105) + s)) / (T(945) + s*(T(420) + T(15)*s)), T(1));
+			}
+
+			template <typename T>
+			T fast_tanh_derivative(T const &x_)
+			{
+				T s = x_*x_, p = T(945) + s*(T(105) + s), q = T(945) + s*(T(420) + T(15)*s);
+				if (std::abs(x_) >= fast_tanh_limit<T>() || std::abs(x_*p) >= q) {
+					return T(0);
+				}
+				return p / q + 2 * s*((T(105) + 2 * s)*q - p*(T(420) + T(30)*s)) / (q*q);
+			}
+		}
+	}
+
+	// Output of the activation for the net input x_ (automatic is evaluated as tanh)
+	template <typename T>
+	T apply_activation(activation_function activation_, T const &x_)
+	{
+		switch (activation_) {
+		case activation_function::linear: return x_;
+		case activation_function::logistic: return T(1) / (T(1) + std::exp(-x_));
+		case activation_function::relu: return std::max(T(0), x_);
+		case activation_function::softsign: return x_ / (T(1) + std::abs(x_));
+		case activation_function::rational_tanh: return detail::activations::rational_tanh(x_);
+		case activation_function::fast_tanh: return detail::activations::fast_tanh(x_);
+		default: return std::tanh(x_);
+		}
+	}
+
+	// Derivative of the activation with respect to the net input x_
+	template <typename T>
+	T activation_derivative(activation_function activation_, T const &x_)
+	{
+		switch (activation_) {
+		case activation_function::linear: return T(1);
+		case activation_function::logistic: { T y = T(1) / (T(1) + std::exp(-x_)); return y*(T(1) - y); }
+		case activation_function::relu: return x_ > T(0) ? T(1) : T(0);
+		case activation_function::softsign: { T d = T(1) + std::abs(x_); return T(1) / (d*d); }
+		case activation_function::rational_tanh: return detail::activations::rational_tanh_derivative(x_);
+		case activation_function::fast_tanh: return detail::activations::fast_tanh_derivative(x_);
+		default: { T y = std::tanh(x_); return T(1) - y*y; }
+		}
+	}
+
+	// Derivative expressed by the output y_, as needed by backpropagation, which only keeps the outputs. Exact
+	// except for the tanh approximations, which use the tanh derivative 1 - y^2 (off by at most 1e-6 for
+	// rational_tanh and 5e-3 for fast_tanh)
+	template <typename T>
+	T activation_derivative_from_output(activation_function activation_, T const &y_)
+	{
+		switch (activation_) {
+		case activation_function::linear: return T(1);
+		case activation_function::logistic: return y_*(T(1) - y_);
+		case activation_function::relu: return y_ > T(0) ? T(1) : T(0);
+		case activation_function::softsign: { T d = T(1) - std::abs(y_); return d*d; }
+		default: return T(1) - y_*y_;
+		}
+	}
+
+	// Applies the activation to [first_, last_) in place. The loops are kept free of branches so that the
+	// compiler vectorizes them.
+	template <typename T>
+	void apply_activation(activation_function activation_, T *first_, T *last_)
+	{
+		switch (activation_) {
+		case activation_function::linear:
+			break;
+		case activation_function::relu:
+			for (T *x = first_; x != last_; ++x) {
+				*x = std::max(T(0), *x);
+			}
+			break;
+		case activation_function::softsign:
+			for (T *x = first_; x != last_; ++x) {
+				*x = *x / (T(1) + std::abs(*x));
+			}
+			break;
+		case activation_function::rational_tanh:
+			for (T *x = first_; x != last_; ++x) {
+				*x = detail::activations::rational_tanh(*x);
+			}
+			break;
+		case activation_function::fast_tanh:
+			for (T *x = first_; x != last_; ++x) {
+				*x = detail::activations::fast_tanh(*x);
+			}
+			break;
+		default:
+			for (T *x = first_; x != last_; ++x) {
+				*x = apply_activation(activation_, *x);
+			}
+		}
+	}
+}
+
+#endif
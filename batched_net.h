@@ -0,0 +1,147 @@
+#ifndef BATCHED_NET_H
+#define BATCHED_NET_H
+
+#include <algorithm>
+#include <vector>
+
+#include <boost\numeric\ublas\matrix.hpp>
+
+#include "neural_nets\general_net.h"
+#include "neural_nets\neural_exception.h"
+#include "neural_nets\detail\net_gradient.h"
+
+// Inference of one general_net for several independent input streams (lanes) in lockstep, e.g. the sessions of
+// a server. Outputs and delay histories are stored lane by lane, so every connection is one vectorizable loop
+// over the lanes. The state of a stream (its output history) is loaded into a lane before and stored after its
+// steps, so streams can move between lanes. Each lane gives the same outputs as a copy of the network.
+
+namespace neural_nets
+{
+	template <typename T>
+	class batched_net
+	{
+	public:
+		// The internal memory of net_ is the initial state of every lane
+		batched_net(general_net<T> net_, size_t lanes_);
+
+		size_t get_lane_count() const { return lanes; }
+		size_t get_input_count() const { return input_count; }
+		size_t get_output_count() const { return graph.get_outputs().size(); }
+
+		// A state holds the outputs of every neuron for the last get_max_delay() steps, oldest first
+		size_t get_state_size() const { return graph.get_max_delay()*graph.get_neuron_count(); }
+		std::vector<T> const &get_initial_state() const { return initial_state; }
+		template <typename iter> void load_state(size_t lane_, iter state_begin_);
+		template <typename iter> void store_state(size_t lane_, iter state_begin_) const;
+
+		// One step of all lanes: row m of inputs_ is the input of lane m, row m of outputs_ its output
+		void operator()(boost::numeric::ublas::matrix<T> const &inputs_, boost::numeric::ublas::matrix<T> &outputs_);
+
+	private:
+		detail::net_graph<T> graph;
+		std::vector<T> weights; // Parameters and frozen values of graph
+		std::vector<T> initial_state;
+		size_t lanes, input_count, rows, current_row;
+		std::vector<T> states; // Ring of rows: [row][neuron][lane]
+		std::vector<size_t> delay_rows; // Offset of the row d steps back
+
+		size_t get_state_row(size_t d_) const { return (current_row + rows - d_) % rows * graph.get_neuron_count(); }
+	};
+
+
+
+
+	template <typename T>
+	batched_net<T>::batched_net(general_net<T> net_, size_t lanes_) : graph(net_), lanes(lanes_), input_count(net_.get_input_count()),
+		rows(graph.get_max_delay() + 1), current_row(0), states(rows*graph.get_neuron_count()*lanes_), delay_rows(rows)
+	{
+		if (!lanes_) {
+			throw neural_exception("A batched net needs at least one lane!");
+		}
+		std::vector<T> parameters(graph.get_parameter_count());
+		net_.get_parameters(parameters.begin(), parameters.end());
+		weights.resize(graph.get_value_count());
+		for (size_t p = 0; p < weights.size(); ++p) {
+			weights[p] = graph.get_weight(parameters, p);
+		}
+
+		boost::numeric::ublas::matrix<T> history(graph.get_max_delay(), graph.get_neuron_count());
+		graph.load_history(net_, history);
+		initial_state.assign(history.data().begin(), history.data().end());
+		for (size_t m = 0; m < lanes; ++m) {
+			load_state(m, initial_state.begin());
+		}
+	}
+
+	template <typename T>
+	template <typename iter>
+	void batched_net<T>::load_state(size_t lane_, iter state_begin_)
+	{
+		size_t max_delay = graph.get_max_delay(), neuron_count = graph.get_neuron_count();
+		for (size_t r = 0; r < max_delay; ++r) {
+			T *row = &states[get_state_row(max_delay - r)*lanes + lane_];
+			for (size_t j = 0; j < neuron_count; ++j, ++state_begin_) {
+				row[j*lanes] = *state_begin_;
+			}
+		}
+	}
+
+	template <typename T>
+	template <typename iter>
+	void batched_net<T>::store_state(size_t lane_, iter state_begin_) const
+	{
+		size_t max_delay = graph.get_max_delay(), neuron_count = graph.get_neuron_count();
+		for (size_t r = 0; r < max_delay; ++r) {
+			T const *row = &states[get_state_row(max_delay - r)*lanes + lane_];
+			for (size_t j = 0; j < neuron_count; ++j, ++state_begin_) {
+				*state_begin_ = row[j*lanes];
+			}
+		}
+	}
+
+	template <typename T>
+	void batched_net<T>::operator()(boost::numeric::ublas::matrix<T> const &inputs_, boost::numeric::ublas::matrix<T> &outputs_)
+	{
+		if (inputs_.size1() != lanes || inputs_.size2() != input_count) {
+			throw neural_exception("Inputs must have one row per lane and one column per input!");
+		}
+		outputs_.resize(lanes, get_output_count(), false);
+		for (size_t d = 0; d < rows; ++d) {
+			delay_rows[d] = get_state_row(d);
+		}
+		auto const &edges = graph.get_edges();
+		for (auto const &n : graph.get_nodes()) {
+			T *sum = &states[(delay_rows[0] + n.neuron)*lanes];
+			if (n.input != detail::net_graph<T>::no_input) {
+				for (size_t m = 0; m < lanes; ++m) {
+					sum[m] = inputs_(m, n.input);
+				}
+			}
+			else {
+				std::fill(sum, sum + lanes, T(0));
+			}
+			for (size_t e = n.first_edge; e < n.last_edge; ++e) {
+				T w = weights[edges[e].parameter];
+				T const *s = &states[(delay_rows[edges[e].delay] + edges[e].source)*lanes];
+				for (size_t m = 0; m < lanes; ++m) {
+					sum[m] += w * s[m];
+				}
+			}
+			T bias = weights[n.bias];
+			for (size_t m = 0; m < lanes; ++m) {
+				sum[m] += bias;
+			}
+			apply_activation(n.activation, sum, sum + lanes);
+		}
+		auto const &outputs = graph.get_outputs();
+		for (size_t k = 0; k < outputs.size(); ++k) {
+			T const *y = &states[(delay_rows[0] + outputs[k])*lanes];
+			for (size_t m = 0; m < lanes; ++m) {
+				outputs_(m, k) = y[m];
+			}
+		}
+		current_row = (current_row + 1) % rows;
+	}
+}
+
+#endif
@@ -0,0 +1,57 @@
+#include <iostream> // For output
+#include <iomanip> // For output formatting
+#include "neural_nets\neural_nets.h" // All relevant headers for full neural network usage
+#include "benchmark_utils.h" // Timing helpers
+
+// Measures what a copy of a general_net costs and how long the numerical Jacobian takes, which
+// simulates the net once per parameter. Copies share the network topology, so a copy only duplicates
+// the weights, biases and delay states. The cost of duplicating the adjacency matrix (which every
+// copy had to pay before the topology was shared) is shown for comparison. The Jacobian is timed with
+// the default 16 parameter vectors simulated in lockstep and with one at a time.
+
+int main()
+{
+	using namespace neural_nets; // Neural network library
+	using namespace boost::numeric::ublas; // Boost vector and matrix libraries
+	using benchmark_utils::measure_seconds;
+
+	std::cout << std::setprecision(4) << std::scientific;
+	std::cout << "Neurons\tParameters\tCopy [s]\tAdjacency copy [s]\tJacobian [s]\tJacobian 1 lane [s]\n";
+
+	for (size_t layer_size : { 5, 10, 20 }) {
+
+		// Input layer, two recurrent hidden layers and one output neuron
+		general_net<double> net(2 * layer_size + 2);
+		size_t output = 2 * layer_size + 1;
+		for (size_t i = 1; i <= layer_size; ++i) {
+			net.connect_neurons(0, i);
+			net.connect_neurons(i, i, tapped_delay_line<double>(1));
+			for (size_t j = layer_size + 1; j <= 2 * layer_size; ++j) {
+				net.connect_neurons(i, j);
+			}
+		}
+		for (size_t j = layer_size + 1; j <= 2 * layer_size; ++j) {
+			net.connect_neurons(j, output);
+			net.connect_neurons(output, j, tapped_delay_line<double>(2));
+		}
+		net.declare_as_input(0);
+		net.declare_as_output(output);
+		net.init_random(-0.5, 0.5);
+
+		auto t = net_signals::linspace(0.0, 100.0, 100);
+		auto u = net_signals::amp_pseudo_random_binary_sequence(t, 10.0, -1.0, 1.0);
+
+		lm_options<double> opts;
+		opts.use_parallelization = false;
+		lm_options<double> single_lane_opts = opts;
+		single_lane_opts.lockstep_lanes = 1;
+
+		double copy_time = measure_seconds([&]() { general_net<double> tmp(net); }, 1000);
+		double adjacency_time = measure_seconds([&]() { matrix<tapped_delay_line<double>> tmp(net.get_adjacency_matrix()); }, 1000);
+		double jacobian_time = measure_seconds([&]() { neural_nets::detail::calc_jacobian_numerically(net, u, opts); }, 3);
+		double single_lane_time = measure_seconds([&]() { neural_nets::detail::calc_jacobian_numerically(net, u, single_lane_opts); }, 3);
+
+		std::cout << net.get_neuron_count() << '\t' << net.get_parameter_count() << "\t\t" << copy_time << "\t"
+			<< adjacency_time << "\t\t" << jacobian_time << '\t' << single_lane_time << '\n';
+	}
+}
@@ -0,0 +1,286 @@
+#include <iostream> // For output
+#include <fstream> // For the result file
+#include <string>
+#include "neural_nets\neural_nets.h" // All relevant headers for full neural network usage
+#include "neural_nets\compiled_net.h" // Optimized inference plans
+#include "neural_nets\quantized_net.h" // Fixed point inference
+#include "neural_nets\batched_net.h" // Lockstep inference of independent streams
+#include "benchmark_utils.h" // Timing helpers and random network generation
+
+// Performance regression suite. Every measurement is written as one CSV line
+// "benchmark,neurons,density,max_delay,parameters,metric,value,unit" to the file given as first
+// argument (default: benchmark_results.csv), so results can be compared across releases.
+
+namespace
+{
+	struct result_writer
+	{
+		explicit result_writer(std::string const &file_name_) : file(file_name_)
+		{
+			file << "benchmark,neurons,density,max_delay,parameters,metric,value,unit\n";
+		}
+
+		void write(std::string const &benchmark_, size_t neurons_, double density_, size_t max_delay_, size_t parameters_,
+			std::string const &metric_, double value_, std::string const &unit_)
+		{
+			file << benchmark_ << ',' << neurons_ << ',' << density_ << ',' << max_delay_ << ',' << parameters_ << ','
+				<< metric_ << ',' << value_ << ',' << unit_ << '\n';
+			std::cout << benchmark_ << " (" << neurons_ << " neurons, density " << density_ << ", delay " << max_delay_ << "): "
+				<< metric_ << " = " << value_ << ' ' << unit_ << '\n';
+		}
+
+		std::ofstream file;
+	};
+
+	neural_nets::general_net<double> make_xor_net()
+	{
+		neural_nets::general_net<double> net(5);
+		net.connect_neurons(0, 2);
+		net.connect_neurons(0, 3);
+		net.connect_neurons(1, 2);
+		net.connect_neurons(1, 3);
+		net.connect_neurons(2, 4);
+		net.connect_neurons(3, 4);
+		net.declare_as_input(0);
+		net.declare_as_input(1);
+		net.declare_as_output(4);
+		return net;
+	}
+
+	neural_nets::general_net<double> make_recurrent_net()
+	{
+		neural_nets::general_net<double> net(4);
+		net.connect_neurons(0, 1);
+		net.connect_neurons(0, 2);
+		net.connect_neurons(1, 3);
+		net.connect_neurons(2, 3);
+		net.connect_neurons(1, 0, neural_nets::tapped_delay_line<double>(1));
+		net.connect_neurons(2, 0, neural_nets::tapped_delay_line<double>(1));
+		net.declare_as_input(0);
+		net.declare_as_output(3);
+		return net;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	using namespace neural_nets; // Neural network library
+	using namespace boost::numeric::ublas; // Boost vector and matrix libraries
+	using benchmark_utils::measure_seconds;
+
+	result_writer results(argc > 1 ? argv[1] : "benchmark_results.csv");
+
+	auto t = net_signals::linspace(0.0, 1000.0, 1000);
+	auto u = net_signals::amp_pseudo_random_binary_sequence(t, 20.0, -1.0, 1.0);
+
+	// Forward pass and Jacobian for a sweep over network size, density and delay depth
+	for (size_t neuron_count : { 10, 30, 100 }) {
+		for (double density : { 0.1, 0.5 }) {
+			for (size_t max_delay : { 0, 2, 8 }) {
+				auto net = benchmark_utils::make_random_net<double>(neuron_count, density, max_delay);
+				size_t parameters = net.get_parameter_count();
+
+				double forward_time = measure_seconds([&]() { net(u); }, 3);
+				results.write("forward_pass", neuron_count, density, max_delay, parameters, "samples_per_second", u.size1() / forward_time, "1/s");
+
+				compiled_net<double> compiled(net);
+				double compiled_time = measure_seconds([&]() { compiled(u); }, 3);
+				results.write("forward_pass_compiled", neuron_count, density, max_delay, parameters, "samples_per_second", u.size1() / compiled_time, "1/s");
+
+				auto approximated = net;
+				for (size_t i = 0; i < neuron_count; ++i) {
+					if (approximated.get_neuron_activation(i) == activation_function::tanh) {
+						approximated.set_neuron_activation(i, activation_function::rational_tanh);
+					}
+				}
+				compiled_net<double> compiled_approximated(approximated);
+				double approximated_time = measure_seconds([&]() { compiled_approximated(u); }, 3);
+				results.write("forward_pass_compiled_rational_tanh", neuron_count, density, max_delay, parameters, "samples_per_second", u.size1() / approximated_time, "1/s");
+
+				quantized_net<double> quantized(net, u);
+				double quantized_time = measure_seconds([&]() { quantized(u); }, 3);
+				results.write("forward_pass_quantized", neuron_count, density, max_delay, parameters, "samples_per_second", u.size1() / quantized_time, "1/s");
+
+				// 16 independent streams in lockstep, samples of all streams per second
+				batched_net<double> batched(net, 16);
+				matrix<double> u_lanes(16, 1), y_lanes;
+				double batched_time = measure_seconds([&]() {
+					for (size_t i = 0; i < u.size1(); ++i) {
+						std::fill(u_lanes.data().begin(), u_lanes.data().end(), u(i, 0));
+						batched(u_lanes, y_lanes);
+					}
+				}, 3);
+				results.write("forward_pass_batched_16", neuron_count, density, max_delay, parameters, "samples_per_second", 16 * u.size1() / batched_time, "1/s");
+
+				if (parameters <= 1000) {
+					lm_options<double> opts;
+					opts.use_parallelization = false;
+					matrix<double> u_short(subrange(u, 0, 100, 0, 1));
+					double jacobian_time = measure_seconds([&]() { neural_nets::detail::calc_jacobian_numerically(net, u_short, opts); }, 1);
+					results.write("jacobian", neuron_count, density, max_delay, parameters, "seconds_per_column", jacobian_time / parameters, "s");
+				}
+			}
+		}
+	}
+
+	// Forward pass of wide two layer networks, serial and with the neurons of one level evaluated in parallel
+	for (size_t width : { 100, 400 }) {
+		general_net<double> net(2 * width + 2);
+		for (size_t i = 1; i <= width; ++i) {
+			net.connect_neurons(0, i);
+			for (size_t j = 1; j <= width; ++j) {
+				net.connect_neurons(i, width + j);
+			}
+			net.connect_neurons(width + i, 2 * width + 1);
+		}
+		net.declare_as_input(0);
+		net.declare_as_output(2 * width + 1);
+		net.init_random(-0.1, 0.1);
+		matrix<double> u_short(subrange(u, 0, 50, 0, 1));
+
+		net.set_parallel_threshold(0);
+		double serial_time = measure_seconds([&]() { net(u_short); }, 1);
+		results.write("forward_pass_wide_serial", net.get_neuron_count(), 1.0, 0, net.get_parameter_count(), "samples_per_second", u_short.size1() / serial_time, "1/s");
+		net.set_parallel_threshold(1);
+		double parallel_time = measure_seconds([&]() { net(u_short); }, 1);
+		results.write("forward_pass_wide_levels", net.get_neuron_count(), 1.0, 0, net.get_parameter_count(), "samples_per_second", u_short.size1() / parallel_time, "1/s");
+	}
+
+	// Construction of a wide two layer network with banded recurrence in the second layer, connection by connection
+	// and with net_builder
+	for (size_t width : { 100, 400 }) {
+		auto recurrence = make_tapped_delay_line<double>(1, 2);
+		size_t band = 8;
+		double connect_time = measure_seconds([&]() {
+			general_net<double> net(2 * width + 2);
+			for (size_t i = 1; i <= width; ++i) {
+				net.connect_neurons(0, i);
+				for (size_t j = 1; j <= width; ++j) {
+					net.connect_neurons(i, width + j);
+				}
+			}
+			for (size_t i = 0; i < width; ++i) {
+				for (size_t j = i > band ? i - band : 0; j < std::min(width, i + band + 1); ++j) {
+					net.connect_neurons(width + 1 + i, width + 1 + j, recurrence);
+				}
+				net.connect_neurons(width + 1 + i, 2 * width + 1);
+			}
+			net.declare_as_input(0);
+			net.declare_as_output(2 * width + 1);
+			net.get_evaluation_order();
+		}, 1);
+		size_t parameters = 0;
+		double builder_time = measure_seconds([&]() {
+			net_builder<double> builder(1);
+			size_t first = builder.add_neurons(width), second = builder.add_neurons(width), output = builder.add_neurons(1);
+			builder.connect_layers(0, 1, first, width, tapped_delay_line<double>(0));
+			builder.connect_layers(first, width, second, width, tapped_delay_line<double>(0));
+			builder.connect_band(second, width, band, recurrence);
+			builder.connect_layers(second, width, output, 1, tapped_delay_line<double>(0));
+			builder.declare_as_input(0);
+			builder.declare_as_output(output);
+			parameters = builder.build().get_parameter_count();
+		}, 1);
+		results.write("construction_connect", 2 * width + 2, 0.0, 2, parameters, "seconds_per_net", connect_time, "s");
+		results.write("construction_builder", 2 * width + 2, 0.0, 2, parameters, "seconds_per_net", builder_time, "s");
+	}
+
+	// Forward pass of FIR filters with long tapped delay lines (consecutive delays 1..taps)
+	for (size_t taps : { 50, 200 }) {
+		std::vector<neural_nets::detail::tapped_delay<double>> delay_line;
+		for (size_t d = 1; d <= taps; ++d) {
+			delay_line.emplace_back(d);
+		}
+		general_net<double> net(10);
+		for (size_t i = 1; i < 9; ++i) {
+			net.connect_neurons(0, i, tapped_delay_line<double>(delay_line));
+			net.connect_neurons(i, 9);
+		}
+		net.declare_as_input(0);
+		net.declare_as_output(9);
+		net.init_random(-0.1, 0.1);
+		double fir_time = measure_seconds([&]() { net(u); }, 3);
+		results.write("forward_pass_fir", net.get_neuron_count(), 0.0, taps, net.get_parameter_count(), "samples_per_second", u.size1() / fir_time, "1/s");
+	}
+
+	// Linear solver on the normal equations of a random least squares problem
+	for (size_t size : { 50, 200, 500 }) {
+		std::mt19937 engine(42);
+		std::uniform_real_distribution<double> value(-1.0, 1.0);
+		matrix<double> a(2 * size, size);
+		vector<double> b(size);
+		for (size_t i = 0; i < a.size1(); ++i) {
+			for (size_t j = 0; j < a.size2(); ++j) {
+				a(i, j) = value(engine);
+			}
+		}
+		for (size_t i = 0; i < size; ++i) {
+			b(i) = value(engine);
+		}
+		matrix<double> system = prod(trans(a), a);
+		double solve_time = measure_seconds([&]() { neural_nets::detail::matrix_utils::solve_linear_equation_system(system, b); }, 3);
+		results.write("linear_solve", 0, 0.0, 0, size, "seconds_per_solve", solve_time, "s");
+		double cholesky_time = measure_seconds([&]() { neural_nets::detail::linear_algebra::solve_symmetric(system, b, true); }, 3);
+		results.write("linear_solve_cholesky", 0, 0.0, 0, size, "seconds_per_solve", cholesky_time, "s");
+
+		// J^T*J and J^T*e of a Jacobian chunk with 4096 rows, as accumulated by the normal equations
+		matrix<double> jacobian(4096, size);
+		vector<double> errors(4096);
+		for (size_t i = 0; i < jacobian.size1(); ++i) {
+			for (size_t j = 0; j < jacobian.size2(); ++j) {
+				jacobian(i, j) = value(engine);
+			}
+			errors(i) = value(engine);
+		}
+		matrix<double> hessian = zero_matrix<double>(size, size);
+		vector<double> gradient = zero_vector<double>(size);
+		double gram_time = measure_seconds([&]() {
+			neural_nets::detail::linear_algebra::add_gram(jacobian, hessian, true);
+			neural_nets::detail::linear_algebra::add_transposed_product(jacobian, errors, gradient, true);
+		}, 1);
+		results.write("normal_equations_chunk", 0, 0.0, 0, size, "seconds_per_chunk", gram_time, "s");
+	}
+
+	// End to end training on the example topologies
+	{
+		matrix<double> x(4, 2), y(4, 1);
+		x(0, 0) = 0; x(0, 1) = 0; y(0, 0) = 1;
+		x(1, 0) = 0; x(1, 1) = 1; y(1, 0) = 0;
+		x(2, 0) = 1; x(2, 1) = 0; y(2, 0) = 0;
+		x(3, 0) = 1; x(3, 1) = 1; y(3, 0) = 1;
+
+		lm_options<double> opts;
+		opts.display_iterations = false;
+		opts.max_iterations = 100;
+		opts.abs_tol = 0.0;
+		opts.rel_tol = 0.0;
+		auto net = make_xor_net();
+		net.init_random(-0.5, 0.5);
+		std::vector<double> weights;
+		double train_time = measure_seconds([&]() { train_lm(net, x, y, weights, opts); }, 10);
+		results.write("train_lm_xor", net.get_neuron_count(), 0.0, 0, net.get_parameter_count(), "seconds_per_run", train_time, "s");
+	}
+	{
+		auto t_train = net_signals::linspace(0.0, 200.0, 200);
+		auto u_train = net_signals::amp_pseudo_random_binary_sequence(t_train, 20.0, -1.0, 1.0);
+		auto y_train = net_signals::low_pass_filter(t_train, u_train, 1.0, 3.0);
+
+		lm_options<double> opts;
+		opts.display_iterations = false;
+		opts.max_iterations = 100;
+		opts.abs_tol = 0.0;
+		opts.rel_tol = 0.0;
+		auto net = make_recurrent_net();
+		net.init_random(-0.5, 0.5);
+		std::vector<double> weights;
+		double train_time = measure_seconds([&]() { train_lm(net, u_train, y_train, weights, opts); }, 3);
+		results.write("train_lm_recurrent", net.get_neuron_count(), 0.0, 1, net.get_parameter_count(), "seconds_per_run", train_time, "s");
+	}
+
+	// Excitation signal generation
+	for (size_t length : { 10000, 100000 }) {
+		auto t_signal = net_signals::linspace(0.0, static_cast<double>(length), length);
+		double aprbs_time = measure_seconds([&]() { net_signals::amp_pseudo_random_binary_sequence(t_signal, 50.0, -1.0, 1.0); }, 3);
+		results.write("aprbs", 0, 0.0, 0, 0, "samples_per_second", length / aprbs_time, "1/s");
+	}
+}
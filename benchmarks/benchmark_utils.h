@@ -0,0 +1,55 @@
+#ifndef BENCHMARK_UTILS_H
+#define BENCHMARK_UTILS_H
+
+#include <chrono>
+#include <random>
+
+#include "neural_nets\general_net.h"
+
+namespace benchmark_utils
+{
+	// Average wall clock time of one call of f_
+	template <typename func>
+	double measure_seconds(func f_, size_t repetitions_)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < repetitions_; ++i) {
+			f_();
+		}
+		std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+		return elapsed.count() / repetitions_;
+	}
+
+	// Reproducible random network with one input (neuron 0) and one output (last neuron). Instant connections
+	// only lead from lower to higher indices, so there are no algebraic loops. Consecutive neurons are always
+	// connected instantly, any other pair with probability density_. A pair without an instant connection gets a
+	// delay line of max_delay_ taps back from the higher to the lower index with probability density_.
+	template <typename T>
+	neural_nets::general_net<T> make_random_net(size_t neuron_count_, double density_, size_t max_delay_, unsigned seed_ = 42)
+	{
+		std::mt19937 engine(seed_);
+		std::bernoulli_distribution connect(density_);
+		std::uniform_real_distribution<T> weight(-0.5, 0.5);
+
+		neural_nets::general_net<T> net(neuron_count_);
+		for (size_t i = 0; i + 1 < neuron_count_; ++i) {
+			for (size_t j = i + 1; j < neuron_count_; ++j) {
+				if (j == i + 1 || connect(engine)) {
+					net.connect_neurons(i, j, weight(engine));
+				}
+				else if (max_delay_ && connect(engine)) {
+					std::vector<neural_nets::detail::tapped_delay<T>> taps;
+					for (size_t d = 1; d <= max_delay_; ++d) {
+						taps.emplace_back(d, weight(engine));
+					}
+					net.connect_neurons(j, i, neural_nets::tapped_delay_line<T>(taps));
+				}
+			}
+		}
+		net.declare_as_input(0);
+		net.declare_as_output(neuron_count_ - 1);
+		return net;
+	}
+}
+
+#endif
@@ -0,0 +1,350 @@
+#ifndef COMPILED_NET_H
+#define COMPILED_NET_H
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include <boost\numeric\ublas\matrix.hpp>
+
+#include "neural_nets\general_net.h"
+
+// Inference only execution plan of a general_net. The network is flattened into nodes with constant weights in
+// evaluation order and simplified by optimization passes, which give the same outputs (up to rounding) with
+// fewer operations per time step. The nodes of a dependency level are grouped by activation function, so each
+// group is activated with one batched kernel. The plan is not trainable, it has to be compiled again after the
+// weights of the network changed.
+
+namespace neural_nets
+{
+	namespace detail
+	{
+		template <typename T>
+		struct plan_edge
+		{
+			size_t source;
+			size_t delay;
+			T weight;
+		};
+
+		// One neuron of the plan, indexed by neuron
+		template <typename T>
+		struct plan_node
+		{
+			activation_function activation;
+			bool output, removed;
+			T bias;
+			std::vector<std::pair<size_t, T>> inputs; // Input index and weight
+			std::vector<plan_edge<T>> edges;
+		};
+
+		template <typename T>
+		std::vector<plan_node<T>> make_plan_nodes(general_net<T> const &net_)
+		{
+			size_t neuron_count = net_.get_neuron_count();
+			std::vector<plan_node<T>> nodes(neuron_count);
+			for (size_t i = 0; i < neuron_count; ++i) {
+				auto const &current = net_.get_neuron(i);
+				auto &n = nodes[i];
+				n.activation = current.get_activation();
+				n.output = current.is_output();
+				n.removed = false;
+				n.bias = net_.get_neuron_bias_weight(i);
+				if (current.is_input()) {
+					n.inputs.emplace_back(net_.get_input_index(i), T(1));
+				}
+				for (size_t j = 0; j < neuron_count; ++j) {
+					auto const &connection = net_.get_connections()(i, j);
+					for (size_t k = 0; connection.is_connected() && k < connection.get_delay_count(); ++k) {
+						plan_edge<T> e = { j, connection.get_delay_line()[k].delay_index, net_.get_connection_weight(i, j, k) };
+						n.edges.push_back(e);
+					}
+				}
+			}
+			return nodes;
+		}
+
+		// Removes the neurons from which no output can be reached
+		template <typename T>
+		void remove_dead_neurons(std::vector<plan_node<T>> &nodes_)
+		{
+			std::vector<bool> alive(nodes_.size(), false);
+			std::vector<size_t> stack;
+			for (size_t i = 0; i < nodes_.size(); ++i) {
+				if (!nodes_[i].removed && nodes_[i].output) {
+					alive[i] = true;
+					stack.push_back(i);
+				}
+			}
+			while (!stack.empty()) {
+				size_t i = stack.back();
+				stack.pop_back();
+				for (auto const &e : nodes_[i].edges) {
+					if (!alive[e.source]) {
+						alive[e.source] = true;
+						stack.push_back(e.source);
+					}
+				}
+			}
+			for (size_t i = 0; i < nodes_.size(); ++i) {
+				if (!alive[i]) {
+					nodes_[i].removed = true;
+					nodes_[i].edges.clear();
+					nodes_[i].inputs.clear();
+				}
+			}
+		}
+
+		// Replaces every instant use of a linear non-output neuron by its weighted inputs, edges and bias and
+		// removes the neuron. Neurons whose output is also used with a delay keep their state and are not folded,
+		// neither are neurons whose terms would be copied to so many consumers that the step gets more expensive.
+		template <typename T>
+		void fold_linear_neurons(std::vector<plan_node<T>> &nodes_, std::vector<size_t> const &evaluation_order_)
+		{
+			std::vector<bool> delayed_use(nodes_.size(), false);
+			for (auto const &n : nodes_) {
+				for (auto const &e : n.edges) {
+					if (e.delay) {
+						delayed_use[e.source] = true;
+					}
+				}
+			}
+
+			std::vector<plan_edge<T>> edges;
+			for (size_t l : evaluation_order_) {
+				auto &folded = nodes_[l];
+				if (folded.removed || folded.activation != activation_function::linear || folded.output || delayed_use[l]) {
+					continue;
+				}
+				size_t uses = 0, terms = folded.edges.size() + folded.inputs.size();
+				for (auto const &n : nodes_) {
+					uses += std::count_if(n.edges.begin(), n.edges.end(), [l](plan_edge<T> const &e_) { return e_.source == l; });
+				}
+				if (uses*terms > uses + terms) {
+					continue;
+				}
+				for (auto &consumer : nodes_) {
+					if (consumer.removed) {
+						continue;
+					}
+					edges.clear();
+					for (auto const &e : consumer.edges) {
+						if (e.source != l) {
+							edges.push_back(e);
+							continue;
+						}
+						for (auto const &f : folded.edges) {
+							plan_edge<T> replacement = { f.source, f.delay, e.weight*f.weight };
+							edges.push_back(replacement);
+						}
+						for (auto const &f : folded.inputs) {
+							consumer.inputs.emplace_back(f.first, e.weight*f.second);
+						}
+						consumer.bias += e.weight*folded.bias;
+					}
+					consumer.edges.swap(edges);
+				}
+				folded.removed = true;
+				folded.edges.clear();
+				folded.inputs.clear();
+			}
+		}
+
+		// Merges the taps of one neuron with the same source and delay (and the uses of the same input) into one
+		template <typename T>
+		void merge_parallel_taps(std::vector<plan_node<T>> &nodes_)
+		{
+			for (auto &n : nodes_) {
+				std::sort(n.edges.begin(), n.edges.end(), [](plan_edge<T> const &a_, plan_edge<T> const &b_) {
+					return a_.source < b_.source || (a_.source == b_.source && a_.delay < b_.delay);
+				});
+				size_t count = 0;
+				for (size_t i = 0; i < n.edges.size(); ++i) {
+					if (count && n.edges[count - 1].source == n.edges[i].source && n.edges[count - 1].delay == n.edges[i].delay) {
+						n.edges[count - 1].weight += n.edges[i].weight;
+					}
+					else {
+						n.edges[count++] = n.edges[i];
+					}
+				}
+				n.edges.resize(count);
+
+				std::sort(n.inputs.begin(), n.inputs.end(), [](std::pair<size_t, T> const &a_, std::pair<size_t, T> const &b_) { return a_.first < b_.first; });
+				count = 0;
+				for (size_t i = 0; i < n.inputs.size(); ++i) {
+					if (count && n.inputs[count - 1].first == n.inputs[i].first) {
+						n.inputs[count - 1].second += n.inputs[i].second;
+					}
+					else {
+						n.inputs[count++] = n.inputs[i];
+					}
+				}
+				n.inputs.resize(count);
+			}
+		}
+	}
+
+	template <typename T>
+	class compiled_net
+	{
+	public:
+		// Compiles net_ including its current internal memory. Without optimize_, the plan executes every
+		// neuron and tap of net_.
+		explicit compiled_net(general_net<T> net_, bool optimize_ = true);
+
+		size_t get_input_count() const { return input_count; }
+		size_t get_output_count() const { return outputs.size(); }
+		size_t get_neuron_count() const { return nodes.size(); }
+		size_t get_operation_count() const { return edges.size() + inputs.size(); } // Multiply-adds per time step
+
+		void clear_internal_memory() { history = boost::numeric::ublas::zero_matrix<T>(history.size1(), history.size2()); }
+
+		template<typename iter1, typename iter2> void operator()(iter1 input_begin_, iter1 input_end_, iter2 output_begin_, iter2 output_end_);
+		boost::numeric::ublas::matrix<T> operator()(boost::numeric::ublas::matrix<T> const &u_);
+
+	private:
+		struct node
+		{
+			T bias;
+			size_t first_input, last_input, first_edge, last_edge;
+		};
+
+		// Consecutive nodes of one level with the same activation
+		struct node_group
+		{
+			activation_function activation;
+			size_t first_node, last_node;
+		};
+
+		struct edge
+		{
+			size_t source;
+			size_t delay;
+			T weight;
+		};
+
+		std::vector<node> nodes;
+		std::vector<node_group> groups;
+		std::vector<edge> edges;
+		std::vector<std::pair<size_t, T>> inputs;
+		std::vector<size_t> outputs;
+		size_t input_count, current_row;
+
+		// Ring of the node outputs of the last max. delay + 1 time steps, delay_rows[d] is the row d steps ago
+		boost::numeric::ublas::matrix<T> history;
+		std::vector<size_t> delay_rows;
+	};
+
+
+
+
+	template <typename T>
+	compiled_net<T>::compiled_net(general_net<T> net_, bool optimize_) : input_count(net_.get_input_count()), current_row(0)
+	{
+		auto const &order = net_.get_evaluation_order();
+		auto plan = detail::make_plan_nodes(net_);
+		if (optimize_) {
+			detail::remove_dead_neurons(plan);
+			detail::fold_linear_neurons(plan, order);
+			detail::merge_parallel_taps(plan);
+		}
+
+		// Evaluation order by dependency level (over the instant edges left in the plan) and activation
+		std::vector<size_t> levels(plan.size(), 0), sorted;
+		for (size_t i : order) {
+			if (plan[i].removed) {
+				continue;
+			}
+			for (auto const &e : plan[i].edges) {
+				if (!e.delay) {
+					levels[i] = std::max(levels[i], levels[e.source] + 1);
+				}
+			}
+			sorted.push_back(i);
+		}
+		std::stable_sort(sorted.begin(), sorted.end(), [&](size_t a_, size_t b_) {
+			return levels[a_] < levels[b_] || (levels[a_] == levels[b_] && plan[a_].activation < plan[b_].activation);
+		});
+
+		std::vector<size_t> node_indices(plan.size());
+		size_t max_delay = 0;
+		for (size_t i : sorted) {
+			node_indices[i] = nodes.size();
+			if (groups.empty() || levels[i] != levels[sorted[groups.back().first_node]] || plan[i].activation != groups.back().activation) {
+				groups.push_back(node_group{ plan[i].activation, nodes.size(), nodes.size() });
+			}
+			++groups.back().last_node;
+			node n = { plan[i].bias, inputs.size(), inputs.size() + plan[i].inputs.size(), 0, 0 };
+			inputs.insert(inputs.end(), plan[i].inputs.begin(), plan[i].inputs.end());
+			nodes.push_back(n);
+		}
+		for (size_t i : sorted) {
+			auto &n = nodes[node_indices[i]];
+			n.first_edge = edges.size();
+			for (auto const &e : plan[i].edges) {
+				edge compiled = { node_indices[e.source], e.delay, e.weight };
+				edges.push_back(compiled);
+				max_delay = std::max(max_delay, e.delay);
+			}
+			n.last_edge = edges.size();
+		}
+		for (size_t i = 0; i < plan.size(); ++i) {
+			if (plan[i].output) {
+				outputs.push_back(node_indices[i]);
+			}
+		}
+
+		history = boost::numeric::ublas::zero_matrix<T>(max_delay + 1, nodes.size());
+		delay_rows.resize(max_delay + 1);
+		for (size_t i : sorted) {
+			auto const &current = net_.get_neuron(i);
+			for (size_t d = 1; d <= std::min(max_delay, current.get_memory_size()); ++d) {
+				history(history.size1() - d, node_indices[i]) = current.read_from_memory(d - 1);
+			}
+		}
+	}
+
+	template <typename T>
+	template<typename iter1, typename iter2> void compiled_net<T>::operator()(iter1 input_begin_, iter1 input_end_, iter2 output_begin_, iter2 output_end_)
+	{
+		NEURAL_NETS_PROFILE_SCOPE(forward_step);
+		size_t rows = history.size1();
+		for (size_t d = 0; d < rows; ++d) {
+			delay_rows[d] = (current_row + rows - d) % rows;
+		}
+		T *current = history.data().begin() + current_row*history.size2(); // Row major, so the row is contiguous
+		for (auto const &g : groups) {
+			for (size_t k = g.first_node; k < g.last_node; ++k) {
+				auto const &n = nodes[k];
+				T sum = 0;
+				for (size_t i = n.first_input; i < n.last_input; ++i) {
+					sum += inputs[i].second * *std::next(input_begin_, inputs[i].first);
+				}
+				for (size_t e = n.first_edge; e < n.last_edge; ++e) {
+					sum += edges[e].weight * history(delay_rows[edges[e].delay], edges[e].source);
+				}
+				current[k] = sum + n.bias;
+			}
+			apply_activation(g.activation, current + g.first_node, current + g.last_node);
+		}
+		for (size_t i : outputs) {
+			*output_begin_ = current[i];
+			++output_begin_;
+		}
+		current_row = (current_row + 1) % rows;
+	}
+
+	template <typename T>
+	boost::numeric::ublas::matrix<T> compiled_net<T>::operator()(boost::numeric::ublas::matrix<T> const &u_)
+	{
+		boost::numeric::ublas::matrix<T> y(u_.size1(), outputs.size());
+		for (size_t i = 0; i < u_.size1(); ++i) {
+			(*this)(std::next(u_.begin1(), i).begin(), std::next(u_.begin1(), i).end(),
+				std::next(y.begin1(), i).begin(), std::next(y.begin1(), i).end());
+		}
+		return y;
+	}
+}
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef DATASET_SIMULATION_H
+#define DATASET_SIMULATION_H
+
+#include <numeric>
+#include <vector>
+
+#include "neural_nets\net_datasets.h"
+#include "neural_nets\net_threading.h"
+
+namespace neural_nets
+{
+	namespace detail
+	{
+		// Sum of the squared output errors of sys_ on data_. The internal memory of sys_ is cleared afterwards.
+		// A single sequence is simulated serially, the multi-sequence overloads run the sequences in parallel
+		// unless parallel_ is false.
+		template <typename sys_type, typename dataset_type>
+		typename dataset_type::value_type calc_squared_error(sys_type &sys_, dataset_type const &data_, size_t chunk_size_, bool = true)
+		{
+			using T = typename dataset_type::value_type;
+			std::vector<T> output(sys_.get_output_count());
+			T error = 0;
+			for_each_chunk(data_, chunk_size_, [&](size_t, boost::numeric::ublas::matrix<T> const &u_, boost::numeric::ublas::matrix<T> const &y_) {
+				for (size_t i = 0; i < u_.size1(); ++i) {
+					sys_(std::next(u_.begin1(), i).begin(), std::next(u_.begin1(), i).end(), output.begin(), output.end());
+					for (size_t j = 0; j < output.size(); ++j) {
+						error += (y_(i, j) - output[j])*(y_(i, j) - output[j]);
+					}
+				}
+			});
+			sys_.clear_internal_memory();
+			return error;
+		}
+
+		// Streaming counterpart of math_utils::normalized_error applied to the output of sys_ on data_
+		template <typename sys_type, typename dataset_type>
+		typename dataset_type::value_type calc_normalized_error(sys_type &sys_, dataset_type const &data_, size_t chunk_size_, bool = true)
+		{
+			using T = typename dataset_type::value_type;
+			std::vector<T> output(sys_.get_output_count());
+			T error = 0;
+			for_each_chunk(data_, chunk_size_, [&](size_t, boost::numeric::ublas::matrix<T> const &u_, boost::numeric::ublas::matrix<T> const &y_) {
+				for (size_t i = 0; i < u_.size1(); ++i) {
+					sys_(std::next(u_.begin1(), i).begin(), std::next(u_.begin1(), i).end(), output.begin(), output.end());
+					error += (output[0] - y_(i, 0))*(output[0] - y_(i, 0));
+				}
+			});
+			sys_.clear_internal_memory();
+			return error / (data_.get_sample_count() + 1);
+		}
+
+		// Every sequence starts from its own initial state, the internal memory of sys_ is cleared afterwards
+		template <typename sys_type, typename dataset_type>
+		typename dataset_type::value_type calc_squared_error(sys_type &sys_, multi_sequence_dataset<dataset_type> const &data_, size_t chunk_size_, bool parallel_ = true)
+		{
+			using T = typename dataset_type::value_type;
+			std::vector<T> errors(data_.get_sequence_count());
+			parallel_for(0, errors.size(), [&](size_t i) {
+				sys_type sys(sys_);
+				data_.reset_state(sys, i);
+				errors[i] = calc_squared_error(sys, data_.get_sequence(i), chunk_size_);
+			}, parallel_);
+			T error = std::accumulate(errors.begin(), errors.end(), T(0));
+			sys_.clear_internal_memory();
+			return error;
+		}
+
+		template <typename sys_type, typename dataset_type>
+		typename dataset_type::value_type calc_normalized_error(sys_type &sys_, multi_sequence_dataset<dataset_type> const &data_, size_t chunk_size_, bool parallel_ = true)
+		{
+			using T = typename dataset_type::value_type;
+			std::vector<T> errors(data_.get_sequence_count());
+			parallel_for(0, errors.size(), [&](size_t i) {
+				sys_type sys(sys_);
+				data_.reset_state(sys, i);
+				errors[i] = calc_normalized_error(sys, data_.get_sequence(i), chunk_size_)*(data_.get_sequence(i).get_sample_count() + 1);
+			}, parallel_);
+			T error = std::accumulate(errors.begin(), errors.end(), T(0));
+			sys_.clear_internal_memory();
+			return error / (data_.get_sample_count() + 1);
+		}
+
+		// Difference between the largest and the smallest value of every output signal of data_
+		template <typename dataset_type>
+		std::vector<typename dataset_type::value_type> calc_output_ranges(dataset_type const &data_, size_t chunk_size_)
+		{
+			using T = typename dataset_type::value_type;
+			std::vector<T> minimum(data_.get_output_count(), std::numeric_limits<T>::max());
+			std::vector<T> maximum(data_.get_output_count(), std::numeric_limits<T>::lowest());
+			for_each_chunk(data_, chunk_size_, [&](size_t, boost::numeric::ublas::matrix<T> const &, boost::numeric::ublas::matrix<T> const &y_) {
+				for (size_t i = 0; i < y_.size1(); ++i) {
+					for (size_t j = 0; j < y_.size2(); ++j) {
+						minimum[j] = std::min(minimum[j], y_(i, j));
+						maximum[j] = std::max(maximum[j], y_(i, j));
+					}
+				}
+			});
+			std::vector<T> ranges(minimum.size(), 0);
+			for (size_t j = 0; j < ranges.size(); ++j) {
+				if (maximum[j] >= minimum[j]) {
+					ranges[j] = maximum[j] - minimum[j];
+				}
+			}
+			return ranges;
+		}
+	}
+}
+
+#endif
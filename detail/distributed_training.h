@@ -0,0 +1,284 @@
+#ifndef DISTRIBUTED_TRAINING_H
+#define DISTRIBUTED_TRAINING_H
+
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "neural_nets\neural_exception.h"
+#include "neural_nets\training_options.h"
+#include "neural_nets\net_datasets.h"
+#include "neural_nets\detail\dataset_simulation.h"
+#include "neural_nets\detail\jacobian_calculation.h"
+#include "neural_nets\detail\parameter_batch.h"
+
+// Protocol of data parallel Levenberg-Marquardt training (see net_distributed.h). The coordinator runs train_lm
+// on a distributed_dataset: wherever train_lm evaluates the data, the coordinator sends a request with the
+// parameters to every worker, evaluates its own slice and adds the replies of the workers in rank order.
+// Workers only answer requests. A transport connects the coordinator with its peers (the workers, or for a
+// worker the coordinator) and provides
+//   size_t get_peer_count() const
+//   void send(size_t peer_, void const *data_, size_t size_)
+//   void receive(size_t peer_, void *data_, size_t size_)
+// as blocking, reliable byte streams. Values are sent in the native representation, so all processes must run
+// on machines with the same byte order and floating point type.
+
+namespace neural_nets
+{
+	namespace detail
+	{
+		namespace distributed
+		{
+			enum class command : std::uint64_t
+			{
+				normal_equations = 1, // Parameters -> lower triangle of J^T*J, J^T*e and the squared error
+				squared_error, // Parameters -> squared error
+				squared_errors, // count parameter vectors -> count squared errors
+				stop
+			};
+
+			static std::uint64_t const reply_ok = 0;
+			static std::uint64_t const reply_error = 1; // Followed by a message instead of values
+
+			// Precedes every request (code is a command) and reply, size bytes follow
+			struct message_header
+			{
+				std::uint64_t code, count, size;
+			};
+
+			// Sent by every worker once connected
+			struct worker_hello
+			{
+				std::uint64_t sample_count, input_count, output_count, scalar_size;
+			};
+
+			template <typename transport_type, typename T>
+			void send_values(transport_type &transport_, size_t peer_, std::uint64_t code_, std::uint64_t count_, std::vector<T> const &values_)
+			{
+				message_header header{ code_, count_, values_.size()*sizeof(T) };
+				transport_.send(peer_, &header, sizeof(header));
+				if (!values_.empty()) {
+					transport_.send(peer_, values_.data(), values_.size()*sizeof(T));
+				}
+			}
+
+			template <typename transport_type, typename T>
+			void receive_values(transport_type &transport_, size_t peer_, std::vector<T> &values_)
+			{
+				if (!values_.empty()) {
+					transport_.receive(peer_, values_.data(), values_.size()*sizeof(T));
+				}
+			}
+
+			template <typename transport_type>
+			void send_error(transport_type &transport_, size_t peer_, std::string const &message_)
+			{
+				message_header header{ reply_error, 0, message_.size() };
+				transport_.send(peer_, &header, sizeof(header));
+				if (!message_.empty()) {
+					transport_.send(peer_, message_.data(), message_.size());
+				}
+			}
+
+			// Reads a reply of values_.size() values, returns the message of a failed worker or an empty string
+			template <typename transport_type, typename T>
+			std::string receive_reply(transport_type &transport_, size_t peer_, std::vector<T> &values_)
+			{
+				message_header header;
+				transport_.receive(peer_, &header, sizeof(header));
+				if (header.code != reply_ok) {
+					std::string message(static_cast<size_t>(header.size), ' ');
+					if (!message.empty()) {
+						transport_.receive(peer_, &message[0], message.size());
+					}
+					return message.empty() ? "unknown error" : message;
+				}
+				if (header.size != values_.size()*sizeof(T)) {
+					throw neural_exception("Worker " + std::to_string(peer_ + 1) + " sent a reply of unexpected size!");
+				}
+				receive_values(transport_, peer_, values_);
+				return std::string();
+			}
+
+			template <typename T>
+			void pack_normal_equations(boost::numeric::ublas::matrix<T> const &hessian_, boost::numeric::ublas::vector<T> const &gradient_, T squared_error_, std::vector<T> &packed_)
+			{
+				size_t n = gradient_.size();
+				packed_.clear();
+				packed_.reserve(n*(n + 1) / 2 + n + 1);
+				for (size_t i = 0; i < n; ++i) {
+					for (size_t j = 0; j <= i; ++j) {
+						packed_.push_back(hessian_(i, j));
+					}
+				}
+				packed_.insert(packed_.end(), gradient_.begin(), gradient_.end());
+				packed_.push_back(squared_error_);
+			}
+
+			template <typename T>
+			void add_packed_normal_equations(std::vector<T> const &packed_, boost::numeric::ublas::matrix<T> &hessian_, boost::numeric::ublas::vector<T> &gradient_, T &squared_error_)
+			{
+				size_t n = gradient_.size(), k = 0;
+				for (size_t i = 0; i < n; ++i) {
+					for (size_t j = 0; j <= i; ++j, ++k) {
+						hessian_(i, j) += packed_[k];
+						if (j < i) {
+							hessian_(j, i) += packed_[k];
+						}
+					}
+				}
+				for (size_t i = 0; i < n; ++i, ++k) {
+					gradient_(i) += packed_[k];
+				}
+				squared_error_ += packed_[k];
+			}
+		}
+	}
+
+	// Training data split over several processes: the local slice of this process (the coordinator) and the
+	// slices of the workers connected by transport_. Used like a dataset with train_lm, it stands for the union of
+	// all slices. The workers are stopped by stop_workers or the destructor.
+	template <typename dataset_type, typename transport_type>
+	class distributed_dataset
+	{
+	public:
+		typedef typename dataset_type::value_type value_type;
+
+		distributed_dataset(dataset_type const &local_, transport_type &transport_) : local(local_), transport(&transport_), sample_count(local_.get_sample_count()), stopped(false)
+		{
+			for (size_t i = 0; i < transport_.get_peer_count(); ++i) {
+				detail::distributed::worker_hello hello;
+				transport_.receive(i, &hello, sizeof(hello));
+				if (hello.scalar_size != sizeof(value_type) || hello.input_count != local_.get_input_count() || hello.output_count != local_.get_output_count()) {
+					throw neural_exception("Worker " + std::to_string(i + 1) + " has data of a different shape or type!");
+				}
+				sample_count += static_cast<size_t>(hello.sample_count);
+			}
+		}
+
+		~distributed_dataset()
+		{
+			try {
+				stop_workers();
+			}
+			catch (...) {
+			}
+		}
+
+		distributed_dataset(distributed_dataset const &) = delete;
+		distributed_dataset &operator=(distributed_dataset const &) = delete;
+
+		size_t get_sample_count() const { return sample_count; }
+		size_t get_input_count() const { return local.get_input_count(); }
+		size_t get_output_count() const { return local.get_output_count(); }
+		size_t get_worker_count() const { return transport->get_peer_count(); }
+		dataset_type const &get_local() const { return local; }
+
+		// Sends a request to every worker, runs local_() on the local slice meanwhile and passes the replies of
+		// reply_size_ values to add_ in rank order. Failures are rethrown once every reply has been read, so the
+		// workers stay usable.
+		template <typename local_function, typename add_function>
+		void evaluate(detail::distributed::command command_, std::uint64_t count_, std::vector<value_type> const &values_, size_t reply_size_,
+			local_function local_, add_function add_) const
+		{
+			for (size_t i = 0; i < transport->get_peer_count(); ++i) {
+				detail::distributed::send_values(*transport, i, static_cast<std::uint64_t>(command_), count_, values_);
+			}
+			std::exception_ptr error;
+			try {
+				local_();
+			}
+			catch (...) {
+				error = std::current_exception();
+			}
+			std::vector<value_type> reply(reply_size_);
+			for (size_t i = 0; i < transport->get_peer_count(); ++i) {
+				std::string message = detail::distributed::receive_reply(*transport, i, reply);
+				if (!message.empty() && !error) {
+					error = std::make_exception_ptr(neural_exception("Worker " + std::to_string(i + 1) + " failed: " + message));
+				}
+				if (!error) {
+					add_(reply);
+				}
+			}
+			if (error) {
+				std::rethrow_exception(error);
+			}
+		}
+
+		void stop_workers()
+		{
+			if (!stopped) {
+				stopped = true;
+				for (size_t i = 0; i < transport->get_peer_count(); ++i) {
+					detail::distributed::send_values(*transport, i, static_cast<std::uint64_t>(detail::distributed::command::stop), 0, std::vector<value_type>());
+				}
+			}
+		}
+
+	private:
+		dataset_type local;
+		transport_type *transport;
+		size_t sample_count;
+		bool stopped;
+	};
+
+	namespace detail
+	{
+		template <typename T, typename sys_type, typename dataset_type, typename transport_type>
+		void calc_normal_equations_numerically(sys_type const &sys_, distributed_dataset<dataset_type, transport_type> const &data_, lm_options<T> const &options_,
+			boost::numeric::ublas::matrix<T> &hessian_approx_, boost::numeric::ublas::vector<T> &gradient_, T &squared_error_)
+		{
+			std::vector<T> parameters(sys_.get_parameter_count());
+			sys_.get_parameters(parameters.begin(), parameters.end());
+			size_t n = parameters.size();
+			data_.evaluate(distributed::command::normal_equations, 1, parameters, n*(n + 1) / 2 + n + 1, [&]() {
+				calc_normal_equations_numerically(sys_, data_.get_local(), options_, hessian_approx_, gradient_, squared_error_);
+			}, [&](std::vector<T> const &reply_) {
+				distributed::add_packed_normal_equations(reply_, hessian_approx_, gradient_, squared_error_);
+			});
+		}
+
+		template <typename sys_type, typename dataset_type, typename transport_type>
+		typename dataset_type::value_type calc_squared_error(sys_type &sys_, distributed_dataset<dataset_type, transport_type> const &data_, size_t chunk_size_, bool parallel_ = true)
+		{
+			using T = typename dataset_type::value_type;
+			std::vector<T> parameters(sys_.get_parameter_count());
+			sys_.get_parameters(parameters.begin(), parameters.end());
+			T error = 0;
+			data_.evaluate(distributed::command::squared_error, 1, parameters, 1, [&]() {
+				error = calc_squared_error(sys_, data_.get_local(), chunk_size_, parallel_);
+			}, [&](std::vector<T> const &reply_) {
+				error += reply_[0];
+			});
+			return error;
+		}
+
+		template <typename sys_type, typename T, typename dataset_type, typename transport_type>
+		std::vector<T> calc_squared_errors(sys_type const &sys_, std::vector<std::vector<T>> const &parameters_, distributed_dataset<dataset_type, transport_type> const &data_,
+			lm_options<T> const &options_)
+		{
+			std::vector<T> flat, errors;
+			for (auto const &i : parameters_) {
+				flat.insert(flat.end(), i.begin(), i.end());
+			}
+			data_.evaluate(distributed::command::squared_errors, parameters_.size(), flat, parameters_.size(), [&]() {
+				errors = calc_squared_errors(sys_, parameters_, data_.get_local(), options_);
+			}, [&](std::vector<T> const &reply_) {
+				for (size_t j = 0; j < errors.size(); ++j) {
+					errors[j] += reply_[j];
+				}
+			});
+			return errors;
+		}
+
+		template <typename sys_type, typename T, typename dataset_type, typename transport_type>
+		void extend_normal_equations(normal_equations_state<sys_type, T> &, distributed_dataset<dataset_type, transport_type> const &, lm_options<T> const &)
+		{
+			throw neural_exception("Horizons of distributed datasets can not be continued!");
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef FIR_KERNELS_H
+#define FIR_KERNELS_H
+
+#include <cstddef>
+
+#if !defined(NEURAL_NETS_DISABLE_SIMD) && defined(__AVX__)
+#include <immintrin.h>
+#define NEURAL_NETS_AVX_FIR
+#endif
+
+// Dot product kernels for runs of taps with consecutive delays: the weights of a run are contiguous and the
+// history of the source neuron is stored newest first, so a run is a dot product of two contiguous arrays.
+// AVX (with FMA if available) is used when the headers are compiled with it, unless NEURAL_NETS_DISABLE_SIMD
+// is defined.
+
+namespace neural_nets
+{
+	namespace detail
+	{
+		// Runs shorter than this are summed in tap order, so short delay lines give exactly the same result as
+		// the tap by tap evaluation
+		static size_t const fir_min_vector_length = 16;
+
+		template <typename T>
+		T fir_dot_scalar(T const *weights_, T const *history_, size_t length_)
+		{
+			T sum0(0), sum1(0), sum2(0), sum3(0);
+			size_t i = 0;
+			for (; i + 4 <= length_; i += 4) {
+				sum0 += weights_[i] * history_[i];
+				sum1 += weights_[i + 1] * history_[i + 1];
+				sum2 += weights_[i + 2] * history_[i + 2];
+				sum3 += weights_[i + 3] * history_[i + 3];
+			}
+			for (; i < length_; ++i) {
+				sum0 += weights_[i] * history_[i];
+			}
+			return (sum0 + sum1) + (sum2 + sum3);
+		}
+
+		template <typename T>
+		T fir_dot(T const *weights_, T const *history_, size_t length_)
+		{
+			return fir_dot_scalar(weights_, history_, length_);
+		}
+
+#ifdef NEURAL_NETS_AVX_FIR
+#ifdef __FMA__
+#define NEURAL_NETS_FIR_MADD_PD(a_, b_, c_) _mm256_fmadd_pd(a_, b_, c_)
+#define NEURAL_NETS_FIR_MADD_PS(a_, b_, c_) _mm256_fmadd_ps(a_, b_, c_)
+#else
+#define NEURAL_NETS_FIR_MADD_PD(a_, b_, c_) _mm256_add_pd(_mm256_mul_pd(a_, b_), c_)
+#define NEURAL_NETS_FIR_MADD_PS(a_, b_, c_) _mm256_add_ps(_mm256_mul_ps(a_, b_), c_)
+#endif
+
+		template <>
+		inline double fir_dot(double const *weights_, double const *history_, size_t length_)
+		{
+			__m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+			size_t i = 0;
+			for (; i + 8 <= length_; i += 8) {
+				sum0 = NEURAL_NETS_FIR_MADD_PD(_mm256_loadu_pd(weights_ + i), _mm256_loadu_pd(history_ + i), sum0);
+				sum1 = NEURAL_NETS_FIR_MADD_PD(_mm256_loadu_pd(weights_ + i + 4), _mm256_loadu_pd(history_ + i + 4), sum1);
+			}
+			for (; i + 4 <= length_; i += 4) {
+				sum0 = NEURAL_NETS_FIR_MADD_PD(_mm256_loadu_pd(weights_ + i), _mm256_loadu_pd(history_ + i), sum0);
+			}
+			double lanes[4];
+			_mm256_storeu_pd(lanes, _mm256_add_pd(sum0, sum1));
+			double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+			for (; i < length_; ++i) {
+				sum += weights_[i] * history_[i];
+			}
+			return sum;
+		}
+
+		template <>
+		inline float fir_dot(float const *weights_, float const *history_, size_t length_)
+		{
+			__m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+			size_t i = 0;
+			for (; i + 16 <= length_; i += 16) {
+				sum0 = NEURAL_NETS_FIR_MADD_PS(_mm256_loadu_ps(weights_ + i), _mm256_loadu_ps(history_ + i), sum0);
+				sum1 = NEURAL_NETS_FIR_MADD_PS(_mm256_loadu_ps(weights_ + i + 8), _mm256_loadu_ps(history_ + i + 8), sum1);
+			}
+			for (; i + 8 <= length_; i += 8) {
+				sum0 = NEURAL_NETS_FIR_MADD_PS(_mm256_loadu_ps(weights_ + i), _mm256_loadu_ps(history_ + i), sum0);
+			}
+			float lanes[8];
+			_mm256_storeu_ps(lanes, _mm256_add_ps(sum0, sum1));
+			float sum = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+			for (; i < length_; ++i) {
+				sum += weights_[i] * history_[i];
+			}
+			return sum;
+		}
+
+#undef NEURAL_NETS_FIR_MADD_PD
+#undef NEURAL_NETS_FIR_MADD_PS
+#endif
+
+		// Adds the run to sum_
+		template <typename T>
+		T fir_accumulate(T sum_, T const *weights_, T const *history_, size_t length_)
+		{
+			if (length_ < fir_min_vector_length) {
+				for (size_t i = 0; i < length_; ++i) {
+					sum_ += weights_[i] * history_[i];
+				}
+				return sum_;
+			}
+			return sum_ + fir_dot(weights_, history_, length_);
+		}
+	}
+}
+
+#endif
@@ -1,50 +1,211 @@
 #ifndef JACOBIAN_CALCULATION_H
 #define JACOBIAN_CALCULATION_H
 
+#include <mutex>
+
 #include "neural_nets\training_options.h"
+#include "neural_nets\net_profiling.h"
+#include "neural_nets\net_datasets.h"
+#include "neural_nets\net_threading.h"
+#include "neural_nets\detail\dataset_simulation.h"
+#include "neural_nets\detail\linear_algebra.h"
+#include "neural_nets\detail\parameter_batch.h"
 
 namespace neural_nets
 {
 	namespace detail
 	{
+		// Lane 0 simulates weights_, lane i + 1 the weights with parameter i decreased by epsilons_[i]. The lanes
+		// are split into blocks of equal size, one batch per block.
+		template <typename sys_type, typename T>
+		void make_perturbed_batches(sys_type const &sys_, std::vector<T> const &weights_, std::vector<T> &epsilons_, lm_options<T> const &options_,
+			std::vector<parameter_batch<sys_type, T>> &batches_)
+		{
+			size_t parameter_count = weights_.size();
+			epsilons_.resize(parameter_count);
+			std::vector<std::vector<T>> lanes(parameter_count + 1, weights_);
+			for (size_t i = 0; i < parameter_count; ++i) {
+				epsilons_[i] = detail::math_utils::calc_optimal_epsilon(weights_[i]);
+				lanes[i + 1][i] -= epsilons_[i];
+			}
+
+			size_t block = get_lane_block_size<sys_type>(lanes.size(), options_);
+			batches_.clear();
+			batches_.reserve((lanes.size() + block - 1) / block);
+			for (size_t first = 0; first < lanes.size(); first += block) {
+				batches_.emplace_back(sys_, std::vector<std::vector<T>>(lanes.begin() + first, lanes.begin() + std::min(lanes.size(), first + block)));
+			}
+		}
+
+		// Continues the batches on the rows of u_: out_before_ gets the nominal outputs and jacobian_ the
+		// difference quotients, row j*out_cnt + k for output k of sample j
+		template <typename sys_type, typename T>
+		void simulate_perturbed_batches(std::vector<parameter_batch<sys_type, T>> &batches_, std::vector<T> const &epsilons_, boost::numeric::ublas::matrix<T> const &u_,
+			boost::numeric::ublas::matrix<T> &out_before_, boost::numeric::ublas::matrix<T> &jacobian_, lm_options<T> const &options_)
+		{
+			size_t rows = u_.size1(), out_cnt = batches_.front().get_output_count(), block = batches_.front().get_lane_count();
+			out_before_.resize(rows, out_cnt, false);
+			jacobian_.resize(rows*out_cnt, epsilons_.size(), false);
+
+			auto jacobian_for_body = [&](size_t b) {
+				NEURAL_NETS_PROFILE_SCOPE(jacobian_column);
+				boost::numeric::ublas::matrix<T> outputs(batches_[b].get_lane_count(), out_cnt);
+				for (size_t j = 0; j < rows; ++j) {
+					batches_[b](std::next(u_.begin1(), j).begin(), std::next(u_.begin1(), j).end(), outputs);
+					for (size_t m = 0; m < outputs.size1(); ++m) {
+						size_t lane = b*block + m;
+						for (size_t k = 0; k < out_cnt; ++k) {
+							if (lane == 0) {
+								out_before_(j, k) = outputs(m, k);
+							}
+							else {
+								jacobian_(j*out_cnt + k, lane - 1) = outputs(m, k);
+							}
+						}
+					}
+				}
+			};
+
+			parallel_for(0, batches_.size(), jacobian_for_body, options_.use_parallelization);
+
+			for (size_t j = 0; j < rows; ++j) {
+				for (size_t k = 0; k < out_cnt; ++k) {
+					for (size_t i = 0; i < epsilons_.size(); ++i) {
+						jacobian_(j*out_cnt + k, i) = (out_before_(j, k) - jacobian_(j*out_cnt + k, i)) / epsilons_[i];
+					}
+				}
+			}
+		}
+
 		template <typename T, typename sys_type>
 		boost::numeric::ublas::matrix<T> calc_jacobian_numerically(sys_type const &sys_, boost::numeric::ublas::matrix<T> const &inputs_, lm_options<T> const &options_)
 		{
-
-			size_t out_cnt = sys_.get_output_count();
-			std::vector<T> weights(sys_.get_parameter_count());
+			std::vector<T> weights(sys_.get_parameter_count()), epsilons;
 			sys_.get_parameters(weights.begin(), weights.end());
-			boost::numeric::ublas::matrix<T> jacobian(inputs_.size1()*sys_.get_output_count(), sys_.get_parameter_count());
 
-			auto jacobian_for_body = [&](size_t i) {
-				sys_type sys(sys_);
-				sys_type tmp_sys(sys_);
+			std::vector<parameter_batch<sys_type, T>> batches;
+			make_perturbed_batches(sys_, weights, epsilons, options_, batches);
+			boost::numeric::ublas::matrix<T> out_before, jacobian;
+			simulate_perturbed_batches(batches, epsilons, inputs_, out_before, jacobian, options_);
+			return jacobian;
+		}
 
-				std::vector<T> tmp_weights = weights, out_before(out_cnt), out_after(out_cnt);
-				T epsilon = detail::math_utils::calc_optimal_epsilon(tmp_weights[i]);
-				tmp_weights[i] -= epsilon;
-				tmp_sys.set_parameters(tmp_weights.begin(), tmp_weights.end());
+		// Partially accumulated normal equations of one parameter vector: the batches of the nominal and the
+		// perturbed parameters with their internal memory after the first sample_count samples, and the sums so far.
+		// Accumulation can be continued when more samples are appended to the data.
+		template <typename sys_type, typename T>
+		struct normal_equations_state
+		{
+			std::vector<T> weights, epsilons;
+			std::vector<parameter_batch<sys_type, T>> batches;
+			size_t sample_count = 0;
+			boost::numeric::ublas::matrix<T> hessian_approx;
+			boost::numeric::ublas::vector<T> gradient;
+			T squared_error = 0;
+		};
 
-				for (size_t j = 0; j < inputs_.size1(); ++j) {
+		template <typename sys_type, typename T>
+		void start_normal_equations(sys_type const &sys_, normal_equations_state<sys_type, T> &state_, lm_options<T> const &options_)
+		{
+			using namespace boost::numeric::ublas;
 
-					sys(std::next(inputs_.begin1(), j).begin(), std::next(inputs_.begin1(), j).end(),
-						out_before.begin(), out_before.end());
-					tmp_sys(std::next(inputs_.begin1(), j).begin(), std::next(inputs_.begin1(), j).end(), out_after.begin(), out_after.end());
+			size_t parameter_count = sys_.get_parameter_count();
+			state_.weights.resize(parameter_count);
+			sys_.get_parameters(state_.weights.begin(), state_.weights.end());
+			make_perturbed_batches(sys_, state_.weights, state_.epsilons, options_, state_.batches);
 
+			state_.sample_count = 0;
+			state_.hessian_approx = zero_matrix<T>(parameter_count, parameter_count);
+			state_.gradient = zero_vector<T>(parameter_count);
+			state_.squared_error = 0;
+		}
+
+		// Accumulates the Gauss-Newton normal equations J^T*J and J^T*e on the samples of data_ after
+		// state_.sample_count, chunk by chunk with a numerically calculated Jacobian J and the errors e = y - y_sys.
+		// Only one chunk of Jacobian rows is held in memory at a time.
+		template <typename sys_type, typename T, typename dataset_type>
+		void extend_normal_equations(normal_equations_state<sys_type, T> &state_, dataset_type const &data_, lm_options<T> const &options_)
+		{
+			using namespace boost::numeric::ublas;
+
+			size_t first = state_.sample_count, sample_count = data_.get_sample_count();
+			if (first >= sample_count) {
+				return;
+			}
+			size_t out_cnt = state_.batches.front().get_output_count();
+
+			matrix<T> jacobian, out_before;
+			vector<T> errors;
+			for_each_chunk(dataset_range<dataset_type>(data_, first, sample_count - first), options_.chunk_size, [&](size_t, matrix<T> const &u_, matrix<T> const &y_) {
+				size_t rows = u_.size1();
+				simulate_perturbed_batches(state_.batches, state_.epsilons, u_, out_before, jacobian, options_);
+
+				errors.resize(rows*out_cnt, false);
+				for (size_t j = 0; j < rows; ++j) {
 					for (size_t k = 0; k < out_cnt; ++k) {
-						jacobian(j*out_cnt + k, i) = (out_before[k] - out_after[k]) / epsilon;
+						errors(j*out_cnt + k) = y_(j, k) - out_before(j, k);
+						state_.squared_error += errors(j*out_cnt + k)*errors(j*out_cnt + k);
 					}
 				}
-			};
 
-			if (options_.use_parallelization) {
-#pragma omp parallel for
-				for (size_t i = 0; i < jacobian.size2(); ++i) { jacobian_for_body(i); }
-			}
-			else {
-				for (size_t i = 0; i < jacobian.size2(); ++i) { jacobian_for_body(i); }
+				NEURAL_NETS_PROFILE_SCOPE(normal_equations);
+				linear_algebra::add_gram(jacobian, state_.hessian_approx, options_.use_parallelization);
+				linear_algebra::add_transposed_product(jacobian, errors, state_.gradient, options_.use_parallelization);
+			});
+			state_.sample_count = sample_count;
+		}
+
+		// Whether state_ holds the first samples of a longer horizon simulated with the parameters of sys_
+		template <typename sys_type, typename T, typename dataset_type>
+		bool can_extend_normal_equations(normal_equations_state<sys_type, T> const &state_, sys_type const &sys_, dataset_type const &data_)
+		{
+			if (state_.batches.empty() || state_.sample_count > data_.get_sample_count() || state_.weights.size() != sys_.get_parameter_count()) {
+				return false;
 			}
-			return jacobian;
+			std::vector<T> weights(sys_.get_parameter_count());
+			sys_.get_parameters(weights.begin(), weights.end());
+			return weights == state_.weights;
+		}
+
+		template <typename T, typename sys_type, typename dataset_type>
+		void calc_normal_equations_numerically(sys_type const &sys_, dataset_type const &data_, lm_options<T> const &options_,
+			boost::numeric::ublas::matrix<T> &hessian_approx_, boost::numeric::ublas::vector<T> &gradient_, T &squared_error_)
+		{
+			normal_equations_state<sys_type, T> state;
+			start_normal_equations(sys_, state, options_);
+			extend_normal_equations(state, data_, options_);
+			hessian_approx_.swap(state.hessian_approx);
+			gradient_.swap(state.gradient);
+			squared_error_ = state.squared_error;
+		}
+
+		// Normal equations of independent sequences, each simulated from its own initial state, summed into one
+		// least squares problem. Sequences and the Jacobian columns within them share the thread pool.
+		template <typename T, typename sys_type, typename dataset_type>
+		void calc_normal_equations_numerically(sys_type const &sys_, multi_sequence_dataset<dataset_type> const &data_, lm_options<T> const &options_,
+			boost::numeric::ublas::matrix<T> &hessian_approx_, boost::numeric::ublas::vector<T> &gradient_, T &squared_error_)
+		{
+			using namespace boost::numeric::ublas;
+
+			size_t parameter_count = sys_.get_parameter_count();
+			hessian_approx_ = zero_matrix<T>(parameter_count, parameter_count);
+			gradient_ = zero_vector<T>(parameter_count);
+			squared_error_ = 0;
+
+			std::mutex sum_mutex;
+			parallel_for(0, data_.get_sequence_count(), [&](size_t i) {
+				sys_type sys(sys_);
+				data_.reset_state(sys, i);
+				matrix<T> hessian;
+				vector<T> gradient;
+				T error;
+				calc_normal_equations_numerically(sys, data_.get_sequence(i), options_, hessian, gradient, error);
+
+				std::lock_guard<std::mutex> lock(sum_mutex);
+				noalias(hessian_approx_) += hessian;
+				noalias(gradient_) += gradient;
+				squared_error_ += error;
+			}, options_.use_parallelization);
 		}
 	}
 }
@@ -0,0 +1,375 @@
+#ifndef LINEAR_ALGEBRA_H
+#define LINEAR_ALGEBRA_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <boost\numeric\ublas\vector.hpp>
+#include <boost\numeric\ublas\matrix.hpp>
+
+#include "neural_nets\detail\matrix_utils.h"
+#include "neural_nets\net_threading.h"
+
+#ifdef NEURAL_NETS_USE_BLAS
+#include <cblas.h>
+#endif
+
+#ifdef NEURAL_NETS_USE_LAPACK
+extern "C"
+{
+	void dpotrf_(char const *uplo, int const *n, double *a, int const *lda, int *info);
+	void spotrf_(char const *uplo, int const *n, float *a, int const *lda, int *info);
+	void dpotrs_(char const *uplo, int const *n, int const *nrhs, double const *a, int const *lda, double *b, int const *ldb, int *info);
+	void spotrs_(char const *uplo, int const *n, int const *nrhs, float const *a, int const *lda, float *b, int const *ldb, int *info);
+}
+#endif
+
+// Dense kernels of the Levenberg-Marquardt normal equations: c += a^T*a (SYRK), y += a^T*x (GEMV) and the
+// Cholesky solve of the damped system. Backends provide the static functions add_gram, add_transposed_product
+// and cholesky_solve (which returns false if the matrix is not positive definite):
+//   builtin_backend  cache blocked loops over contiguous rows, vectorized by the compiler, on the thread pool
+//   blas_backend     CBLAS (NEURAL_NETS_USE_BLAS) and LAPACK (NEURAL_NETS_USE_LAPACK) for float and double
+//   ublas_backend    the plain ublas expressions and LU elimination (NEURAL_NETS_UBLAS_LINEAR_ALGEBRA)
+// The macros are defined before including the library; BLAS/LAPACK must then be linked.
+
+namespace neural_nets
+{
+	namespace detail
+	{
+		namespace linear_algebra
+		{
+			// Multiply-adds below which the kernels stay serial
+			static size_t const parallel_work = 1 << 18;
+
+			template <typename T>
+			T dot(T const *x_, T const *y_, size_t length_)
+			{
+				T sum0(0), sum1(0);
+				size_t i = 0;
+				for (; i + 2 <= length_; i += 2) {
+					sum0 += x_[i] * y_[i];
+					sum1 += x_[i + 1] * y_[i + 1];
+				}
+				for (; i < length_; ++i) {
+					sum0 += x_[i] * y_[i];
+				}
+				return sum0 + sum1;
+			}
+
+			template <typename T>
+			void copy_lower_to_upper(boost::numeric::ublas::matrix<T> &c_)
+			{
+				for (size_t i = 0; i < c_.size1(); ++i) {
+					for (size_t j = 0; j < i; ++j) {
+						c_(j, i) = c_(i, j);
+					}
+				}
+			}
+
+			struct builtin_backend
+			{
+				// Rows of c_ are split into blocks of columns of a_, each block runs over a_ in slices of rows that
+				// stay in cache and adds four rows of a_ at a time to the lower triangle
+				template <typename T>
+				static void add_gram(boost::numeric::ublas::matrix<T> const &a_, boost::numeric::ublas::matrix<T> &c_, bool parallel_)
+				{
+					size_t rows = a_.size1(), n = a_.size2();
+					if (!rows || !n) {
+						return;
+					}
+					T const *a = &a_.data()[0];
+					T *c = &c_.data()[0];
+					size_t slice = std::max<size_t>(4, (256 << 10) / (n*sizeof(T))), block = 16;
+					parallel_for(0, (n + block - 1) / block, [&](size_t b_) {
+						size_t first = b_*block, last = std::min(n, first + block);
+						for (size_t r0 = 0; r0 < rows; r0 += slice) {
+							size_t r1 = std::min(rows, r0 + slice);
+							for (size_t i = first; i < last; ++i) {
+								T *ci = c + i*n;
+								size_t r = r0;
+								for (; r + 4 <= r1; r += 4) {
+									T const *x0 = a + r*n, *x1 = x0 + n, *x2 = x1 + n, *x3 = x2 + n;
+									T s0 = x0[i], s1 = x1[i], s2 = x2[i], s3 = x3[i];
+									for (size_t j = 0; j <= i; ++j) {
+										ci[j] += s0*x0[j] + s1*x1[j] + s2*x2[j] + s3*x3[j];
+									}
+								}
+								for (; r < r1; ++r) {
+									T const *x = a + r*n;
+									T s = x[i];
+									for (size_t j = 0; j <= i; ++j) {
+										ci[j] += s*x[j];
+									}
+								}
+							}
+						}
+					}, parallel_ && rows*n*n / 2 >= parallel_work);
+					copy_lower_to_upper(c_);
+				}
+
+				// Blocks of y_ are independent, each adds four rows of a_ at a time
+				template <typename T>
+				static void add_transposed_product(boost::numeric::ublas::matrix<T> const &a_, boost::numeric::ublas::vector<T> const &x_,
+					boost::numeric::ublas::vector<T> &y_, bool parallel_)
+				{
+					size_t rows = a_.size1(), n = a_.size2();
+					if (!rows || !n) {
+						return;
+					}
+					T const *a = &a_.data()[0];
+					size_t block = 256;
+					parallel_for(0, (n + block - 1) / block, [&](size_t b_) {
+						size_t first = b_*block, last = std::min(n, first + block);
+						T *y = &y_(0);
+						size_t r = 0;
+						for (; r + 4 <= rows; r += 4) {
+							T const *x0 = a + r*n, *x1 = x0 + n, *x2 = x1 + n, *x3 = x2 + n;
+							T s0 = x_(r), s1 = x_(r + 1), s2 = x_(r + 2), s3 = x_(r + 3);
+							for (size_t j = first; j < last; ++j) {
+								y[j] += s0*x0[j] + s1*x1[j] + s2*x2[j] + s3*x3[j];
+							}
+						}
+						for (; r < rows; ++r) {
+							T const *x = a + r*n;
+							T s = x_(r);
+							for (size_t j = first; j < last; ++j) {
+								y[j] += s*x[j];
+							}
+						}
+					}, parallel_ && rows*n >= parallel_work);
+				}
+
+				// Blocked right looking factorization a_ = L*L^T into the lower triangle. The trailing update runs
+				// on the thread pool over rows, against a transposed copy of the panel so that its inner loop is
+				// contiguous.
+				template <typename T>
+				static bool cholesky_factorize(boost::numeric::ublas::matrix<T> &a_, bool parallel_)
+				{
+					size_t n = a_.size1(), block = 64;
+					if (!n) {
+						return true;
+					}
+					T *a = &a_.data()[0];
+					std::vector<T> panel(block*n);
+					for (size_t k0 = 0; k0 < n; k0 += block) {
+						size_t k1 = std::min(n, k0 + block), width = k1 - k0;
+						for (size_t j = k0; j < k1; ++j) {
+							T *aj = a + j*n;
+							T d = aj[j] - dot(aj + k0, aj + k0, j - k0);
+							if (!(d > T(0))) {
+								return false;
+							}
+							aj[j] = std::sqrt(d);
+							for (size_t i = j + 1; i < k1; ++i) {
+								T *ai = a + i*n;
+								ai[j] = (ai[j] - dot(ai + k0, aj + k0, j - k0)) / aj[j];
+							}
+						}
+						bool parallel = parallel_ && (n - k1)*(n - k1)*width / 2 >= parallel_work;
+						parallel_for(k1, n, [&](size_t i_) {
+							T *ai = a + i_*n;
+							for (size_t j = k0; j < k1; ++j) {
+								T const *aj = a + j*n;
+								ai[j] = (ai[j] - dot(ai + k0, aj + k0, j - k0)) / aj[j];
+								panel[(j - k0)*n + i_] = ai[j];
+							}
+						}, parallel);
+						parallel_for(k1, n, [&](size_t i_) {
+							T *ai = a + i_*n;
+							for (size_t k = 0; k < width; ++k) {
+								T s = ai[k0 + k];
+								T const *p = &panel[k*n];
+								for (size_t j = k1; j <= i_; ++j) {
+									ai[j] -= s*p[j];
+								}
+							}
+						}, parallel);
+					}
+					return true;
+				}
+
+				// Solves l*l^T*x = b_ in place for the factor in the lower triangle of l_
+				template <typename T>
+				static void cholesky_substitute(boost::numeric::ublas::matrix<T> const &l_, boost::numeric::ublas::vector<T> &b_)
+				{
+					size_t n = l_.size1();
+					T const *l = &l_.data()[0];
+					T *x = &b_(0);
+					for (size_t i = 0; i < n; ++i) {
+						x[i] = (x[i] - dot(l + i*n, x, i)) / l[i*n + i];
+					}
+					for (size_t i = n; i-- > 0;) {
+						x[i] /= l[i*n + i];
+						T const *li = l + i*n;
+						T s = x[i];
+						for (size_t k = 0; k < i; ++k) {
+							x[k] -= li[k] * s;
+						}
+					}
+				}
+
+				template <typename T>
+				static bool cholesky_solve(boost::numeric::ublas::matrix<T> &a_, boost::numeric::ublas::vector<T> &b_, bool parallel_)
+				{
+					if (!cholesky_factorize(a_, parallel_)) {
+						return false;
+					}
+					if (a_.size1()) {
+						cholesky_substitute(a_, b_);
+					}
+					return true;
+				}
+			};
+
+			struct ublas_backend
+			{
+				template <typename T>
+				static void add_gram(boost::numeric::ublas::matrix<T> const &a_, boost::numeric::ublas::matrix<T> &c_, bool)
+				{
+					noalias(c_) += prod(trans(a_), a_);
+				}
+
+				template <typename T>
+				static void add_transposed_product(boost::numeric::ublas::matrix<T> const &a_, boost::numeric::ublas::vector<T> const &x_,
+					boost::numeric::ublas::vector<T> &y_, bool)
+				{
+					noalias(y_) += prod(trans(a_), x_);
+				}
+
+				// Leaves the solve to the elimination of matrix_utils
+				template <typename T>
+				static bool cholesky_solve(boost::numeric::ublas::matrix<T> &, boost::numeric::ublas::vector<T> &, bool)
+				{
+					return false;
+				}
+			};
+
+			// Other value types than float and double use the built-in kernels. The BLAS library uses its own threads.
+			struct blas_backend
+			{
+				template <typename T>
+				static void add_gram(boost::numeric::ublas::matrix<T> const &a_, boost::numeric::ublas::matrix<T> &c_, bool parallel_)
+				{
+					builtin_backend::add_gram(a_, c_, parallel_);
+				}
+
+				template <typename T>
+				static void add_transposed_product(boost::numeric::ublas::matrix<T> const &a_, boost::numeric::ublas::vector<T> const &x_,
+					boost::numeric::ublas::vector<T> &y_, bool parallel_)
+				{
+					builtin_backend::add_transposed_product(a_, x_, y_, parallel_);
+				}
+
+				template <typename T>
+				static bool cholesky_solve(boost::numeric::ublas::matrix<T> &a_, boost::numeric::ublas::vector<T> &b_, bool parallel_)
+				{
+					return builtin_backend::cholesky_solve(a_, b_, parallel_);
+				}
+
+#ifdef NEURAL_NETS_USE_BLAS
+				static void add_gram(boost::numeric::ublas::matrix<double> const &a_, boost::numeric::ublas::matrix<double> &c_, bool)
+				{
+					if (a_.size1() && a_.size2()) {
+						int n = static_cast<int>(a_.size2()), rows = static_cast<int>(a_.size1());
+						cblas_dsyrk(CblasRowMajor, CblasLower, CblasTrans, n, rows, 1.0, &a_.data()[0], n, 1.0, &c_.data()[0], n);
+						copy_lower_to_upper(c_);
+					}
+				}
+
+				static void add_gram(boost::numeric::ublas::matrix<float> const &a_, boost::numeric::ublas::matrix<float> &c_, bool)
+				{
+					if (a_.size1() && a_.size2()) {
+						int n = static_cast<int>(a_.size2()), rows = static_cast<int>(a_.size1());
+						cblas_ssyrk(CblasRowMajor, CblasLower, CblasTrans, n, rows, 1.0f, &a_.data()[0], n, 1.0f, &c_.data()[0], n);
+						copy_lower_to_upper(c_);
+					}
+				}
+
+				static void add_transposed_product(boost::numeric::ublas::matrix<double> const &a_, boost::numeric::ublas::vector<double> const &x_,
+					boost::numeric::ublas::vector<double> &y_, bool)
+				{
+					if (a_.size1() && a_.size2()) {
+						int n = static_cast<int>(a_.size2()), rows = static_cast<int>(a_.size1());
+						cblas_dgemv(CblasRowMajor, CblasTrans, rows, n, 1.0, &a_.data()[0], n, &x_.data()[0], 1, 1.0, &y_.data()[0], 1);
+					}
+				}
+
+				static void add_transposed_product(boost::numeric::ublas::matrix<float> const &a_, boost::numeric::ublas::vector<float> const &x_,
+					boost::numeric::ublas::vector<float> &y_, bool)
+				{
+					if (a_.size1() && a_.size2()) {
+						int n = static_cast<int>(a_.size2()), rows = static_cast<int>(a_.size1());
+						cblas_sgemv(CblasRowMajor, CblasTrans, rows, n, 1.0f, &a_.data()[0], n, &x_.data()[0], 1, 1.0f, &y_.data()[0], 1);
+					}
+				}
+#endif
+
+#ifdef NEURAL_NETS_USE_LAPACK
+				// The row major lower triangle is the column major upper one
+				static bool cholesky_solve(boost::numeric::ublas::matrix<double> &a_, boost::numeric::ublas::vector<double> &b_, bool)
+				{
+					int n = static_cast<int>(a_.size1()), one = 1, info = 0;
+					if (n) {
+						dpotrf_("U", &n, &a_.data()[0], &n, &info);
+						if (!info) {
+							dpotrs_("U", &n, &one, &a_.data()[0], &n, &b_.data()[0], &n, &info);
+						}
+					}
+					return !info;
+				}
+
+				static bool cholesky_solve(boost::numeric::ublas::matrix<float> &a_, boost::numeric::ublas::vector<float> &b_, bool)
+				{
+					int n = static_cast<int>(a_.size1()), one = 1, info = 0;
+					if (n) {
+						spotrf_("U", &n, &a_.data()[0], &n, &info);
+						if (!info) {
+							spotrs_("U", &n, &one, &a_.data()[0], &n, &b_.data()[0], &n, &info);
+						}
+					}
+					return !info;
+				}
+#endif
+			};
+
+#if defined(NEURAL_NETS_UBLAS_LINEAR_ALGEBRA)
+			using default_backend = ublas_backend;
+#elif defined(NEURAL_NETS_USE_BLAS) || defined(NEURAL_NETS_USE_LAPACK)
+			using default_backend = blas_backend;
+#else
+			using default_backend = builtin_backend;
+#endif
+
+			// c_ += a_^T*a_ for the symmetric c_
+			template <typename T>
+			void add_gram(boost::numeric::ublas::matrix<T> const &a_, boost::numeric::ublas::matrix<T> &c_, bool parallel_)
+			{
+				default_backend::add_gram(a_, c_, parallel_);
+			}
+
+			// y_ += a_^T*x_
+			template <typename T>
+			void add_transposed_product(boost::numeric::ublas::matrix<T> const &a_, boost::numeric::ublas::vector<T> const &x_,
+				boost::numeric::ublas::vector<T> &y_, bool parallel_)
+			{
+				default_backend::add_transposed_product(a_, x_, y_, parallel_);
+			}
+
+			// Solves a_*x = b_ for symmetric a_ by Cholesky factorization. Matrices that are not positive definite
+			// fall back to the elimination of matrix_utils.
+			template <typename T>
+			boost::numeric::ublas::vector<T> solve_symmetric(boost::numeric::ublas::matrix<T> const &a_, boost::numeric::ublas::vector<T> const &b_, bool parallel_)
+			{
+				boost::numeric::ublas::matrix<T> factor(a_);
+				boost::numeric::ublas::vector<T> x(b_);
+				if (default_backend::cholesky_solve(factor, x, parallel_)) {
+					return x;
+				}
+				return matrix_utils::solve_linear_equation_system(a_, b_);
+			}
+		}
+	}
+}
+
+#endif
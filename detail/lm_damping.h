@@ -0,0 +1,37 @@
+#ifndef LM_DAMPING_H
+#define LM_DAMPING_H
+
+#include <cmath>
+
+#include "neural_nets\detail\matrix_utils.h"
+
+namespace neural_nets
+{
+	namespace detail
+	{
+		// The damped LM system (H + lambda*diag(H))*delta = g is scaled with S = diag(H)^(-1/2) to
+		// (S*H*S + lambda*I)*z = S*g, delta = S*z. The returned tridiagonal form of S*H*S solves it for any
+		// lambda in O(n^2). Parameters without influence (zero diagonal) get a unit scaling and no step.
+		template <typename T>
+		matrix_utils::symmetric_tridiagonal_form<T> calc_damping_form(boost::numeric::ublas::matrix<T> const &hessian_approx_, boost::numeric::ublas::vector<T> const &gradient_,
+			boost::numeric::ublas::vector<T> &scaling_, boost::numeric::ublas::vector<T> &scaled_gradient_)
+		{
+			size_t n = hessian_approx_.size1();
+			scaling_.resize(n);
+			scaled_gradient_.resize(n);
+			for (size_t i = 0; i < n; ++i) {
+				scaling_(i) = hessian_approx_(i, i) > 0 ? 1 / std::sqrt(hessian_approx_(i, i)) : T(1);
+				scaled_gradient_(i) = scaling_(i)*gradient_(i);
+			}
+			boost::numeric::ublas::matrix<T> scaled(n, n);
+			for (size_t i = 0; i < n; ++i) {
+				for (size_t j = 0; j < n; ++j) {
+					scaled(i, j) = scaling_(i)*hessian_approx_(i, j)*scaling_(j);
+				}
+			}
+			return matrix_utils::tridiagonalize_symmetric(scaled);
+		}
+	}
+}
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef MATRIX_UTILS_H
 #define MATRIX_UTILS_H
 
+#include <cmath>
 #include <string>
 #include <sstream>
 
@@ -103,6 +104,114 @@ namespace neural_nets
 				return result;
 
 			}
+
+			// Symmetric matrix A = Q*T*Q^T with orthogonal Q and tridiagonal T. Once computed, the shifted systems
+			// (A + shift*I)*x = b are solved in O(n^2) each, which is used to try several LM damping values.
+			template <typename T>
+			struct symmetric_tridiagonal_form
+			{
+				boost::numeric::ublas::matrix<T> q;
+				boost::numeric::ublas::vector<T> diagonal, off_diagonal;
+			};
+
+			// Householder reduction, O(n^3)
+			template <typename T>
+			symmetric_tridiagonal_form<T> tridiagonalize_symmetric(boost::numeric::ublas::matrix<T> a_)
+			{
+				using namespace boost::numeric::ublas;
+
+				size_t n = a_.size1();
+				symmetric_tridiagonal_form<T> form;
+				form.q = identity_matrix<T>(n);
+				vector<T> v(n), w(n);
+
+				for (size_t k = 0; k + 2 < n; ++k) {
+					T norm = 0;
+					for (size_t i = k + 1; i < n; ++i) {
+						norm += a_(i, k)*a_(i, k);
+					}
+					norm = std::sqrt(norm);
+					if (norm == T(0)) {
+						continue;
+					}
+					T alpha = a_(k + 1, k) > 0 ? -norm : norm;
+					T v_norm = 0;
+					for (size_t i = k + 1; i < n; ++i) {
+						v(i) = a_(i, k) - (i == k + 1 ? alpha : T(0));
+						v_norm += v(i)*v(i);
+					}
+					v_norm = std::sqrt(v_norm);
+					if (v_norm == T(0)) {
+						continue;
+					}
+					for (size_t i = k + 1; i < n; ++i) {
+						v(i) /= v_norm;
+					}
+
+					// A = H*A*H and Q = Q*H with H = I - 2*v*v^T acting on the indices k+1..n-1
+					for (size_t j = 0; j < n; ++j) {
+						w(j) = 0;
+					}
+					for (size_t i = k + 1; i < n; ++i) {
+						for (size_t j = 0; j < n; ++j) {
+							w(j) += v(i)*a_(i, j);
+						}
+					}
+					for (size_t i = k + 1; i < n; ++i) {
+						for (size_t j = 0; j < n; ++j) {
+							a_(i, j) -= 2 * v(i)*w(j);
+						}
+					}
+					for (size_t i = 0; i < n; ++i) {
+						T a_v = 0, q_v = 0;
+						for (size_t j = k + 1; j < n; ++j) {
+							a_v += a_(i, j)*v(j);
+							q_v += form.q(i, j)*v(j);
+						}
+						for (size_t j = k + 1; j < n; ++j) {
+							a_(i, j) -= 2 * a_v*v(j);
+							form.q(i, j) -= 2 * q_v*v(j);
+						}
+					}
+				}
+
+				form.diagonal.resize(n);
+				form.off_diagonal.resize(n ? n - 1 : 0);
+				for (size_t i = 0; i < n; ++i) {
+					form.diagonal(i) = a_(i, i);
+					if (i + 1 < n) {
+						form.off_diagonal(i) = a_(i + 1, i);
+					}
+				}
+				return form;
+			}
+
+			// Solves (A + shift_*I)*x = b_ for A given by its tridiagonal form. The shifted tridiagonal system is
+			// solved without pivoting, which is stable as long as A + shift_*I is positive definite.
+			template <typename T>
+			boost::numeric::ublas::vector<T> solve_shifted_system(symmetric_tridiagonal_form<T> const &form_, T shift_, boost::numeric::ublas::vector<T> const &b_)
+			{
+				using namespace boost::numeric::ublas;
+
+				size_t n = form_.diagonal.size();
+				vector<T> x = prod(trans(form_.q), b_);
+				if (!n) {
+					return x;
+				}
+				vector<T> upper(n);
+				T pivot = form_.diagonal(0) + shift_;
+				for (size_t i = 1; i < n; ++i) {
+					upper(i - 1) = form_.off_diagonal(i - 1) / pivot;
+					x(i - 1) /= pivot;
+					pivot = form_.diagonal(i) + shift_ - form_.off_diagonal(i - 1)*upper(i - 1);
+					x(i) -= form_.off_diagonal(i - 1)*x(i - 1);
+				}
+				x(n - 1) /= pivot;
+				for (size_t i = n - 1; i > 0; --i) {
+					x(i - 1) -= upper(i - 1)*x(i);
+				}
+				return prod(form_.q, x);
+			}
 		}
 	}
 }
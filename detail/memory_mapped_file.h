@@ -0,0 +1,154 @@
+#ifndef MEMORY_MAPPED_FILE_H
+#define MEMORY_MAPPED_FILE_H
+
+#include <algorithm>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "neural_nets\neural_exception.h"
+
+namespace neural_nets
+{
+	namespace detail
+	{
+		// Read only mapping of a whole file
+		class memory_mapped_file
+		{
+		public:
+			explicit memory_mapped_file(std::string const &file_name_) : data(nullptr), size(0)
+			{
+#ifdef _WIN32
+				file = CreateFileA(file_name_.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+				if (file == INVALID_HANDLE_VALUE) {
+					throw neural_exception("Could not open file " + file_name_);
+				}
+				LARGE_INTEGER file_size;
+				GetFileSizeEx(file, &file_size);
+				size = static_cast<size_t>(file_size.QuadPart);
+				mapping = nullptr;
+				if (size) {
+					mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+					data = mapping ? static_cast<char const *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+					if (!data) {
+						close();
+						throw neural_exception("Could not map file " + file_name_);
+					}
+				}
+#else
+				file = ::open(file_name_.c_str(), O_RDONLY);
+				if (file < 0) {
+					throw neural_exception("Could not open file " + file_name_);
+				}
+				struct stat file_status;
+				if (::fstat(file, &file_status) != 0) {
+					close();
+					throw neural_exception("Could not read size of file " + file_name_);
+				}
+				size = static_cast<size_t>(file_status.st_size);
+				if (size) {
+					void *address = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+					if (address == MAP_FAILED) {
+						close();
+						throw neural_exception("Could not map file " + file_name_);
+					}
+					data = static_cast<char const *>(address);
+				}
+#endif
+			}
+
+			~memory_mapped_file() { close(); }
+
+			memory_mapped_file(memory_mapped_file const &) = delete;
+			memory_mapped_file &operator=(memory_mapped_file const &) = delete;
+
+			char const *get_data() const { return data; }
+			size_t get_size() const { return size; }
+
+			// Hints that the given range will be read soon (and in order), the kernel may read it ahead
+			void prefetch(size_t offset_, size_t length_) const
+			{
+#ifndef _WIN32
+				if (!data || offset_ >= size) {
+					return;
+				}
+				size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+				size_t begin = offset_ / page * page;
+				size_t end = std::min(size, offset_ + length_);
+				::madvise(const_cast<char *>(data) + begin, end - begin, MADV_WILLNEED);
+#else
+				(void)offset_;
+				(void)length_;
+#endif
+			}
+
+			// Hints that the given range is not needed anymore, so its pages may be dropped from memory
+			void release(size_t offset_, size_t length_) const
+			{
+#ifndef _WIN32
+				if (!data || offset_ >= size) {
+					return;
+				}
+				size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+				size_t begin = offset_ / page * page;
+				size_t end = std::min(size, offset_ + length_) / page * page;
+				if (end > begin) {
+					::madvise(const_cast<char *>(data) + begin, end - begin, MADV_DONTNEED);
+				}
+#else
+				(void)offset_;
+				(void)length_;
+#endif
+			}
+
+		private:
+			char const *data;
+			size_t size;
+#ifdef _WIN32
+			HANDLE file, mapping;
+
+			void close()
+			{
+				if (data) {
+					UnmapViewOfFile(data);
+					data = nullptr;
+				}
+				if (mapping) {
+					CloseHandle(mapping);
+					mapping = nullptr;
+				}
+				if (file != INVALID_HANDLE_VALUE) {
+					CloseHandle(file);
+					file = INVALID_HANDLE_VALUE;
+				}
+			}
+#else
+			int file;
+
+			void close()
+			{
+				if (data) {
+					::munmap(const_cast<char *>(data), size);
+					data = nullptr;
+				}
+				if (file >= 0) {
+					::close(file);
+					file = -1;
+				}
+			}
+#endif
+		};
+	}
+}
+
+#endif
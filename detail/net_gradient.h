@@ -0,0 +1,365 @@
+#ifndef NET_GRADIENT_H
+#define NET_GRADIENT_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "neural_nets\general_net.h"
+
+namespace neural_nets
+{
+	namespace detail
+	{
+		// Flat view of a general_net in evaluation order for reverse mode (backpropagation through time)
+		// gradients. Parameter indices follow general_net::get_parameters. Frozen weights and biases get the
+		// indices from get_parameter_count() on and take their values from the graph instead of the parameters.
+		// Tied taps share the index of their weight, so their gradient contributions add up.
+		//
+		// Simulations run on a state matrix with one row per time step and one column per neuron. A window of
+		// L steps uses rows [D, D + L), the first D = get_max_delay() rows hold the outputs before the window.
+		template <typename T>
+		class net_graph
+		{
+		public:
+			static size_t const no_input = std::numeric_limits<size_t>::max();
+
+			struct edge
+			{
+				size_t source;
+				size_t delay;
+				size_t parameter;
+			};
+
+			struct node
+			{
+				size_t neuron;
+				size_t input; // Index into the input vector or no_input
+				size_t bias;
+				activation_function activation;
+				size_t first_edge, last_edge;
+			};
+
+			explicit net_graph(general_net<T> &net_) : neuron_count(net_.get_neuron_count()), parameter_count(net_.get_parameter_count()), max_delay(0)
+			{
+				auto const &connections = net_.get_connections();
+				std::vector<std::vector<edge>> incoming(neuron_count);
+				size_t parameter = 0;
+				auto next_index = [&](bool trainable_, T const &weight_) {
+					if (trainable_) {
+						return parameter++;
+					}
+					frozen_weights.push_back(weight_);
+					return parameter_count + frozen_weights.size() - 1;
+				};
+				std::unordered_map<size_t, size_t> weight_parameters;
+				for (size_t i = 0; i < neuron_count; ++i) {
+					for (size_t j = 0; j < neuron_count; ++j) {
+						auto const &connection = connections(j, i);
+						for (size_t k = 0; connection.is_connected() && k < connection.get_delay_count(); ++k) {
+							if (!net_.is_connection_tied(j, i, k)) {
+								weight_parameters[net_.get_weight_index(j, i, k)] = next_index(net_.is_connection_trainable(j, i, k), net_.get_connection_weight(j, i, k));
+							}
+						}
+					}
+				}
+				for (size_t i = 0; i < neuron_count; ++i) {
+					for (size_t j = 0; j < neuron_count; ++j) {
+						auto const &connection = connections(j, i);
+						for (size_t k = 0; connection.is_connected() && k < connection.get_delay_count(); ++k) {
+							size_t delay = connection.get_delay_line()[k].delay_index;
+							incoming[j].push_back(edge{ i, delay, weight_parameters[net_.get_weight_index(j, i, k)] });
+							max_delay = std::max(max_delay, delay);
+						}
+					}
+				}
+				std::vector<size_t> biases(neuron_count);
+				for (size_t i = 0; i < neuron_count; ++i) {
+					biases[i] = next_index(net_.is_neuron_bias_trainable(i), net_.get_neuron_bias_weight(i));
+				}
+
+				for (size_t i : net_.get_evaluation_order()) {
+					auto const &current = net_.get_neuron(i);
+					node n;
+					n.neuron = i;
+					n.input = current.is_input() ? net_.get_input_index(i) : no_input;
+					n.bias = biases[i];
+					n.activation = current.get_activation();
+					n.first_edge = edges.size();
+					edges.insert(edges.end(), incoming[i].begin(), incoming[i].end());
+					n.last_edge = edges.size();
+					nodes.push_back(n);
+				}
+				for (size_t i = 0; i < neuron_count; ++i) {
+					if (net_.get_neuron(i).is_output()) {
+						outputs.push_back(i);
+					}
+				}
+			}
+
+			size_t get_neuron_count() const { return neuron_count; }
+			size_t get_parameter_count() const { return parameter_count; }
+			size_t get_value_count() const { return parameter_count + frozen_weights.size(); } // Parameters and frozen values
+			size_t get_max_delay() const { return max_delay; }
+			std::vector<size_t> const &get_outputs() const { return outputs; }
+			std::vector<node> const &get_nodes() const { return nodes; }
+			std::vector<edge> const &get_edges() const { return edges; }
+
+			bool is_trainable(size_t parameter_) const { return parameter_ < parameter_count; }
+			T get_weight(std::vector<T> const &parameters_, size_t parameter_) const
+			{
+				return parameter_ < parameter_count ? parameters_[parameter_] : frozen_weights[parameter_ - parameter_count];
+			}
+
+			// Fills the first get_max_delay() rows of states_ with the output history stored in the internal memory of net_
+			void load_history(general_net<T> const &net_, boost::numeric::ublas::matrix<T> &states_) const
+			{
+				for (size_t d = 1; d <= max_delay; ++d) {
+					for (size_t j = 0; j < neuron_count; ++j) {
+						auto const &current = net_.get_neuron(j);
+						states_(max_delay - d, j) = d <= current.get_memory_size() ? current.read_from_memory(d - 1) : T(0);
+					}
+				}
+			}
+
+			// Weighted sum of the inputs of n_ including its bias (the argument of its activation) at row_
+			template <typename iter>
+			T calc_net_input(node const &n_, std::vector<T> const &parameters_, boost::numeric::ublas::matrix<T> const &states_, size_t row_, iter input_) const
+			{
+				T sum = n_.input != no_input ? *std::next(input_, n_.input) : T(0);
+				for (size_t e = n_.first_edge; e < n_.last_edge; ++e) {
+					sum += get_weight(parameters_, edges[e].parameter) * states_(row_ - edges[e].delay, edges[e].source);
+				}
+				return sum + get_weight(parameters_, n_.bias);
+			}
+
+			// Same computation as general_net::operator() for the time step of row_
+			template <typename iter>
+			void forward_step(std::vector<T> const &parameters_, boost::numeric::ublas::matrix<T> &states_, size_t row_, iter input_) const
+			{
+				for (auto const &n : nodes) {
+					states_(row_, n.neuron) = apply_activation(n.activation, calc_net_input(n, parameters_, states_, row_, input_));
+				}
+			}
+
+			// Propagates the adjoints of the outputs at row_ to the parameters and to the outputs of earlier steps.
+			// Adjoints are not propagated to rows before first_row_ (truncation).
+			void backward_step(std::vector<T> const &parameters_, boost::numeric::ublas::matrix<T> const &states_, boost::numeric::ublas::matrix<T> &adjoints_,
+				size_t row_, size_t first_row_, std::vector<T> &gradient_) const
+			{
+				for (auto n = nodes.rbegin(); n != nodes.rend(); ++n) {
+					T output = states_(row_, n->neuron);
+					T adjoint = adjoints_(row_, n->neuron) * activation_derivative_from_output(n->activation, output);
+					if (adjoint == T(0)) {
+						continue;
+					}
+					if (is_trainable(n->bias)) {
+						gradient_[n->bias] += adjoint;
+					}
+					for (size_t e = n->first_edge; e < n->last_edge; ++e) {
+						auto const &current = edges[e];
+						size_t source_row = row_ - current.delay;
+						if (is_trainable(current.parameter)) {
+							gradient_[current.parameter] += adjoint * states_(source_row, current.source);
+						}
+						if (source_row >= first_row_) {
+							adjoints_(source_row, current.source) += adjoint * get_weight(parameters_, current.parameter);
+						}
+					}
+				}
+			}
+
+		private:
+			size_t neuron_count, parameter_count, max_delay;
+			std::vector<node> nodes;
+			std::vector<edge> edges;
+			std::vector<size_t> outputs;
+			std::vector<T> frozen_weights;
+		};
+
+		// Adds the gradient of the summed squared output errors on samples [first_, first_ + count_) of u_/y_ to
+		// gradient_ and returns the summed squared error. The outputs before the window are taken from the
+		// internal memory of net_, gradients are truncated at the start of the window.
+		template <typename T>
+		T calc_window_gradient(net_graph<T> const &graph_, general_net<T> const &net_, std::vector<T> const &parameters_,
+			boost::numeric::ublas::matrix<T> const &u_, boost::numeric::ublas::matrix<T> const &y_, size_t first_, size_t count_,
+			std::vector<T> &gradient_)
+		{
+			using namespace boost::numeric::ublas;
+
+			size_t history = graph_.get_max_delay();
+			matrix<T> states(history + count_, graph_.get_neuron_count());
+			graph_.load_history(net_, states);
+			for (size_t t = 0; t < count_; ++t) {
+				graph_.forward_step(parameters_, states, history + t, std::next(u_.begin1(), first_ + t).begin());
+			}
+
+			T error = 0;
+			matrix<T> adjoints = zero_matrix<T>(states.size1(), states.size2());
+			auto const &outputs = graph_.get_outputs();
+			for (size_t t = 0; t < count_; ++t) {
+				for (size_t k = 0; k < outputs.size(); ++k) {
+					T difference = states(history + t, outputs[k]) - y_(first_ + t, k);
+					error += difference*difference;
+					adjoints(history + t, outputs[k]) = 2 * difference;
+				}
+			}
+			for (size_t t = count_; t > 0; --t) {
+				graph_.backward_step(parameters_, states, adjoints, history + t - 1, history, gradient_);
+			}
+			return error;
+		}
+
+		// Binomial (Revolve style) checkpointing of the adjoint pass over a whole sequence. The sequence is split
+		// into leaves of at most leaf_length_ steps which are reversed from the last to the first. A leaf is
+		// recorded completely, the states in between are recomputed from at most slot_count_ stored snapshots
+		// of the last get_max_delay() outputs. Adjoints reaching back before a leaf are carried to the previous one.
+		template <typename T, typename dataset_type>
+		class checkpointed_adjoint
+		{
+		public:
+			explicit checkpointed_adjoint(net_graph<T> const &graph_, std::vector<T> const &parameters_, dataset_type const &data_,
+				size_t leaf_length_, size_t slot_count_)
+				: graph(graph_), parameters(parameters_), data(data_), leaf_length(std::max<size_t>(leaf_length_, 1)), slot_count(slot_count_) {}
+
+			// Adds the gradient of the summed squared output errors to gradient_ and returns that error. The
+			// outputs before the sequence are taken from history_ (see net_graph::load_history).
+			T run(boost::numeric::ublas::matrix<T> const &history_, std::vector<T> &gradient_)
+			{
+				size_t sample_count = data.get_sample_count();
+				carry = boost::numeric::ublas::zero_matrix<T>(graph.get_max_delay(), graph.get_neuron_count());
+				recomputed_steps = 0;
+				gradient = &gradient_;
+				return sample_count ? reverse(history_, 0, sample_count, slot_count) : T(0);
+			}
+
+			size_t get_recomputed_steps() const { return recomputed_steps; }
+
+		private:
+			net_graph<T> const &graph;
+			std::vector<T> const &parameters;
+			dataset_type const &data;
+			size_t leaf_length, slot_count, recomputed_steps = 0;
+			boost::numeric::ublas::matrix<T> carry;
+			std::vector<T> *gradient = nullptr;
+
+			// Number of leaves that can be reversed with slots_ snapshots and at most sweeps_ forward sweeps
+			static size_t binomial_leaves(size_t slots_, size_t sweeps_)
+			{
+				double leaves = 1;
+				for (size_t i = 1; i <= slots_; ++i) {
+					leaves = leaves * static_cast<double>(sweeps_ + i) / static_cast<double>(i);
+				}
+				return leaves < static_cast<double>(std::numeric_limits<size_t>::max() / 2) ? static_cast<size_t>(leaves + 0.5) : std::numeric_limits<size_t>::max() / 2;
+			}
+
+			T reverse(boost::numeric::ublas::matrix<T> const &history_, size_t first_, size_t last_, size_t slots_)
+			{
+				size_t leaves = (last_ - first_ + leaf_length - 1) / leaf_length;
+				if (leaves == 1) {
+					return reverse_leaf(history_, first_, last_);
+				}
+				T error = 0;
+				if (!slots_) {
+					for (size_t i = leaves; i > 0; --i) {
+						boost::numeric::ublas::matrix<T> history(history_);
+						size_t leaf_first = first_ + (i - 1)*leaf_length;
+						advance(history, first_, leaf_first);
+						error += reverse_leaf(history, leaf_first, std::min(last_, leaf_first + leaf_length));
+					}
+					return error;
+				}
+
+				size_t sweeps = 1;
+				while (binomial_leaves(slots_, sweeps) < leaves) {
+					++sweeps;
+				}
+				size_t split = first_ + (leaves - std::min(binomial_leaves(slots_ - 1, sweeps), leaves - 1))*leaf_length;
+				{
+					boost::numeric::ublas::matrix<T> snapshot(history_);
+					advance(snapshot, first_, split);
+					error += reverse(snapshot, split, last_, slots_ - 1);
+				}
+				return error + reverse(history_, first_, split, slots_);
+			}
+
+			// Moves history_ from the state at step first_ to the state at step last_ without recording
+			void advance(boost::numeric::ublas::matrix<T> &history_, size_t first_, size_t last_)
+			{
+				using boost::numeric::ublas::range;
+				size_t delay = graph.get_max_delay();
+				boost::numeric::ublas::matrix<T> u, y, states(delay + leaf_length, graph.get_neuron_count());
+				recomputed_steps += last_ - first_;
+				while (first_ < last_) {
+					size_t count = std::min(leaf_length, last_ - first_);
+					data.read(first_, count, u, y);
+					project(states, range(0, delay), range(0, states.size2())) = history_;
+					for (size_t t = 0; t < count; ++t) {
+						graph.forward_step(parameters, states, delay + t, std::next(u.begin1(), t).begin());
+					}
+					history_ = project(states, range(count, count + delay), range(0, states.size2()));
+					first_ += count;
+				}
+			}
+
+			T reverse_leaf(boost::numeric::ublas::matrix<T> const &history_, size_t first_, size_t last_)
+			{
+				using boost::numeric::ublas::range;
+				size_t delay = graph.get_max_delay(), count = last_ - first_;
+				boost::numeric::ublas::matrix<T> u, y, states(delay + count, graph.get_neuron_count());
+				data.read(first_, count, u, y);
+				project(states, range(0, delay), range(0, states.size2())) = history_;
+				for (size_t t = 0; t < count; ++t) {
+					graph.forward_step(parameters, states, delay + t, std::next(u.begin1(), t).begin());
+				}
+
+				T error = 0;
+				boost::numeric::ublas::matrix<T> adjoints = boost::numeric::ublas::zero_matrix<T>(states.size1(), states.size2());
+				project(adjoints, range(count, count + delay), range(0, states.size2())) += carry;
+				auto const &outputs = graph.get_outputs();
+				for (size_t t = 0; t < count; ++t) {
+					for (size_t k = 0; k < outputs.size(); ++k) {
+						T difference = states(delay + t, outputs[k]) - y(t, k);
+						error += difference*difference;
+						adjoints(delay + t, outputs[k]) += 2 * difference;
+					}
+				}
+				for (size_t t = count; t > 0; --t) {
+					graph.backward_step(parameters, states, adjoints, delay + t - 1, 0, *gradient);
+				}
+				carry = project(adjoints, range(0, delay), range(0, states.size2()));
+				return error;
+			}
+		};
+
+		// Leaf length and snapshot count of a checkpointed adjoint pass that stays within memory_budget_ bytes.
+		// Half of the budget is used for recording one leaf, the other half for snapshots.
+		template <typename T>
+		void plan_checkpoints(net_graph<T> const &graph_, size_t io_count_, size_t memory_budget_, size_t &leaf_length_, size_t &slot_count_)
+		{
+			size_t delay = graph_.get_max_delay(), neuron_count = graph_.get_neuron_count();
+			size_t step_bytes = (2 * neuron_count + io_count_)*sizeof(T), snapshot_bytes = std::max<size_t>(delay*neuron_count*sizeof(T), 1);
+			size_t leaf_bytes = memory_budget_ / 2;
+			leaf_length_ = leaf_bytes / step_bytes > delay ? leaf_bytes / step_bytes - delay : 1;
+			slot_count_ = (memory_budget_ - std::min(memory_budget_, leaf_bytes)) / snapshot_bytes;
+		}
+
+		// Full gradient of the summed squared error of net_ on data_ within a memory budget. The outputs before
+		// the first sample are taken from the internal memory of net_.
+		template <typename T, typename dataset_type>
+		T calc_sequence_gradient(net_graph<T> const &graph_, general_net<T> const &net_, std::vector<T> const &parameters_,
+			dataset_type const &data_, size_t memory_budget_, std::vector<T> &gradient_)
+		{
+			size_t leaf_length, slot_count;
+			plan_checkpoints(graph_, data_.get_input_count() + data_.get_output_count(), memory_budget_, leaf_length, slot_count);
+			boost::numeric::ublas::matrix<T> history(graph_.get_max_delay(), graph_.get_neuron_count());
+			graph_.load_history(net_, history);
+			checkpointed_adjoint<T, dataset_type> adjoint(graph_, parameters_, data_, leaf_length, slot_count);
+			return adjoint.run(history, gradient_);
+		}
+	}
+}
+
+#endif
@@ -33,36 +33,28 @@ namespace neural_nets
 
 			struct neuron_input_info
 			{
-				explicit neuron_input_info(size_t index_) :
-				index(index_) {}
+				explicit neuron_input_info(size_t index_, bool bias_trainable_) :
+				index(index_), bias_trainable(bias_trainable_) {}
 				size_t index;
-				std::vector<connection_info> connection_source;
+				bool bias_trainable;
+				std::vector<connection_info> connection_source; // Trainable taps only
 			};
 
 		public:
-			explicit net_initializer(dynamic_system const &net_, boost::numeric::ublas::matrix<T> const &y_) {
-				outputs_range.reserve(y_.size2());
-				neuron_inputs.reserve(y_.size2());
+			explicit net_initializer(dynamic_system const &net_, boost::numeric::ublas::matrix<T> const &y_) : net_initializer(net_, calc_outputs_range(y_)) {}
+
+			explicit net_initializer(dynamic_system const &net_, std::vector<T> const &outputs_range_) : outputs_range(outputs_range_) {
+				neuron_inputs.reserve(outputs_range_.size());
 
-				for (size_t j = 0; j < y_.size2(); ++j) {
-					T max_tmp = y_(0, 0), min_tmp = y_(0, 0);
-					for (size_t i = 0; i < y_.size1(); ++i) {
-						if (y_(i, j) > max_tmp) {
-							max_tmp = y_(i, j);
-						}
-						if (y_(i, j) < min_tmp) {
-							min_tmp = y_(i, j);
-						}
-					}
-					outputs_range.push_back(max_tmp - min_tmp);
-				}
 				for (size_t i = 0; i < net_.get_neuron_count(); ++i) {
 					if (net_.get_neuron(i).is_output()) {
-						neuron_input_info input_info(i);
+						neuron_input_info input_info(i, net_.is_neuron_bias_trainable(i));
 						for (size_t j = 0; j < net_.get_neuron_count(); ++j) {
-							if (net_.get_adjacency_matrix()(i, j).get_delay_count()) {
-								for (size_t k = 0; k < net_.get_adjacency_matrix()(i, j).get_delay_line().size(); ++k) {
-									input_info.connection_source.push_back(connection_info(j, k));
+							if (net_.get_connections()(i, j).get_delay_count()) {
+								for (size_t k = 0; k < net_.get_connections()(i, j).get_delay_line().size(); ++k) {
+									if (net_.is_connection_trainable(i, j, k)) {
+										input_info.connection_source.push_back(connection_info(j, k));
+									}
 								}
 							}
 						}
@@ -73,8 +65,13 @@ namespace neural_nets
 
 			void perform_init_on(dynamic_system &net_) {
 
+				// Frozen taps and biases keep their weights
 				for (size_t i = 0; i < neuron_inputs.size(); ++i) {
-					size_t relevant_weight_count = detail::random_utils::value_in_range<size_t>(1, neuron_inputs[i].connection_source.size() + 1);
+					size_t slot_count = neuron_inputs[i].connection_source.size() + (neuron_inputs[i].bias_trainable ? 1 : 0);
+					if (!slot_count) {
+						continue;
+					}
+					size_t relevant_weight_count = detail::random_utils::value_in_range<size_t>(1, slot_count);
 					size_t cnt = relevant_weight_count;
 
 					T init_weight = outputs_range[i]/static_cast<T>(relevant_weight_count);
@@ -87,7 +84,7 @@ namespace neural_nets
 						size_t delay = neuron_inputs[i].connection_source[j].source_delay;
 						net_.set_connection_weight(target, source, delay, init_weight);
 					}
-					if (cnt) {
+					if (cnt && neuron_inputs[i].bias_trainable) {
 						net_.set_neuron_bias_weight(neuron_inputs[i].index, init_weight);
 					}
 				}
@@ -96,12 +93,31 @@ namespace neural_nets
 		private:
 			std::vector<T> outputs_range;
 			std::vector<neuron_input_info> neuron_inputs;
+
+			static std::vector<T> calc_outputs_range(boost::numeric::ublas::matrix<T> const &y_) {
+				std::vector<T> result;
+				result.reserve(y_.size2());
+				for (size_t j = 0; j < y_.size2(); ++j) {
+					T max_tmp = y_(0, 0), min_tmp = y_(0, 0);
+					for (size_t i = 0; i < y_.size1(); ++i) {
+						if (y_(i, j) > max_tmp) {
+							max_tmp = y_(i, j);
+						}
+						if (y_(i, j) < min_tmp) {
+							min_tmp = y_(i, j);
+						}
+					}
+					result.push_back(max_tmp - min_tmp);
+				}
+				return result;
+			}
 		};
 		
 		template <typename dynamic_system, typename T>
 		class empty_initializer {
 			public:
 				explicit empty_initializer(dynamic_system const &sys_, boost::numeric::ublas::matrix<T> const &y_) {}
+				explicit empty_initializer(dynamic_system const &sys_, std::vector<T> const &outputs_range_) {}
 				void perform_init_on(dynamic_system &system_) {}
 		};
 
@@ -112,6 +128,7 @@ namespace neural_nets
 
 			public:
 				explicit output_neuron_initializer(dynamic_system const &sys_, boost::numeric::ublas::matrix<T> const &y_) : parent_type(sys_, y_) {}
+				explicit output_neuron_initializer(dynamic_system const &sys_, std::vector<T> const &outputs_range_) : parent_type(sys_, outputs_range_) {}
 		};
 	}
 }
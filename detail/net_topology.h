@@ -0,0 +1,138 @@
+#ifndef NET_TOPOLOGY_H
+#define NET_TOPOLOGY_H
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "neural_nets\detail\matrix_utils.h"
+#include "neural_nets\tapped_delay_line.h"
+
+namespace neural_nets
+{
+	namespace detail
+	{
+		// Order in which the neurons of a time step are evaluated: sorted_indices is grouped into dependency
+		// levels, the neurons sorted_indices[level_offsets[l]] to sorted_indices[level_offsets[l + 1] - 1] only
+		// have instant inputs from earlier levels
+		struct evaluation_order
+		{
+			std::vector<size_t> sorted_indices, level_offsets;
+		};
+
+		// Lazily built evaluation order that copies of a topology share, read and written atomically
+		class shared_evaluation_order
+		{
+		public:
+			shared_evaluation_order() {}
+			shared_evaluation_order(shared_evaluation_order const &other_) : order(other_.load()) {}
+			shared_evaluation_order &operator=(shared_evaluation_order const &other_) { store(other_.load()); return *this; }
+
+			std::shared_ptr<evaluation_order const> load() const { return std::atomic_load(&order); }
+			void store(std::shared_ptr<evaluation_order const> order_) { std::atomic_store(&order, std::move(order_)); }
+			void reset() { store(nullptr); }
+
+			// Stores order_ unless an order is stored already, returns the stored one
+			std::shared_ptr<evaluation_order const> store_if_empty(std::shared_ptr<evaluation_order const> order_)
+			{
+				std::shared_ptr<evaluation_order const> expected;
+				return std::atomic_compare_exchange_strong(&order, &expected, order_) ? order_ : expected;
+			}
+
+		private:
+			std::shared_ptr<evaluation_order const> order;
+		};
+
+		// Structural part of a general_net. It is shared between copies of a net and only
+		// duplicated when one of them changes its structure (copy on write).
+		template <class T>
+		struct net_topology
+		{
+			explicit net_topology(size_t neuron_count_) : input_count(0), output_count(0),
+				weight_count(neuron_count_), connections(neuron_count_, neuron_count_), weight_offsets(neuron_count_, neuron_count_, 0),
+				frozen_biases(neuron_count_, false)
+			{
+			}
+
+			size_t input_count, output_count, weight_count; // weight_count: trainable weights and biases
+			std::map<size_t, size_t> input_order;
+
+			// Built on first evaluation and reset by every structural change. Building it is no structural
+			// change, so copies sharing the topology share the order as well.
+			shared_evaluation_order order;
+
+			// The delay weights stored here are the ones given at connection time, the current
+			// weights live in the owning net at the positions given by weight_offsets.
+			boost::numeric::ublas::matrix<tapped_delay_line<T>> connections;
+			boost::numeric::ublas::matrix<size_t> weight_offsets;
+
+			// Frozen flags per weight slot (parallel to the weights of the owning net) and per bias
+			std::vector<bool> frozen_weights, frozen_biases;
+
+			// Slot every weight slot takes its value from: itself, or the owner slot of a group of tied taps.
+			// The frozen flag of a tied slot is the one of its owner.
+			std::vector<size_t> shared_weights;
+
+			// Slots tied to every owner slot, so writing a weight only updates its own group
+			std::map<size_t, std::vector<size_t>> tied_slots;
+
+			bool is_parameter(size_t slot_) const { return shared_weights[slot_] == slot_ && !frozen_weights[slot_]; }
+
+			// Ties slot_ to the owner slot owner_, a group owned by slot_ moves to owner_ as well
+			void tie(size_t slot_, size_t owner_)
+			{
+				if (shared_weights[slot_] == slot_) {
+					auto group = tied_slots.find(slot_);
+					if (group != tied_slots.end()) {
+						for (size_t i : group->second) {
+							shared_weights[i] = owner_;
+						}
+						auto &owner_group = tied_slots[owner_];
+						owner_group.insert(owner_group.end(), group->second.begin(), group->second.end());
+						tied_slots.erase(group);
+					}
+					weight_count -= frozen_weights[slot_] ? 0 : 1;
+				}
+				else {
+					remove_from_group(slot_);
+				}
+				shared_weights[slot_] = owner_;
+				tied_slots[owner_].push_back(slot_);
+			}
+
+			void untie(size_t slot_)
+			{
+				if (shared_weights[slot_] != slot_) {
+					remove_from_group(slot_);
+					frozen_weights[slot_] = frozen_weights[shared_weights[slot_]];
+					shared_weights[slot_] = slot_;
+					weight_count += frozen_weights[slot_] ? 0 : 1;
+				}
+			}
+
+			// Unties all slots taking their value from slot_
+			void release_tied(size_t slot_)
+			{
+				auto group = tied_slots.find(slot_);
+				if (group != tied_slots.end()) {
+					auto slots = group->second;
+					for (size_t i : slots) {
+						untie(i);
+					}
+				}
+			}
+
+			void remove_from_group(size_t slot_)
+			{
+				auto group = tied_slots.find(shared_weights[slot_]);
+				group->second.erase(std::find(group->second.begin(), group->second.end(), slot_));
+				if (group->second.empty()) {
+					tied_slots.erase(group);
+				}
+			}
+		};
+	}
+}
+
+#endif
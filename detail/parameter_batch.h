@@ -0,0 +1,203 @@
+#ifndef PARAMETER_BATCH_H
+#define PARAMETER_BATCH_H
+
+#include <algorithm>
+#include <vector>
+
+#include "neural_nets\general_net.h"
+#include "neural_nets\training_options.h"
+#include "neural_nets\net_datasets.h"
+#include "neural_nets\net_threading.h"
+#include "neural_nets\detail\net_gradient.h"
+
+namespace neural_nets
+{
+	namespace detail
+	{
+		// Simulates one system with several parameter vectors (lanes) on the same inputs. Each call takes one
+		// input sample and writes one row of outputs per lane. Generic systems keep a copy per lane.
+		template <typename sys_type, typename T>
+		class parameter_batch
+		{
+		public:
+			parameter_batch(sys_type const &sys_, std::vector<std::vector<T>> const &parameters_) : systems(parameters_.size(), sys_), output(sys_.get_output_count())
+			{
+				for (size_t m = 0; m < systems.size(); ++m) {
+					systems[m].set_parameters(parameters_[m].begin(), parameters_[m].end());
+				}
+			}
+
+			// Copies are stepped one after another, so more than one lane per batch gains nothing
+			static size_t get_max_lanes(size_t) { return 1; }
+
+			size_t get_lane_count() const { return systems.size(); }
+			size_t get_output_count() const { return output.size(); }
+
+			void clear_internal_memory() { for (auto &i : systems) i.clear_internal_memory(); }
+			template <typename iter> void set_internal_memory(iter begin_, iter end_) { for (auto &i : systems) i.set_internal_memory(begin_, end_); }
+
+			template <typename iter>
+			void operator()(iter input_begin_, iter input_end_, boost::numeric::ublas::matrix<T> &outputs_)
+			{
+				for (size_t m = 0; m < systems.size(); ++m) {
+					systems[m](input_begin_, input_end_, output.begin(), output.end());
+					std::copy(output.begin(), output.end(), std::next(outputs_.begin1(), m).begin());
+				}
+			}
+
+		private:
+			std::vector<sys_type> systems;
+			std::vector<T> output;
+		};
+
+		// General nets run all lanes in lockstep: values and states are stored lane by lane, so every
+		// connection is one loop over the lanes that the compiler vectorizes. The sums are formed in the order
+		// of general_net::operator(), so each lane gives the same outputs as a copy of the net, except for
+		// delay runs long enough for fir_dot.
+		template <typename T>
+		class parameter_batch<general_net<T>, T>
+		{
+		public:
+			parameter_batch(general_net<T> const &net_, std::vector<std::vector<T>> const &parameters_) : net(net_), graph(net), lanes(parameters_.size()),
+				rows(graph.get_max_delay() + 1), current_row(0), values(graph.get_value_count()*lanes),
+				states(rows*graph.get_neuron_count()*lanes), delay_rows(rows)
+			{
+				std::vector<T> none;
+				for (size_t p = 0; p < graph.get_value_count(); ++p) {
+					for (size_t m = 0; m < lanes; ++m) {
+						values[p*lanes + m] = graph.is_trainable(p) ? parameters_[m][p] : graph.get_weight(none, p);
+					}
+				}
+				load_history();
+			}
+
+			static size_t get_max_lanes(size_t lanes_) { return lanes_; }
+
+			size_t get_lane_count() const { return lanes; }
+			size_t get_output_count() const { return graph.get_outputs().size(); }
+
+			void clear_internal_memory()
+			{
+				net.clear_internal_memory();
+				load_history();
+			}
+
+			template <typename iter>
+			void set_internal_memory(iter begin_, iter end_)
+			{
+				net.set_internal_memory(begin_, end_);
+				load_history();
+			}
+
+			template <typename iter>
+			void operator()(iter input_begin_, iter, boost::numeric::ublas::matrix<T> &outputs_)
+			{
+				size_t neuron_count = graph.get_neuron_count();
+				for (size_t d = 0; d < rows; ++d) {
+					delay_rows[d] = (current_row + rows - d) % rows * neuron_count;
+				}
+				auto const &edges = graph.get_edges();
+				for (auto const &n : graph.get_nodes()) {
+					T *sum = &states[(delay_rows[0] + n.neuron)*lanes];
+					std::fill(sum, sum + lanes, n.input != net_graph<T>::no_input ? *std::next(input_begin_, n.input) : T(0));
+					for (size_t e = n.first_edge; e < n.last_edge; ++e) {
+						T const *w = &values[edges[e].parameter*lanes];
+						T const *s = &states[(delay_rows[edges[e].delay] + edges[e].source)*lanes];
+						for (size_t m = 0; m < lanes; ++m) {
+							sum[m] += w[m] * s[m];
+						}
+					}
+					T const *bias = &values[n.bias*lanes];
+					for (size_t m = 0; m < lanes; ++m) {
+						sum[m] += bias[m];
+					}
+					apply_activation(n.activation, sum, sum + lanes);
+				}
+				auto const &outputs = graph.get_outputs();
+				for (size_t k = 0; k < outputs.size(); ++k) {
+					T const *y = &states[(delay_rows[0] + outputs[k])*lanes];
+					for (size_t m = 0; m < lanes; ++m) {
+						outputs_(m, k) = y[m];
+					}
+				}
+				current_row = (current_row + 1) % rows;
+			}
+
+		private:
+			general_net<T> net; // Holds the internal memory set from outside
+			net_graph<T> graph;
+			size_t lanes, rows, current_row;
+			std::vector<T> values; // [value][lane]
+			std::vector<T> states; // Ring of rows: [row][neuron][lane]
+			std::vector<size_t> delay_rows; // Offset of the row d steps back
+
+			// Broadcasts the internal memory of net into the ring, the next step is written to row 0
+			void load_history()
+			{
+				size_t neuron_count = graph.get_neuron_count();
+				boost::numeric::ublas::matrix<T> history(graph.get_max_delay(), neuron_count);
+				graph.load_history(net, history);
+				current_row = 0;
+				std::fill(states.begin(), states.end(), T(0));
+				for (size_t r = 0; r < history.size1(); ++r) {
+					for (size_t j = 0; j < neuron_count; ++j) {
+						std::fill_n(&states[((r + 1)*neuron_count + j)*lanes], lanes, history(r, j));
+					}
+				}
+			}
+		};
+
+		// Lanes per batch when count_ parameter vectors are split over the thread pool
+		template <typename sys_type, typename T>
+		size_t get_lane_block_size(size_t count_, lm_options<T> const &options_)
+		{
+			size_t threads = options_.use_parallelization ? get_thread_count() : 1;
+			size_t per_thread = (count_ + threads - 1) / threads;
+			return std::max<size_t>(1, std::min(parameter_batch<sys_type, T>::get_max_lanes(options_.lockstep_lanes), per_thread));
+		}
+
+		template <typename sys_type, typename T, typename dataset_type>
+		void add_squared_errors(parameter_batch<sys_type, T> &batch_, dataset_type const &data_, size_t chunk_size_, T *errors_)
+		{
+			boost::numeric::ublas::matrix<T> outputs(batch_.get_lane_count(), batch_.get_output_count());
+			for_each_chunk(data_, chunk_size_, [&](size_t, boost::numeric::ublas::matrix<T> const &u_, boost::numeric::ublas::matrix<T> const &y_) {
+				for (size_t i = 0; i < u_.size1(); ++i) {
+					batch_(std::next(u_.begin1(), i).begin(), std::next(u_.begin1(), i).end(), outputs);
+					for (size_t m = 0; m < outputs.size1(); ++m) {
+						for (size_t j = 0; j < outputs.size2(); ++j) {
+							errors_[m] += (y_(i, j) - outputs(m, j))*(y_(i, j) - outputs(m, j));
+						}
+					}
+				}
+			});
+		}
+
+		template <typename sys_type, typename T, typename dataset_type>
+		void add_squared_errors(parameter_batch<sys_type, T> &batch_, multi_sequence_dataset<dataset_type> const &data_, size_t chunk_size_, T *errors_)
+		{
+			for (size_t i = 0; i < data_.get_sequence_count(); ++i) {
+				data_.reset_state(batch_, i);
+				add_squared_errors(batch_, data_.get_sequence(i), chunk_size_, errors_);
+			}
+		}
+
+		// Sums of the squared output errors of sys_ with each of parameters_ on data_, starting from cleared
+		// internal memory. Blocks of lanes are simulated in lockstep on the thread pool.
+		template <typename sys_type, typename T, typename dataset_type>
+		std::vector<T> calc_squared_errors(sys_type const &sys_, std::vector<std::vector<T>> const &parameters_, dataset_type const &data_, lm_options<T> const &options_)
+		{
+			std::vector<T> errors(parameters_.size(), T(0));
+			size_t block = get_lane_block_size<sys_type>(parameters_.size(), options_);
+			parallel_for(0, (parameters_.size() + block - 1) / block, [&](size_t b) {
+				size_t first = b*block, last = std::min(parameters_.size(), first + block);
+				sys_type sys(sys_);
+				sys.clear_internal_memory();
+				parameter_batch<sys_type, T> batch(sys, std::vector<std::vector<T>>(parameters_.begin() + first, parameters_.begin() + last));
+				add_squared_errors(batch, data_, options_.chunk_size, &errors[first]);
+			}, options_.use_parallelization);
+			return errors;
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,241 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace neural_nets
+{
+	namespace detail
+	{
+		// Persistent pool of worker threads with one task queue per worker. Workers take tasks from the back of
+		// their own queue and steal from the front of the other queues when idle. A thread waiting for its tasks
+		// to finish executes pending tasks itself, so parallel loops nest (e.g. Jacobian columns within
+		// sequences) without blocking workers or starting additional threads.
+		class thread_pool
+		{
+		public:
+			explicit thread_pool(size_t thread_count_, bool pin_threads_) : queues(std::max<size_t>(thread_count_, 1))
+			{
+				for (auto &i : queues) {
+					i.reset(new task_queue());
+				}
+				// The calling thread takes part in the work, so one thread less is started
+				for (size_t i = 1; i < queues.size(); ++i) {
+					workers.emplace_back([this, i]() { worker_loop(i); });
+					if (pin_threads_) {
+						pin_to_core(workers.back(), i);
+					}
+				}
+			}
+
+			~thread_pool()
+			{
+				{
+					std::lock_guard<std::mutex> lock(sleep_mutex);
+					stop = true;
+				}
+				wake_up.notify_all();
+				for (auto &i : workers) {
+					i.join();
+				}
+			}
+
+			thread_pool(thread_pool const &) = delete;
+			thread_pool &operator=(thread_pool const &) = delete;
+
+			size_t get_thread_count() const { return queues.size(); }
+
+			// Calls func_(i) for all i in [first_, last_). The range is split into more tasks than threads, so
+			// tasks of varying cost are balanced by stealing. Rethrows the first exception thrown by func_.
+			template <typename func>
+			void parallel_for(size_t first_, size_t last_, func const &func_)
+			{
+				if (last_ <= first_) {
+					return;
+				}
+				size_t count = last_ - first_;
+				if (count == 1 || queues.size() == 1) {
+					for (size_t i = first_; i < last_; ++i) {
+						func_(i);
+					}
+					return;
+				}
+
+				size_t block_size = std::max<size_t>(1, count / (4 * queues.size()));
+				task_group group;
+				group.pending = (count + block_size - 1) / block_size;
+
+				task_queue &queue = *queues[get_queue_index()];
+				{
+					std::lock_guard<std::mutex> lock(queue.mutex);
+					for (size_t i = first_; i < last_; i += block_size) {
+						size_t block_end = std::min(last_, i + block_size);
+						queue.tasks.push_back(task{ [&func_, i, block_end]() {
+							for (size_t j = i; j < block_end; ++j) {
+								func_(j);
+							}
+						}, &group });
+					}
+				}
+				queued.fetch_add(group.pending, std::memory_order_release);
+				{
+					std::lock_guard<std::mutex> lock(sleep_mutex);
+				}
+				wake_up.notify_all();
+
+				while (group.pending.load(std::memory_order_acquire)) {
+					if (!run_pending_task()) {
+						std::this_thread::yield();
+					}
+				}
+				if (group.error) {
+					std::rethrow_exception(group.error);
+				}
+			}
+
+		private:
+			struct task_group
+			{
+				std::atomic<size_t> pending;
+				std::mutex error_mutex;
+				std::exception_ptr error;
+			};
+
+			struct task
+			{
+				std::function<void()> work;
+				task_group *group;
+			};
+
+			struct task_queue
+			{
+				std::mutex mutex;
+				std::deque<task> tasks;
+			};
+
+			std::vector<std::unique_ptr<task_queue>> queues;
+			std::vector<std::thread> workers;
+			std::atomic<size_t> queued{ 0 };
+			std::mutex sleep_mutex;
+			std::condition_variable wake_up;
+			bool stop = false;
+
+			// Queue of the current thread: its own for workers of this pool, the first one for all other threads
+			size_t get_queue_index() const
+			{
+				auto const &identity = get_thread_identity();
+				return identity.pool == this ? identity.index : 0;
+			}
+
+			struct thread_identity
+			{
+				thread_pool const *pool = nullptr;
+				size_t index = 0;
+			};
+
+			static thread_identity &get_thread_identity()
+			{
+				thread_local thread_identity identity;
+				return identity;
+			}
+
+			bool pop_task(size_t queue_index_, bool steal_, task &task_)
+			{
+				task_queue &queue = *queues[queue_index_];
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				if (queue.tasks.empty()) {
+					return false;
+				}
+				if (steal_) {
+					task_ = std::move(queue.tasks.front());
+					queue.tasks.pop_front();
+				}
+				else {
+					task_ = std::move(queue.tasks.back());
+					queue.tasks.pop_back();
+				}
+				queued.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+
+			bool run_pending_task()
+			{
+				size_t own = get_queue_index();
+				task current;
+				bool found = pop_task(own, false, current);
+				for (size_t i = 1; !found && i < queues.size(); ++i) {
+					found = pop_task((own + i) % queues.size(), true, current);
+				}
+				if (!found) {
+					return false;
+				}
+
+				try {
+					current.work();
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(current.group->error_mutex);
+					if (!current.group->error) {
+						current.group->error = std::current_exception();
+					}
+				}
+				current.group->pending.fetch_sub(1, std::memory_order_release);
+				return true;
+			}
+
+			void worker_loop(size_t index_)
+			{
+				get_thread_identity().pool = this;
+				get_thread_identity().index = index_;
+				while (true) {
+					if (run_pending_task()) {
+						continue;
+					}
+					std::unique_lock<std::mutex> lock(sleep_mutex);
+					wake_up.wait(lock, [this]() { return stop || queued.load(std::memory_order_acquire); });
+					if (stop) {
+						return;
+					}
+				}
+			}
+
+			static void pin_to_core(std::thread &thread_, size_t index_)
+			{
+				size_t core_count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+#ifdef _WIN32
+				SetThreadAffinityMask(thread_.native_handle(), DWORD_PTR(1) << (index_ % core_count));
+#elif defined(__linux__)
+				cpu_set_t cpus;
+				CPU_ZERO(&cpus);
+				CPU_SET(index_ % core_count, &cpus);
+				pthread_setaffinity_np(thread_.native_handle(), sizeof(cpus), &cpus);
+#else
+				(void)thread_;
+				(void)index_;
+				(void)core_count;
+#endif
+			}
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,54 @@
+#include <iostream> // For output
+#include <algorithm> // For std::max
+#include <chrono> // For timing
+
+#include "neural_nets\general_net.h" // General Dynamic Neural Network (GDNN) class template
+#include "neural_nets\net_training.h" // Neural Network training methods and gradient calculation
+#include "neural_nets\net_signals.h" // Optimal APRBS (training signal) generation
+
+// Gradients through long sequences with a limited memory budget. The states of the network are not all kept
+// in memory but recomputed from a few snapshots, which must give the same gradient as the unconstrained calculation.
+
+int main()
+{
+	using namespace neural_nets; // Neural network library
+	using namespace boost::numeric::ublas; // Boost vector and matrix libraries
+
+	// Recurrent network with delays of up to 3 time steps
+	general_net<double> net(5);
+	net.connect_neurons(0, 1);
+	net.connect_neurons(0, 2);
+	net.connect_neurons(1, 3);
+	net.connect_neurons(2, 3);
+	net.connect_neurons(3, 4);
+	net.connect_neurons(3, 1, tapped_delay_line<double>(1));
+	net.connect_neurons(4, 2, tapped_delay_line<double>(3));
+	net.declare_as_input(0);
+	net.declare_as_output(4);
+	net.init_random(-0.5, 0.5);
+
+	// Long excitation signal and the response of a low pass filter as desired output
+	auto t = net_signals::linspace(0.0, 20000.0, 20000);
+	auto u = net_signals::amp_pseudo_random_binary_sequence(t, 20.0, -1.0, 1.0);
+	auto y = net_signals::low_pass_filter(t, u, 1.0, 3.0);
+
+	// Reference: a budget large enough to record the whole sequence at once
+	std::vector<double> reference;
+	calc_gradient(net, u, y, reference, size_t(1) << 30);
+
+	std::cout << "Budget [bytes]\tTime [s]\tMax. deviation from reference\n";
+	std::cout << "--------------------------------------------------------------\n";
+	for (size_t budget : { size_t(1) << 20, size_t(1) << 16, size_t(1) << 12, size_t(1) << 10 }) {
+		std::vector<double> gradient;
+		auto start = std::chrono::steady_clock::now();
+		calc_gradient(net, u, y, gradient, budget);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		double deviation = 0, scale = 0;
+		for (size_t i = 0; i < gradient.size(); ++i) {
+			deviation = std::max(deviation, std::abs(gradient[i] - reference[i]));
+			scale = std::max(scale, std::abs(reference[i]));
+		}
+		std::cout << budget << "\t\t" << seconds << "\t\t" << deviation / scale << " (relative)\n";
+	}
+}
@@ -0,0 +1,61 @@
+#include <iostream> // For output
+#include <string> // For the command line
+#include "neural_nets\neural_nets.h" // All relevant headers for full neural network usage
+#include "neural_nets\net_distributed.h" // Training over several processes
+
+// Start the coordinator with "example_distributed 0" and the workers with "example_distributed 1" to
+// "example_distributed 3" (in any order, e.g. in four terminals or as background jobs)
+int main(int argc, char *argv[])
+{
+	using namespace neural_nets; // Neural network library
+	using namespace boost::numeric::ublas; // Boost vector and matrix libraries
+
+	size_t const worker_count = 3;
+	std::string const socket_path = "/tmp/neural_nets_example.sock";
+	size_t rank = argc > 1 ? std::stoul(argv[1]) : 0;
+
+	// Every process creates the same network (the initial weights of the coordinator are trained)
+	general_net<double> net(4);
+	net.connect_neurons(0, 1);
+	net.connect_neurons(0, 2);
+	net.connect_neurons(1, 3);
+	net.connect_neurons(2, 3);
+	net.connect_neurons(1, 0, tapped_delay_line<double>(1));
+	net.connect_neurons(2, 0, tapped_delay_line<double>(1));
+	net.declare_as_input(0);
+	net.declare_as_output(3);
+
+	// Each process holds its own slice of the training sequences, here one low pass filter experiment per process
+	auto t = net_signals::linspace(0.0, 500.0, 500);
+	auto u = net_signals::amp_pseudo_random_binary_sequence(t, 20.0, -1.0, 1.0);
+	auto y = net_signals::low_pass_filter(t, u, 1.0, 3.0);
+	multi_sequence_dataset<matrix_dataset<double>> local_data;
+	local_data.add_sequence(matrix_dataset<double>(u, y));
+
+	lm_options<double> lm_opts;
+	lm_opts.max_iterations = 100;
+
+	try {
+		if (rank) {
+			// Workers serve their slice until the coordinator is done
+			auto transport = connect_to_coordinator(socket_path, rank);
+			run_lm_worker(net, local_data, transport, lm_opts);
+			return 0;
+		}
+
+		// The coordinator trains on the union of all slices
+		net.init_random(-0.5, 0.5);
+		auto transport = listen_for_workers(socket_path, worker_count);
+		distributed_dataset<multi_sequence_dataset<matrix_dataset<double>>, unix_socket_transport> data(local_data, transport);
+		std::vector<double> weights;
+		auto total_error = train_lm(net, data, weights, lm_opts);
+		data.stop_workers();
+
+		std::cout << "Samples: " << data.get_sample_count() << '\n';
+		std::cout << "Total MSE (Model Error): " << total_error << '\n';
+	}
+	catch (neural_exception const &e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+}
@@ -0,0 +1,38 @@
+#include <iostream> // For output
+#include "neural_nets\neural_nets.h" // All relevant headers for full neural network usage
+#include "neural_nets\quantized_net.h" // Fixed point inference
+
+// Identifies a recurrent model in floating point and runs it with int8 weights and int16 states
+
+int main()
+{
+	using namespace neural_nets; // Neural network library
+	using namespace boost::numeric::ublas; // Boost vector and matrix libraries
+
+	general_net<double> net(4);
+	net.connect_neurons(0, 1);
+	net.connect_neurons(0, 2);
+	net.connect_neurons(1, 3);
+	net.connect_neurons(2, 3);
+	net.connect_neurons(1, 0, tapped_delay_line<double>(1));
+	net.connect_neurons(2, 0, tapped_delay_line<double>(1));
+	net.declare_as_input(0);
+	net.declare_as_output(3);
+
+	auto t = net_signals::linspace(0.0, 200.0, 200);
+	auto u = net_signals::amp_pseudo_random_binary_sequence(t, 20.0, -1.0, 1.0);
+	auto y = net_signals::low_pass_filter(t, u, 1.0, 3.0);
+
+	lm_step_options<double> step_opts;
+	step_opts.lm_opts.display_iterations = false;
+	train_lm_stepwise(net, u, y, step_opts);
+	net.clear_internal_memory();
+
+	// The training signal serves as representative input for the value ranges of all neurons
+	quantized_net<double> quantized(net, calibrate_quantization(net, u));
+
+	// Accuracy on a different signal of the same amplitude
+	auto u_test = net_signals::amp_pseudo_random_binary_sequence(t, 10.0, -1.0, 1.0);
+	std::cout << "Weights: " << quantized.get_weight_bytes() << " bytes\n";
+	std::cout << compare_quantized(net, quantized, u_test);
+}
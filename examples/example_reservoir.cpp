@@ -0,0 +1,47 @@
+#include <iostream> // For output
+#include <chrono> // For timing
+
+#include "neural_nets\general_net.h" // General Dynamic Neural Network (GDNN) class template
+#include "neural_nets\net_reservoir.h" // Echo state (reservoir) training
+#include "neural_nets\net_signals.h" // Optimal APRBS (training signal) generation
+#include "neural_nets\detail\dataset_simulation.h" // Error on a dataset
+
+// Echo state network: a randomly connected recurrent reservoir whose output weights are fitted in one pass
+
+int main()
+{
+	using namespace neural_nets; // Neural network library
+	using namespace boost::numeric::ublas; // Boost vector and matrix libraries
+
+	// Input neuron 0, reservoir neurons 1..40 with random delayed connections, output neuron 41
+	size_t const reservoir_size = 40;
+	general_net<double> net(reservoir_size + 2);
+	for (size_t i = 1; i <= reservoir_size; ++i) {
+		net.connect_neurons(0, i);
+		net.connect_neurons(i, reservoir_size + 1);
+		for (size_t j = 1; j <= reservoir_size; ++j) {
+			if ((i * 7 + j * 13) % 5 == 0) {
+				net.connect_neurons(j, i, tapped_delay_line<double>(1));
+			}
+		}
+	}
+	net.declare_as_input(0);
+	net.declare_as_output(reservoir_size + 1);
+
+	// Excitation signal and the response of a low pass filter as desired output
+	auto t = net_signals::linspace(0.0, 5000.0, 5000);
+	auto u = net_signals::amp_pseudo_random_binary_sequence(t, 20.0, -1.0, 1.0);
+	auto y = net_signals::low_pass_filter(t, u, 1.0, 3.0);
+
+	reservoir_options<double> opts;
+	opts.spectral_radius = 0.9;
+	opts.washout = 100;
+
+	auto start = std::chrono::steady_clock::now();
+	double error = train_reservoir(net, u, y, opts);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "Spectral radius of the reservoir: " << estimate_spectral_radius(net) << '\n';
+	std::cout << "Mean squared error of the readout: " << error << " (" << seconds << " s)\n";
+	std::cout << "Mean squared error on simulation: " << neural_nets::detail::calc_squared_error(net, matrix_dataset<double>(u, y), 4096) / u.size1() << '\n';
+}
@@ -1,34 +1,45 @@
 #ifndef GENERAL_NET_H
 #define GENERAL_NET_H
 
+#include <algorithm>
+#include <iterator>
 #include <sstream>
 #include <map>
+#include <memory>
 
 #include "neural_nets\detail\matrix_utils.h"
+#include "neural_nets\detail\net_topology.h"
 #include "neural_nets\neuron.h"
 #include "neural_nets\neural_exception.h"
+#include "neural_nets\net_profiling.h"
 #include "neural_nets\tapped_delay_line.h"
 #include "neural_nets\detail\random_utils.h"
 #include "neural_nets\detail\math_utils.h"
+#include "neural_nets\detail\fir_kernels.h"
+#include "neural_nets\net_threading.h"
 
 namespace neural_nets
 {
+	template <class T>
+	class net_builder;
 
 	template <class T>
 	class general_net
 	{
 	public:
-		explicit general_net() {};
+		explicit general_net() : general_net(0) {};
 		explicit general_net(size_t neuron_count_);
 
 		size_t get_neuron_count() const { return neurons.size(); }
-		size_t get_input_count() const { return input_count; }
-		size_t get_output_count() const { return output_count; }
-		size_t get_parameter_count() const { return weight_count; }
+		size_t get_input_count() const { return topology->input_count; }
+		size_t get_output_count() const { return topology->output_count; }
+		size_t get_parameter_count() const { return topology->weight_count; }
+		size_t get_internal_memory_size() const;
 
 		void declare_as_input(size_t index_);
 		void declare_as_output(size_t index_);
 		void set_neuron_bias_weight(size_t index_, T const &weight_) { biases[index_] = weight_; }
+		void set_neuron_activation(size_t index_, activation_function activation_) { neurons[index_].set_activation(activation_); }
 		void connect_neurons(size_t first_, size_t second_, T const &weight_ = 1.0);
 		void connect_neurons(size_t first_, size_t second_, tapped_delay_line<T> const &tdl_);
 		void set_connection_weight(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_, T weight_);
@@ -36,14 +47,45 @@ namespace neural_nets
 		void init_random(T const &lower_, T const &upper_);
 		void init_bias_weights_random(T const &lower_, T const &upper_);
 
+		// Frozen weights and biases keep their value: they are left out of get_parameter_count(),
+		// get_parameters() and set_parameters() and are therefore not changed by any training method
+		void set_connection_trainable(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_, bool trainable_);
+		void set_connection_trainable(size_t from_neuron_, size_t to_neuron_, bool trainable_);
+		void set_neuron_bias_trainable(size_t index_, bool trainable_);
+		bool is_connection_trainable(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_) const;
+		bool is_neuron_bias_trainable(size_t index_) const { return !topology->frozen_biases[index_]; }
+
+		// Tied taps share one weight: it is a single parameter, and setting or training it changes all of
+		// them. A tied tap takes the weight and trainable flag of the tap it is tied to. Replacing a
+		// connection unties its taps and all taps tied to them.
+		void tie_connection_weight(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_, size_t shared_from_neuron_, size_t shared_to_neuron_, size_t shared_tdl_index_);
+		void tie_connection_weights(size_t from_neuron_, size_t to_neuron_, size_t shared_from_neuron_, size_t shared_to_neuron_);
+		void untie_connection_weight(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_);
+		bool is_connection_tied(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_) const;
+		size_t get_weight_index(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_) const; // Equal for tied taps
+
 		T get_neuron_bias_weight(size_t neuron_index_) const;
 		T get_connection_weight(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_) const;
+		activation_function get_neuron_activation(size_t neuron_index_) const { return neurons[neuron_index_].get_activation(); }
+		size_t get_input_index(size_t neuron_index_) const { return topology->input_order.find(neuron_index_)->second; }
+		std::vector<size_t> const &get_evaluation_order() const { return topological_sort().sorted_indices; }
+		std::vector<size_t> const &get_evaluation_levels() const { return topological_sort().level_offsets; }
+
+		// Neurons of one dependency level are evaluated in parallel on the thread pool if the level size times the
+		// neuron count (the work of the level) reaches threshold_, 0 always evaluates serially
+		void set_parallel_threshold(size_t threshold_) { parallel_threshold = threshold_; }
+		size_t get_parallel_threshold() const { return parallel_threshold; }
 
 		neuron<T> const &get_neuron(size_t index_) const { return neurons[index_]; }
-		boost::numeric::ublas::matrix<tapped_delay_line<T>> const &get_adjacency_matrix() const { return connections; }
+		boost::numeric::ublas::matrix<tapped_delay_line<T>> get_adjacency_matrix() const; // With the current weights
+
+		// Delays of every connection without copying, the tap weights in it are the ones given at connection time
+		boost::numeric::ublas::matrix<tapped_delay_line<T>> const &get_connections() const { return topology->connections; }
 
 		template<typename iter> void set_parameters(iter begin_, iter end_);
 		template<typename iter> void get_parameters(iter begin_, iter end_) const;
+		template<typename iter> void set_internal_memory(iter begin_, iter end_);
+		template<typename iter> void get_internal_memory(iter begin_, iter end_) const;
 
 		void operator()(T const &input_, T &output_); // SISO
 		template<typename iter> void operator()(iter input_begin_, iter input_end_, T &output_); // MISO
@@ -55,44 +97,55 @@ namespace neural_nets
 		bool is_valid() const;
 
 	private:
-		bool sort_required;
-		size_t input_count, output_count, weight_count;
-		std::map<size_t, size_t> input_order;
-		std::vector<T> biases;
-		std::vector<size_t> sorted_indices;
+		friend class net_builder<T>;
+
+		std::shared_ptr<detail::net_topology<T>> topology;
+		std::vector<T> weights, biases;
 		std::vector<neuron<T>> neurons;
-		boost::numeric::ublas::matrix<tapped_delay_line<T>> connections;
+		size_t parallel_threshold;
 
+		detail::net_topology<T> &mutable_topology();
+		void update_tied_weights();
+		void update_tied_weights(size_t owner_); // Only the group of owner_
+		void check_internal_memory_size(size_t size_) const;
 		bool contains_element(std::vector<size_t> const &vec_, size_t const &value_) const;
 		size_t find_missing_entry(std::vector<size_t> vec_) const; // Yes, call by value
-		size_t parse_line(size_t line_, std::vector<size_t> &stack_) const;
+		size_t parse_line(size_t line_, std::vector<size_t> const &sorted_, std::vector<size_t> &stack_) const;
 		std::string get_algebraic_loop_string(std::vector<size_t> const &stack_, size_t to_) const;
-		void topological_sort();
+		detail::evaluation_order const &topological_sort() const;
 	};
 
 
 
 
 	template<class T>
-	general_net<T>::general_net(size_t neuron_count_) : connections(neuron_count_, neuron_count_), sort_required(true), weight_count(neuron_count_), input_count(0), output_count(0)
+	general_net<T>::general_net(size_t neuron_count_) : topology(std::make_shared<detail::net_topology<T>>(neuron_count_)), parallel_threshold(1 << 16)
 	{
 		neurons.reserve(neuron_count_);
 		biases.reserve(neuron_count_);
-		sorted_indices.reserve(neuron_count_);
 		for (size_t i = 0; i < neuron_count_; ++i) {
 			biases.push_back(1);
 			neurons.emplace_back(i);
-			sorted_indices.push_back(i);
 		}
 	}
 
+	template<class T>
+	detail::net_topology<T> &general_net<T>::mutable_topology()
+	{
+		if (topology.use_count() > 1) {
+			topology = std::make_shared<detail::net_topology<T>>(*topology);
+		}
+		return *topology;
+	}
+
 	template<class T>
 	void general_net<T>::declare_as_input(size_t index_)
 	{
 		if (!neurons[index_].is_input()) {
-			sort_required = true;
-			input_order[index_] = input_count;
-			++input_count;
+			auto &topo = mutable_topology();
+			topo.order.reset();
+			topo.input_order[index_] = topo.input_count;
+			++topo.input_count;
 			neurons[index_].set_as_input(true);
 		}
 	}
@@ -101,8 +154,9 @@ namespace neural_nets
 	void general_net<T>::declare_as_output(size_t index_)
 	{
 		if (!neurons[index_].is_output()) {
-			sort_required = true;
-			++output_count;
+			auto &topo = mutable_topology();
+			topo.order.reset();
+			++topo.output_count;
 			neurons[index_].set_as_output(true);
 		}
 	}
@@ -110,23 +164,139 @@ namespace neural_nets
 	template <class T>
 	void general_net<T>::init_random(T const&lower_, T const &upper_)
 	{
-		std::vector<T> weights(weight_count);
-		for (auto &i : weights) {
+		std::vector<T> parameters(get_parameter_count());
+		for (auto &i : parameters) {
 			i = detail::random_utils::value_in_range<T>(lower_, upper_);
 		}
-		set_parameters(weights.begin(), weights.end());
+		set_parameters(parameters.begin(), parameters.end());
 	}
 
 	template <class T>
 	void general_net<T>::init_bias_weights_random(T const&lower_, T const &upper_)
 	{
-		for (auto &i : biases) {
-			i = detail::random_utils::value_in_range<T>(lower_, upper_);
+		for (size_t i = 0; i < biases.size(); ++i) {
+			if (is_neuron_bias_trainable(i)) {
+				biases[i] = detail::random_utils::value_in_range<T>(lower_, upper_);
+			}
+		}
+	}
+
+	template <class T>
+	void general_net<T>::set_connection_trainable(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_, bool trainable_)
+	{
+		if (is_connection_trainable(from_neuron_, to_neuron_, tdl_index_) != trainable_) {
+			auto &topo = mutable_topology();
+			topo.frozen_weights[get_weight_index(from_neuron_, to_neuron_, tdl_index_)] = !trainable_;
+			trainable_ ? ++topo.weight_count : --topo.weight_count;
+		}
+	}
+
+	template <class T>
+	void general_net<T>::set_connection_trainable(size_t from_neuron_, size_t to_neuron_, bool trainable_)
+	{
+		for (size_t k = 0; k < topology->connections(from_neuron_, to_neuron_).get_delay_count(); ++k) {
+			set_connection_trainable(from_neuron_, to_neuron_, k, trainable_);
+		}
+	}
+
+	template <class T>
+	void general_net<T>::set_neuron_bias_trainable(size_t index_, bool trainable_)
+	{
+		if (is_neuron_bias_trainable(index_) != trainable_) {
+			auto &topo = mutable_topology();
+			topo.frozen_biases[index_] = !trainable_;
+			trainable_ ? ++topo.weight_count : --topo.weight_count;
+		}
+	}
+
+	template <class T>
+	bool general_net<T>::is_connection_trainable(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_) const
+	{
+		return !topology->frozen_weights[get_weight_index(from_neuron_, to_neuron_, tdl_index_)];
+	}
+
+	template <class T>
+	void general_net<T>::tie_connection_weight(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_, size_t shared_from_neuron_, size_t shared_to_neuron_, size_t shared_tdl_index_)
+	{
+		size_t slot = topology->weight_offsets(from_neuron_, to_neuron_) + tdl_index_;
+		size_t owner = get_weight_index(shared_from_neuron_, shared_to_neuron_, shared_tdl_index_);
+		if (owner == slot || topology->shared_weights[slot] == owner) {
+			return;
+		}
+		mutable_topology().tie(slot, owner);
+		update_tied_weights(owner);
+	}
+
+	template <class T>
+	void general_net<T>::tie_connection_weights(size_t from_neuron_, size_t to_neuron_, size_t shared_from_neuron_, size_t shared_to_neuron_)
+	{
+		size_t delay_count = topology->connections(from_neuron_, to_neuron_).get_delay_count();
+		if (delay_count != topology->connections(shared_from_neuron_, shared_to_neuron_).get_delay_count()) {
+			throw neural_exception("Tied connections must have the same number of taps!");
+		}
+		for (size_t k = 0; k < delay_count; ++k) {
+			tie_connection_weight(from_neuron_, to_neuron_, k, shared_from_neuron_, shared_to_neuron_, k);
+		}
+	}
+
+	template <class T>
+	void general_net<T>::untie_connection_weight(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_)
+	{
+		if (is_connection_tied(from_neuron_, to_neuron_, tdl_index_)) {
+			mutable_topology().untie(topology->weight_offsets(from_neuron_, to_neuron_) + tdl_index_);
+		}
+	}
+
+	template <class T>
+	bool general_net<T>::is_connection_tied(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_) const
+	{
+		size_t slot = topology->weight_offsets(from_neuron_, to_neuron_) + tdl_index_;
+		return topology->shared_weights[slot] != slot;
+	}
+
+	template <class T>
+	size_t general_net<T>::get_weight_index(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_) const
+	{
+		return topology->shared_weights[topology->weight_offsets(from_neuron_, to_neuron_) + tdl_index_];
+	}
+
+	template <class T>
+	boost::numeric::ublas::matrix<tapped_delay_line<T>> general_net<T>::get_adjacency_matrix() const
+	{
+		auto connections = topology->connections;
+		for (size_t i = 0; i < connections.size1(); ++i) {
+			for (size_t j = 0; j < connections.size2(); ++j) {
+				for (size_t k = 0; connections(i, j).is_connected() && k < connections(i, j).get_delay_count(); ++k) {
+					connections(i, j).set_delay_by_index(k, weights[topology->weight_offsets(i, j) + k]);
+				}
+			}
+		}
+		return connections;
+	}
+
+	template <class T>
+	void general_net<T>::update_tied_weights()
+	{
+		for (auto const &i : topology->tied_slots) {
+			for (size_t slot : i.second) {
+				weights[slot] = weights[i.first];
+			}
+		}
+	}
+
+	template <class T>
+	void general_net<T>::update_tied_weights(size_t owner_)
+	{
+		auto group = topology->tied_slots.find(owner_);
+		if (group != topology->tied_slots.end()) {
+			for (size_t slot : group->second) {
+				weights[slot] = weights[owner_];
+			}
 		}
 	}
 
 	template<class T>
-	void general_net<T>::connect_neurons(size_t first_, size_t second_, T const &weight_ = 1.0)
+	void general_net<T>::connect_neurons(size_t first_, size_t second_, T const &weight_)
 	{
 		connect_neurons(first_, second_, tapped_delay_line<T>(0, weight_));
 	}
@@ -139,9 +309,33 @@ namespace neural_nets
 				neurons[first_].set_memory_size(tdl_.get_maximum_delay() + 1);
 			}
 		}
-		sort_required = true;
-		connections(second_, first_) = tdl_;
-		weight_count += tdl_.get_delay_count();
+		auto &topo = mutable_topology();
+		auto const &previous = topo.connections(second_, first_);
+		size_t previous_count = previous.is_connected() ? previous.get_delay_count() : 0, previous_trainable = 0;
+		for (size_t k = 0; k < previous_count; ++k) {
+			size_t slot = topo.weight_offsets(second_, first_) + k;
+			topo.release_tied(slot);
+			topo.untie(slot);
+			previous_trainable += topo.is_parameter(slot) ? 1 : 0;
+		}
+
+		// Weight slots of a replaced connection are reused if they suffice, otherwise new ones are appended.
+		// The new taps are all trainable.
+		if (previous_count < tdl_.get_delay_count()) {
+			topo.weight_offsets(second_, first_) = weights.size();
+			weights.resize(weights.size() + tdl_.get_delay_count());
+			topo.frozen_weights.resize(weights.size());
+			for (size_t i = topo.shared_weights.size(); i < weights.size(); ++i) {
+				topo.shared_weights.push_back(i);
+			}
+		}
+		for (size_t k = 0; k < tdl_.get_delay_count(); ++k) {
+			weights[topo.weight_offsets(second_, first_) + k] = tdl_.get_delay_weight(k);
+			topo.frozen_weights[topo.weight_offsets(second_, first_) + k] = false;
+		}
+		topo.order.reset();
+		topo.weight_count += tdl_.get_delay_count() - previous_trainable;
+		topo.connections(second_, first_) = tdl_;
 	}
 
 	template<class T>
@@ -153,13 +347,15 @@ namespace neural_nets
 	template<class T>
 	void general_net<T>::set_connection_weight(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_, T weight_)
 	{
-		connections(from_neuron_, to_neuron_).set_delay_by_index(tdl_index_, weight_);
+		size_t owner = get_weight_index(from_neuron_, to_neuron_, tdl_index_);
+		weights[owner] = weight_;
+		update_tied_weights(owner);
 	}
 
 	template<class T>
 	T general_net<T>::get_connection_weight(size_t from_neuron_, size_t to_neuron_, size_t tdl_index_) const
 	{
-		return connections(from_neuron_, to_neuron_).get_delay_weight(tdl_index_);
+		return weights[topology->weight_offsets(from_neuron_, to_neuron_) + tdl_index_];
 	}
 
 	template<class T>
@@ -168,18 +364,24 @@ namespace neural_nets
 		size_t neuron_count = get_neuron_count();
 		for (size_t i = 0; i < neuron_count; ++i) {
 			for (size_t j = 0; j < neuron_count; ++j) {
-				if (connections(j, i).is_connected()) {
-					for (size_t k = 0; k < connections(j, i).get_delay_count(); k++) {
-						set_connection_weight(j, i, k, *begin_);
-						++begin_;
+				if (topology->connections(j, i).is_connected()) {
+					for (size_t k = 0; k < topology->connections(j, i).get_delay_count(); k++) {
+						size_t slot = topology->weight_offsets(j, i) + k;
+						if (topology->is_parameter(slot)) {
+							weights[slot] = *begin_;
+							++begin_;
+						}
 					}
 				}
 			}
 		}
 		for (size_t i = 0; i < neuron_count; i++) {
-			biases[i] = *begin_;
-			++begin_;
+			if (is_neuron_bias_trainable(i)) {
+				biases[i] = *begin_;
+				++begin_;
+			}
 		}
+		update_tied_weights();
 	}
 
 	template<class T>
@@ -188,24 +390,70 @@ namespace neural_nets
 		size_t neuron_count = get_neuron_count();
 		for (size_t i = 0; i < neuron_count; ++i) {
 			for (size_t j = 0; j < neuron_count; ++j) {
-				if (connections(j, i).is_connected()) {
-					for (size_t k = 0; k < connections(j, i).get_delay_count(); ++k) {
-						*begin_ = get_connection_weight(j, i, k);
-						++begin_;
+				if (topology->connections(j, i).is_connected()) {
+					for (size_t k = 0; k < topology->connections(j, i).get_delay_count(); ++k) {
+						if (topology->is_parameter(topology->weight_offsets(j, i) + k)) {
+							*begin_ = get_connection_weight(j, i, k);
+							++begin_;
+						}
 					}
 				}
 			}
 		}
 		for (size_t i = 0; i < neuron_count; i++) {
-			*begin_ = get_neuron_bias_weight(i);
-			++begin_;
+			if (is_neuron_bias_trainable(i)) {
+				*begin_ = get_neuron_bias_weight(i);
+				++begin_;
+			}
+		}
+	}
+
+	template<class T>
+	size_t general_net<T>::get_internal_memory_size() const
+	{
+		size_t size = 0;
+		for (auto const &i : neurons) {
+			size += i.get_memory_size();
+		}
+		return size;
+	}
+
+	template<class T>
+	void general_net<T>::check_internal_memory_size(size_t size_) const
+	{
+		if (size_ != get_internal_memory_size()) {
+			throw neural_exception("Internal memory of size " + std::to_string(size_) + " given, the network has " + std::to_string(get_internal_memory_size()) + "!");
+		}
+	}
+
+	template<class T>
+	template<typename iter> void general_net<T>::set_internal_memory(iter begin_, iter end_)
+	{
+		check_internal_memory_size(static_cast<size_t>(std::distance(begin_, end_)));
+		for (auto &i : neurons) {
+			for (size_t k = 0; k < i.get_memory_size(); ++k) {
+				i.write_to_memory(k, *begin_);
+				++begin_;
+			}
+		}
+	}
+
+	template<class T>
+	template<typename iter> void general_net<T>::get_internal_memory(iter begin_, iter end_) const
+	{
+		check_internal_memory_size(static_cast<size_t>(std::distance(begin_, end_)));
+		for (auto const &i : neurons) {
+			for (size_t k = 0; k < i.get_memory_size(); ++k) {
+				*begin_ = i.read_from_memory(k);
+				++begin_;
+			}
 		}
 	}
 
 	template<class T>
 	boost::numeric::ublas::matrix<T> general_net<T>::operator()(boost::numeric::ublas::matrix<T> const &u_)
 	{
-		boost::numeric::ublas::matrix<T> y(u_.size1(), output_count);
+		boost::numeric::ublas::matrix<T> y(u_.size1(), topology->output_count);
 		for (size_t i = 0; i < u_.size1(); ++i) {
 			(*this)(std::next(u_.begin1(), i).begin(), std::next(u_.begin1(), i).end(), 
 				std::next(y.begin1(), i).begin(), std::next(y.begin1(), i).end());
@@ -239,34 +487,49 @@ namespace neural_nets
 	template<class T>
 	template<typename iter1, typename iter2> void general_net<T>::operator()(iter1 input_begin_, iter1 input_end_, iter2 output_begin_, iter2 output_end_)
 	{
-		topological_sort();
+		auto const &order = topological_sort();
+		NEURAL_NETS_PROFILE_SCOPE(forward_step);
 		std::vector<T> output;
 		size_t neuron_count = get_neuron_count();
 		output.resize(neuron_count);
 
-		for (size_t k = 0; k < neuron_count; ++k) {
-			size_t i = sorted_indices[k];
+		auto evaluate = [&](size_t k) {
+			size_t i = order.sorted_indices[k];
 			bool input_detected = false;
 			for (size_t j = 0; j < neuron_count; ++j) {
 				if (neurons[i].is_input() && !input_detected) {
-					output[i] = *std::next(input_begin_, input_order.find(i)->second);
+					output[i] = *std::next(input_begin_, topology->input_order.find(i)->second);
 					input_detected = true;
 				}
-				if (connections(i, j).is_connected()) {
-					if (connections(i, j).is_instant())
-						output[i] += connections(i, j).get_delay_weight(0)*output[j];
-					if (connections(i, j).has_delays()) {
-						size_t delay_weight_counter = 0;
-						for (auto const &h : connections(i, j).get_delay_line()) {
-							if (h.delay_index) {
-								output[i] += connections(i, j).get_delay_weight(delay_weight_counter)*neurons[j].read_from_memory(h.delay_index - 1);
-							}
-							++delay_weight_counter;
+				auto const &connection = topology->connections(i, j);
+				if (connection.is_connected()) {
+					T const *connection_weights = &weights[topology->weight_offsets(i, j)];
+					if (connection.is_instant())
+						output[i] += connection_weights[0]*output[j];
+					if (connection.has_delays()) {
+						T const *history = neurons[j].get_memory_window();
+						auto const &delay_line = connection.get_delay_line();
+						for (auto const &r : connection.get_delay_runs()) {
+							output[i] = detail::fir_accumulate(output[i], connection_weights + r.first_tap,
+								history + delay_line[r.first_tap].delay_index - 1, r.tap_count);
 						}
 					}
 				}
 			}
 			output[i] = neurons[i].output_function(output[i] + biases[i]);
+		};
+
+		auto const &levels = order.level_offsets;
+		for (size_t l = 0; l + 1 < levels.size(); ++l) {
+			size_t level_size = levels[l + 1] - levels[l];
+			if (parallel_threshold && level_size > 1 && level_size*neuron_count >= parallel_threshold) {
+				detail::parallel_for(levels[l], levels[l + 1], evaluate);
+			}
+			else {
+				for (size_t k = levels[l]; k < levels[l + 1]; ++k) {
+					evaluate(k);
+				}
+			}
 		}
 
 		for (size_t i = 0; i < neuron_count; ++i) {
@@ -315,16 +578,16 @@ namespace neural_nets
 	}
 
 	template <class T>
-	size_t general_net<T>::parse_line(size_t line_, std::vector<size_t> &stack_) const
+	size_t general_net<T>::parse_line(size_t line_, std::vector<size_t> const &sorted_, std::vector<size_t> &stack_) const
 	{
 		for (size_t i = 0; i < get_neuron_count(); i++) {
-			if (connections(line_, i).is_instant()) {
-				if (!contains_element(sorted_indices, i)) {
+			if (topology->connections(line_, i).is_instant()) {
+				if (!contains_element(sorted_, i)) {
 					if (contains_element(stack_, i)) {
 						throw neural_exception(get_algebraic_loop_string(stack_, line_));
 					}
 					stack_.push_back(line_);
-					return parse_line(i, stack_);
+					return parse_line(i, sorted_, stack_);
 				}
 			}
 		}
@@ -337,7 +600,7 @@ namespace neural_nets
 		for (size_t col = 0; col < get_neuron_count(); ++col) {
 			bool has_outputs = false;
 			for (size_t row = 0; row < get_neuron_count(); ++row) {
-				if (connections(row, col).is_connected()) {
+				if (topology->connections(row, col).is_connected()) {
 					has_outputs = true;
 					break;
 				}
@@ -349,7 +612,7 @@ namespace neural_nets
 		for (size_t row = 0; row < get_neuron_count(); ++row) {
 			bool has_inputs = false;
 			for (size_t col = 0; col < get_neuron_count(); ++col) {
-				if (connections(row, col).is_connected()) {
+				if (topology->connections(row, col).is_connected()) {
 					has_inputs = true;
 					break;
 				}
@@ -364,9 +627,8 @@ namespace neural_nets
 	template<class T>
 	bool general_net<T>::is_valid() const
 	{
-		auto tmp(*this);
 		try {
-			tmp.topological_sort();
+			topological_sort();
 		}
 		catch (neural_exception const &) {
 			return false;
@@ -375,11 +637,12 @@ namespace neural_nets
 	}
 
 	template <class T>
-	void general_net<T>::topological_sort()
+	detail::evaluation_order const &general_net<T>::topological_sort() const
 	{
-		if (!sort_required) {
-			return;
+		if (auto order = topology->order.load()) {
+			return *order; // Kept alive by the topology until its next structural change
 		}
+		NEURAL_NETS_PROFILE_SCOPE(topological_sort);
 		bool input_detected = false, output_detected = false;
 		for (auto const &i : neurons) {
 			if (i.is_input()) {
@@ -399,20 +662,43 @@ namespace neural_nets
 			throw neural_exception("Network contains neurons which have neither an input nor an output!");
 		}
 
-		sorted_indices.clear();
+		auto order = std::make_shared<detail::evaluation_order>();
+		auto &sorted = order->sorted_indices;
 		size_t current_line = 0;
 		std::vector<size_t> stack;
-		while (sorted_indices.size() < get_neuron_count()) {
-			sorted_indices.push_back(parse_line(current_line, stack));
+		while (sorted.size() < get_neuron_count()) {
+			sorted.push_back(parse_line(current_line, sorted, stack));
 			if (stack.empty()) {
-				current_line = find_missing_entry(sorted_indices);
+				current_line = find_missing_entry(sorted);
 			}
 			else {
 				current_line = stack.front();
 				stack.clear();
 			}
 		}
-		sort_required = false;
+
+		// Level of a neuron: one more than the highest level of its instant inputs
+		std::vector<size_t> levels(get_neuron_count(), 0);
+		size_t level_count = 0;
+		for (size_t i : sorted) {
+			for (size_t j = 0; j < get_neuron_count(); ++j) {
+				if (topology->connections(i, j).is_instant()) {
+					levels[i] = std::max(levels[i], levels[j] + 1);
+				}
+			}
+			level_count = std::max(level_count, levels[i] + 1);
+		}
+		std::stable_sort(sorted.begin(), sorted.end(), [&](size_t a_, size_t b_) { return levels[a_] < levels[b_]; });
+		order->level_offsets.assign(level_count + 1, 0);
+		for (size_t i = 0; i < get_neuron_count(); ++i) {
+			++order->level_offsets[levels[i] + 1];
+		}
+		for (size_t l = 0; l < level_count; ++l) {
+			order->level_offsets[l + 1] += order->level_offsets[l];
+		}
+
+		// Copies sharing the topology may sort concurrently, the first order stored is kept
+		return *topology->order.store_if_empty(order);
 	}
 
 
@@ -443,23 +729,29 @@ namespace neural_nets
 		stream << "\nTotal Neurons: " << net.get_neuron_count() << '\n';
 		stream << "Parameters: " << net.get_parameter_count() << '\n';
 		for (size_t i = 0; i < net.get_neuron_count(); ++i) {
-			stream << "Bias " << i << ": " << net.get_neuron_bias_weight(i) << '\n';
+			stream << "Bias " << i << ": " << net.get_neuron_bias_weight(i) << (net.is_neuron_bias_trainable(i) ? "" : " (frozen)") << '\n';
+		}
+		for (size_t i = 0; i < net.get_neuron_count(); ++i) {
+			if (net.get_neuron(i).get_declared_activation() != activation_function::automatic) {
+				stream << "Activation " << i << ": " << get_activation_name(net.get_neuron_activation(i)) << '\n';
+			}
 		}
 
 		size_t max_delay = 0;
 		for (size_t i = 0; i < net.get_neuron_count(); ++i) {
 			for (size_t j = 0; j < net.get_neuron_count(); ++j) {
-				max_delay = std::max(max_delay, net.get_adjacency_matrix()(i, j).get_maximum_delay());
+				max_delay = std::max(max_delay, net.get_connections()(i, j).get_maximum_delay());
 			}
 		}
 
 		for (size_t i = 0; i < net.get_neuron_count(); ++i) {
 			for (size_t j = 0; j < net.get_neuron_count(); ++j) {
-				if (net.get_adjacency_matrix()(i, j).is_connected()) {
-					for (size_t k = 0; k < net.get_adjacency_matrix()(i, j).get_delay_count(); ++k) {
-						size_t delay = net.get_adjacency_matrix()(i, j).get_delay_line()[k].delay_index;
-						T weight = net.get_adjacency_matrix()(i, j).get_delay_line()[k].delay_weight;
-						stream << "Weight from " << j << " to " << i << " (" << delay << " delay): " << weight << '\n';
+				if (net.get_connections()(i, j).is_connected()) {
+					for (size_t k = 0; k < net.get_connections()(i, j).get_delay_count(); ++k) {
+						size_t delay = net.get_connections()(i, j).get_delay_line()[k].delay_index;
+						T weight = net.get_connection_weight(i, j, k);
+						stream << "Weight from " << j << " to " << i << " (" << delay << " delay): " << weight << (net.is_connection_trainable(i, j, k) ? "" : " (frozen)")
+							<< (net.is_connection_tied(i, j, k) ? " (tied)" : "") << '\n';
 					}
 				}
 			}
@@ -0,0 +1,232 @@
+#ifndef NET_BUILDER_H
+#define NET_BUILDER_H
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "neural_nets\general_net.h"
+#include "neural_nets\neural_exception.h"
+#include "neural_nets\tapped_delay_line.h"
+
+// Collects the structure of a large network as an edge list, with primitives for fully connected layers,
+// one to one connections and banded recurrence, and builds the general_net in one pass: the connections are
+// validated once, every weight slot is laid out in the order the edges were added, memory sizes are set once
+// per neuron and the evaluation order is computed at the end. Nets connected neuron by neuron give the same
+// result when they add the same edges in the same order.
+
+namespace neural_nets
+{
+	template <class T>
+	class net_builder
+	{
+	public:
+		explicit net_builder(size_t neuron_count_ = 0) : biases(neuron_count_, T(1)), activations(neuron_count_, activation_function::automatic), outputs(neuron_count_, false) {}
+
+		size_t get_neuron_count() const { return biases.size(); }
+		size_t get_connection_count() const { return edges.size(); }
+		size_t add_neurons(size_t count_); // Returns the index of the first new neuron
+
+		void declare_as_input(size_t index_);
+		void declare_as_output(size_t index_);
+		void set_neuron_bias_weight(size_t index_, T const &weight_) { check_range(index_, 1); biases[index_] = weight_; }
+		void set_neuron_activation(size_t index_, activation_function activation_) { check_range(index_, 1); activations[index_] = activation_; }
+		void set_neuron_activation(size_t first_, size_t count_, activation_function activation_);
+
+		// Connections run from first_ to second_ as in general_net::connect_neurons. Each pair may only be
+		// connected once.
+		void connect_neurons(size_t first_, size_t second_, T const &weight_ = 1.0);
+		void connect_neurons(size_t first_, size_t second_, tapped_delay_line<T> const &tdl_);
+
+		// Every neuron of [from_first_, from_first_ + from_count_) to every neuron of [to_first_, to_first_ + to_count_)
+		void connect_layers(size_t from_first_, size_t from_count_, size_t to_first_, size_t to_count_, tapped_delay_line<T> const &tdl_);
+		// Neuron from_first_ + i to neuron to_first_ + i for i < count_
+		void connect_one_to_one(size_t from_first_, size_t to_first_, size_t count_, tapped_delay_line<T> const &tdl_);
+		// Within [first_, first_ + count_) every neuron to the neurons at most bandwidth_ positions away, itself included
+		void connect_band(size_t first_, size_t count_, size_t bandwidth_, tapped_delay_line<T> const &tdl_);
+
+		general_net<T> build() const;
+
+	private:
+		struct edge
+		{
+			size_t source, target, delay_line;
+		};
+
+		std::vector<T> biases;
+		std::vector<activation_function> activations;
+		std::vector<bool> outputs;
+		std::vector<size_t> inputs; // In the order of declaration
+		std::vector<tapped_delay_line<T>> delay_lines; // Shared by all edges of one primitive
+		std::vector<edge> edges;
+
+		void check_range(size_t first_, size_t count_) const;
+		size_t add_delay_line(tapped_delay_line<T> const &tdl_);
+	};
+
+
+
+
+	template <class T>
+	size_t net_builder<T>::add_neurons(size_t count_)
+	{
+		size_t first = get_neuron_count();
+		biases.resize(first + count_, T(1));
+		activations.resize(first + count_, activation_function::automatic);
+		outputs.resize(first + count_, false);
+		return first;
+	}
+
+	template <class T>
+	void net_builder<T>::declare_as_input(size_t index_)
+	{
+		check_range(index_, 1);
+		if (std::find(inputs.begin(), inputs.end(), index_) == inputs.end()) {
+			inputs.push_back(index_);
+		}
+	}
+
+	template <class T>
+	void net_builder<T>::declare_as_output(size_t index_)
+	{
+		check_range(index_, 1);
+		outputs[index_] = true;
+	}
+
+	template <class T>
+	void net_builder<T>::set_neuron_activation(size_t first_, size_t count_, activation_function activation_)
+	{
+		check_range(first_, count_);
+		std::fill_n(activations.begin() + first_, count_, activation_);
+	}
+
+	template <class T>
+	void net_builder<T>::connect_neurons(size_t first_, size_t second_, T const &weight_)
+	{
+		connect_neurons(first_, second_, tapped_delay_line<T>(0, weight_));
+	}
+
+	template <class T>
+	void net_builder<T>::connect_neurons(size_t first_, size_t second_, tapped_delay_line<T> const &tdl_)
+	{
+		check_range(first_, 1);
+		check_range(second_, 1);
+		edges.push_back(edge{ first_, second_, add_delay_line(tdl_) });
+	}
+
+	template <class T>
+	void net_builder<T>::connect_layers(size_t from_first_, size_t from_count_, size_t to_first_, size_t to_count_, tapped_delay_line<T> const &tdl_)
+	{
+		check_range(from_first_, from_count_);
+		check_range(to_first_, to_count_);
+		size_t delay_line = add_delay_line(tdl_);
+		edges.reserve(edges.size() + from_count_*to_count_);
+		for (size_t i = from_first_; i < from_first_ + from_count_; ++i) {
+			for (size_t j = to_first_; j < to_first_ + to_count_; ++j) {
+				edges.push_back(edge{ i, j, delay_line });
+			}
+		}
+	}
+
+	template <class T>
+	void net_builder<T>::connect_one_to_one(size_t from_first_, size_t to_first_, size_t count_, tapped_delay_line<T> const &tdl_)
+	{
+		check_range(from_first_, count_);
+		check_range(to_first_, count_);
+		size_t delay_line = add_delay_line(tdl_);
+		for (size_t i = 0; i < count_; ++i) {
+			edges.push_back(edge{ from_first_ + i, to_first_ + i, delay_line });
+		}
+	}
+
+	template <class T>
+	void net_builder<T>::connect_band(size_t first_, size_t count_, size_t bandwidth_, tapped_delay_line<T> const &tdl_)
+	{
+		check_range(first_, count_);
+		size_t delay_line = add_delay_line(tdl_);
+		for (size_t i = 0; i < count_; ++i) {
+			for (size_t j = i > bandwidth_ ? i - bandwidth_ : 0; j < std::min(count_, i + bandwidth_ + 1); ++j) {
+				edges.push_back(edge{ first_ + i, first_ + j, delay_line });
+			}
+		}
+	}
+
+	template <class T>
+	general_net<T> net_builder<T>::build() const
+	{
+		for (auto const &i : delay_lines) {
+			auto const &taps = i.get_delay_line();
+			for (size_t k = 1; k < taps.size(); ++k) {
+				if (taps[k].delay_index <= taps[k - 1].delay_index) {
+					throw neural_exception("The delays of a tapped delay line must be strictly increasing!");
+				}
+			}
+		}
+
+		size_t neuron_count = get_neuron_count(), tap_count = 0;
+		for (auto const &i : edges) {
+			tap_count += delay_lines[i.delay_line].get_delay_count();
+		}
+
+		general_net<T> net(neuron_count);
+		auto &topo = *net.topology;
+		net.weights.resize(tap_count);
+		topo.frozen_weights.assign(tap_count, false);
+		topo.shared_weights.resize(tap_count);
+		std::vector<size_t> memory_sizes(neuron_count, 0);
+		size_t offset = 0;
+		for (auto const &i : edges) {
+			auto &connection = topo.connections(i.target, i.source);
+			if (connection.is_connected()) {
+				throw neural_exception("Neuron " + std::to_string(i.source) + " is connected to neuron " + std::to_string(i.target) + " more than once!");
+			}
+			auto const &tdl = delay_lines[i.delay_line];
+			connection = tdl;
+			topo.weight_offsets(i.target, i.source) = offset;
+			for (size_t k = 0; k < tdl.get_delay_count(); ++k, ++offset) {
+				net.weights[offset] = tdl.get_delay_weight(k);
+				topo.shared_weights[offset] = offset;
+			}
+			if (tdl.has_delays()) {
+				memory_sizes[i.source] = std::max(memory_sizes[i.source], tdl.get_maximum_delay() + 1);
+			}
+		}
+		topo.weight_count += tap_count;
+
+		for (size_t i = 0; i < neuron_count; ++i) {
+			if (memory_sizes[i]) {
+				net.neurons[i].set_memory_size(memory_sizes[i]);
+			}
+			net.set_neuron_bias_weight(i, biases[i]);
+			net.set_neuron_activation(i, activations[i]);
+			if (outputs[i]) {
+				net.declare_as_output(i);
+			}
+		}
+		for (auto const &i : inputs) {
+			net.declare_as_input(i);
+		}
+		net.topological_sort();
+		return net;
+	}
+
+	template <class T>
+	void net_builder<T>::check_range(size_t first_, size_t count_) const
+	{
+		if (first_ + count_ > get_neuron_count()) {
+			throw neural_exception("Neuron index " + std::to_string(first_ + count_ - 1) + " is out of range!");
+		}
+	}
+
+	template <class T>
+	size_t net_builder<T>::add_delay_line(tapped_delay_line<T> const &tdl_)
+	{
+		if (!tdl_.is_connected() || !tdl_.get_delay_count()) {
+			throw neural_exception("A connection needs at least one tap!");
+		}
+		delay_lines.push_back(tdl_);
+		return delay_lines.size() - 1;
+	}
+}
+
+#endif
@@ -0,0 +1,512 @@
+#ifndef NET_DATASETS_H
+#define NET_DATASETS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "neural_nets\neural_exception.h"
+#include "neural_nets\detail\matrix_utils.h"
+#include "neural_nets\detail\memory_mapped_file.h"
+
+// Training data for the training functions. A dataset is any class providing
+//
+//   typedef ... value_type;
+//   size_t get_sample_count() const;
+//   size_t get_input_count() const;
+//   size_t get_output_count() const;
+//   void read(size_t first_, size_t count_, matrix<value_type> &u_, matrix<value_type> &y_) const;
+//   void prefetch(size_t first_, size_t count_) const;   // Hint: these samples will be read next
+//   void release(size_t first_, size_t count_) const;    // Hint: these samples will not be read again soon
+//
+// The training functions read datasets sequentially in chunks, so only a bounded number of samples is
+// held in memory at any time.
+
+namespace neural_nets
+{
+	// Non owning view on input and output matrices that are held in memory
+	template <typename T>
+	class matrix_dataset
+	{
+	public:
+		typedef T value_type;
+
+		explicit matrix_dataset() : u(nullptr), y(nullptr) {}
+		explicit matrix_dataset(boost::numeric::ublas::matrix<T> const &u_, boost::numeric::ublas::matrix<T> const &y_) : u(&u_), y(&y_)
+		{
+			if (u_.size1() != y_.size1()) {
+				throw neural_exception("Input and output data must have the same number of samples!");
+			}
+		}
+
+		size_t get_sample_count() const { return u ? u->size1() : 0; }
+		size_t get_input_count() const { return u ? u->size2() : 0; }
+		size_t get_output_count() const { return y ? y->size2() : 0; }
+
+		void read(size_t first_, size_t count_, boost::numeric::ublas::matrix<T> &u_, boost::numeric::ublas::matrix<T> &y_) const
+		{
+			using boost::numeric::ublas::range;
+			u_ = project(*u, range(first_, first_ + count_), range(0, u->size2()));
+			y_ = project(*y, range(first_, first_ + count_), range(0, y->size2()));
+		}
+
+		void prefetch(size_t, size_t) const {}
+		void release(size_t, size_t) const {}
+
+	private:
+		boost::numeric::ublas::matrix<T> const *u, *y;
+	};
+
+	// View on a contiguous range of samples of another dataset, e.g. a prefix used as training horizon
+	template <typename dataset_type>
+	class dataset_range
+	{
+	public:
+		typedef typename dataset_type::value_type value_type;
+
+		explicit dataset_range(dataset_type const &data_, size_t first_, size_t count_) : data(&data_), first(first_), count(count_)
+		{
+			if (first_ + count_ > data_.get_sample_count()) {
+				throw neural_exception("Dataset range exceeds the dataset!");
+			}
+		}
+
+		size_t get_sample_count() const { return count; }
+		size_t get_input_count() const { return data->get_input_count(); }
+		size_t get_output_count() const { return data->get_output_count(); }
+
+		void read(size_t first_, size_t count_, boost::numeric::ublas::matrix<value_type> &u_, boost::numeric::ublas::matrix<value_type> &y_) const
+		{
+			data->read(first + first_, count_, u_, y_);
+		}
+		void prefetch(size_t first_, size_t count_) const { data->prefetch(first + first_, count_); }
+		void release(size_t first_, size_t count_) const { data->release(first + first_, count_); }
+
+	private:
+		dataset_type const *data;
+		size_t first, count;
+	};
+
+	template <typename dataset_type>
+	dataset_range<dataset_type> make_dataset_range(dataset_type const &data_, size_t first_, size_t count_)
+	{
+		return dataset_range<dataset_type>(data_, first_, count_);
+	}
+
+	// Independent sequences (e.g. separate experiments) that are trained on as one problem. The internal memory
+	// of the network is reset at the start of every sequence, either cleared or set to a given initial state
+	// (as returned by general_net::get_internal_memory). Reading it like a single dataset yields the
+	// concatenation of all sequences.
+	template <typename dataset_type>
+	class multi_sequence_dataset
+	{
+	public:
+		typedef typename dataset_type::value_type value_type;
+
+		explicit multi_sequence_dataset() {}
+		explicit multi_sequence_dataset(std::vector<dataset_type> const &sequences_) : sequences(sequences_), initial_states(sequences_.size()) {}
+
+		void add_sequence(dataset_type const &sequence_, std::vector<value_type> const &initial_state_ = std::vector<value_type>())
+		{
+			if (!sequences.empty() && (sequence_.get_input_count() != get_input_count() || sequence_.get_output_count() != get_output_count())) {
+				throw neural_exception("All sequences must have the same number of inputs and outputs!");
+			}
+			sequences.push_back(sequence_);
+			initial_states.push_back(initial_state_);
+		}
+
+		size_t get_sequence_count() const { return sequences.size(); }
+		dataset_type const &get_sequence(size_t index_) const { return sequences[index_]; }
+		std::vector<value_type> const &get_initial_state(size_t index_) const { return initial_states[index_]; }
+
+		// Brings sys_ into the state it has at the start of the given sequence. A non-empty initial state must
+		// have the internal memory size of sys_.
+		template <typename sys_type>
+		void reset_state(sys_type &sys_, size_t index_) const
+		{
+			sys_.clear_internal_memory();
+			if (!initial_states[index_].empty()) {
+				try {
+					sys_.set_internal_memory(initial_states[index_].begin(), initial_states[index_].end());
+				}
+				catch (neural_exception const &e) {
+					throw neural_exception("Initial state of sequence " + std::to_string(index_) + ": " + e.what());
+				}
+			}
+		}
+
+		size_t get_sample_count() const
+		{
+			size_t count = 0;
+			for (auto const &i : sequences) {
+				count += i.get_sample_count();
+			}
+			return count;
+		}
+		size_t get_input_count() const { return sequences.empty() ? 0 : sequences.front().get_input_count(); }
+		size_t get_output_count() const { return sequences.empty() ? 0 : sequences.front().get_output_count(); }
+
+		void read(size_t first_, size_t count_, boost::numeric::ublas::matrix<value_type> &u_, boost::numeric::ublas::matrix<value_type> &y_) const
+		{
+			using boost::numeric::ublas::range;
+			boost::numeric::ublas::matrix<value_type> u_part, y_part;
+			u_.resize(count_, get_input_count(), false);
+			y_.resize(count_, get_output_count(), false);
+			size_t row = 0;
+			for_each_part(first_, count_, [&](dataset_type const &sequence_, size_t sequence_first_, size_t sequence_count_) {
+				sequence_.read(sequence_first_, sequence_count_, u_part, y_part);
+				project(u_, range(row, row + sequence_count_), range(0, u_.size2())) = u_part;
+				project(y_, range(row, row + sequence_count_), range(0, y_.size2())) = y_part;
+				row += sequence_count_;
+			});
+		}
+		void prefetch(size_t first_, size_t count_) const
+		{
+			for_each_part(first_, count_, [](dataset_type const &sequence_, size_t sequence_first_, size_t sequence_count_) {
+				sequence_.prefetch(sequence_first_, sequence_count_);
+			});
+		}
+		void release(size_t first_, size_t count_) const
+		{
+			for_each_part(first_, count_, [](dataset_type const &sequence_, size_t sequence_first_, size_t sequence_count_) {
+				sequence_.release(sequence_first_, sequence_count_);
+			});
+		}
+
+		// The first count_ samples of the concatenation, keeping the sequence boundaries
+		multi_sequence_dataset<dataset_range<dataset_type>> get_prefix(size_t count_) const
+		{
+			multi_sequence_dataset<dataset_range<dataset_type>> prefix;
+			for (size_t i = 0; i < sequences.size() && count_; ++i) {
+				size_t length = std::min(count_, sequences[i].get_sample_count());
+				prefix.add_sequence(dataset_range<dataset_type>(sequences[i], 0, length), initial_states[i]);
+				count_ -= length;
+			}
+			return prefix;
+		}
+
+	private:
+		std::vector<dataset_type> sequences;
+		std::vector<std::vector<value_type>> initial_states;
+
+		template <typename func>
+		void for_each_part(size_t first_, size_t count_, func func_) const
+		{
+			for (size_t i = 0; i < sequences.size() && count_; ++i) {
+				size_t length = sequences[i].get_sample_count();
+				if (first_ >= length) {
+					first_ -= length;
+					continue;
+				}
+				size_t part = std::min(count_, length - first_);
+				func_(sequences[i], first_, part);
+				count_ -= part;
+				first_ = 0;
+			}
+		}
+	};
+
+	namespace detail
+	{
+		template <typename type, typename = void>
+		struct is_dataset : std::false_type {};
+
+		template <typename type>
+		struct is_dataset<type, decltype(void(std::declval<type const &>().get_sample_count()))> : std::true_type {};
+
+		template <typename type>
+		struct is_multi_sequence_dataset : std::false_type {};
+
+		template <typename dataset_type>
+		struct is_multi_sequence_dataset<multi_sequence_dataset<dataset_type>> : std::true_type {};
+
+		namespace column_files
+		{
+			static std::uint32_t const format_version = 1;
+			static std::uint32_t const endianness_marker = 0x01020304;
+
+			// A column file is this header followed by sample_count values of the scalar type
+			struct column_header
+			{
+				char magic[8];
+				std::uint32_t version;
+				std::uint32_t endianness;
+				std::uint32_t scalar_size;
+				std::uint32_t scalar_digits;
+				std::uint64_t sample_count;
+			};
+
+			inline char const *get_magic() { return "GDNNCOL"; }
+		}
+	}
+
+	// Writes one column of samples to a binary column file
+	template <typename T>
+	class column_file_writer
+	{
+	public:
+		explicit column_file_writer(std::string const &file_name_) : file_name(file_name_), file(file_name_, std::ios::binary), sample_count(0)
+		{
+			if (!file) {
+				throw neural_exception("Could not open file " + file_name_ + " for writing");
+			}
+			write_header();
+		}
+		~column_file_writer()
+		{
+			try {
+				close();
+			}
+			catch (neural_exception const &) {}
+		}
+
+		void append(T const &value_)
+		{
+			file.write(reinterpret_cast<char const *>(&value_), sizeof(T));
+			++sample_count;
+		}
+
+		void close()
+		{
+			if (file.is_open()) {
+				file.seekp(0);
+				write_header();
+				file.close();
+				if (file.fail()) {
+					throw neural_exception("Could not write file " + file_name);
+				}
+			}
+		}
+
+	private:
+		std::string file_name;
+		std::ofstream file;
+		std::uint64_t sample_count;
+
+		void write_header()
+		{
+			using namespace detail::column_files;
+			column_header header;
+			std::memset(&header, 0, sizeof(header));
+			std::memcpy(header.magic, get_magic(), sizeof(header.magic));
+			header.version = format_version;
+			header.endianness = endianness_marker;
+			header.scalar_size = sizeof(T);
+			header.scalar_digits = std::numeric_limits<T>::digits;
+			header.sample_count = sample_count;
+			file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+		}
+	};
+
+	// Dataset backed by memory mapped column files, one file per input and output signal
+	template <typename T>
+	class mapped_dataset
+	{
+	public:
+		typedef T value_type;
+
+		explicit mapped_dataset(std::vector<std::string> const &input_files_, std::vector<std::string> const &output_files_) : sample_count(0)
+		{
+			for (auto const &i : input_files_) {
+				inputs.push_back(open_column(i));
+			}
+			for (auto const &i : output_files_) {
+				outputs.push_back(open_column(i));
+			}
+		}
+
+		size_t get_sample_count() const { return sample_count; }
+		size_t get_input_count() const { return inputs.size(); }
+		size_t get_output_count() const { return outputs.size(); }
+
+		void read(size_t first_, size_t count_, boost::numeric::ublas::matrix<T> &u_, boost::numeric::ublas::matrix<T> &y_) const
+		{
+			u_.resize(count_, inputs.size(), false);
+			y_.resize(count_, outputs.size(), false);
+			for (size_t j = 0; j < inputs.size(); ++j) {
+				T const *values = get_values(*inputs[j]) + first_;
+				for (size_t i = 0; i < count_; ++i) {
+					u_(i, j) = values[i];
+				}
+			}
+			for (size_t j = 0; j < outputs.size(); ++j) {
+				T const *values = get_values(*outputs[j]) + first_;
+				for (size_t i = 0; i < count_; ++i) {
+					y_(i, j) = values[i];
+				}
+			}
+		}
+
+		void prefetch(size_t first_, size_t count_) const
+		{
+			for (auto const &i : inputs) {
+				i->prefetch(sizeof(detail::column_files::column_header) + first_*sizeof(T), count_*sizeof(T));
+			}
+			for (auto const &i : outputs) {
+				i->prefetch(sizeof(detail::column_files::column_header) + first_*sizeof(T), count_*sizeof(T));
+			}
+		}
+
+		void release(size_t first_, size_t count_) const
+		{
+			for (auto const &i : inputs) {
+				i->release(sizeof(detail::column_files::column_header) + first_*sizeof(T), count_*sizeof(T));
+			}
+			for (auto const &i : outputs) {
+				i->release(sizeof(detail::column_files::column_header) + first_*sizeof(T), count_*sizeof(T));
+			}
+		}
+
+	private:
+		size_t sample_count;
+		std::vector<std::shared_ptr<detail::memory_mapped_file>> inputs, outputs;
+
+		static T const *get_values(detail::memory_mapped_file const &file_)
+		{
+			return reinterpret_cast<T const *>(file_.get_data() + sizeof(detail::column_files::column_header));
+		}
+
+		std::shared_ptr<detail::memory_mapped_file> open_column(std::string const &file_name_)
+		{
+			using namespace detail::column_files;
+			auto file = std::make_shared<detail::memory_mapped_file>(file_name_);
+			if (file->get_size() < sizeof(column_header)) {
+				throw neural_exception(file_name_ + " is not a column file");
+			}
+			column_header const &header = *reinterpret_cast<column_header const *>(file->get_data());
+			if (std::memcmp(header.magic, get_magic(), sizeof(header.magic)) != 0 || header.version != format_version) {
+				throw neural_exception(file_name_ + " is not a column file of a supported version");
+			}
+			if (header.endianness != endianness_marker || header.scalar_size != sizeof(T) || header.scalar_digits != std::numeric_limits<T>::digits) {
+				throw neural_exception(file_name_ + " was written for a different floating point type or byte order");
+			}
+			// The sample count is untrusted, bound it before computing the exact size
+			if (header.sample_count > (file->get_size() - sizeof(column_header)) / sizeof(T) ||
+				file->get_size() != sizeof(column_header) + static_cast<size_t>(header.sample_count)*sizeof(T)) {
+				throw neural_exception(file_name_ + " is truncated or corrupt");
+			}
+			if (inputs.empty() && outputs.empty()) {
+				sample_count = static_cast<size_t>(header.sample_count);
+			}
+			else if (sample_count != header.sample_count) {
+				throw neural_exception("All column files of a dataset must have the same number of samples!");
+			}
+			return file;
+		}
+	};
+
+	// Converts every column of a CSV file into a column file "<prefix><column index>.col" and returns
+	// their names. The CSV file is read line by line, so it may be larger than the available memory.
+	template <typename T>
+	std::vector<std::string> convert_csv_to_columns(std::string const &csv_file_, std::string const &column_prefix_, char separator_ = ',', bool has_header_ = true)
+	{
+		std::ifstream csv(csv_file_);
+		if (!csv) {
+			throw neural_exception("Could not open file " + csv_file_);
+		}
+
+		std::vector<std::string> file_names;
+		std::vector<std::unique_ptr<column_file_writer<T>>> writers;
+		std::vector<T> values;
+		std::string line, cell;
+		size_t line_number = 0;
+		while (std::getline(csv, line)) {
+			++line_number;
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+			if (line.empty() || (has_header_ && line_number == 1)) {
+				continue;
+			}
+			std::stringstream line_stream(line);
+			values.clear();
+			while (std::getline(line_stream, cell, separator_)) {
+				std::stringstream cell_stream(cell);
+				T value;
+				if (!(cell_stream >> value)) {
+					throw neural_exception(csv_file_ + " contains an invalid number in line " + std::to_string(line_number));
+				}
+				values.push_back(value);
+			}
+			if (writers.empty()) {
+				for (size_t i = 0; i < values.size(); ++i) {
+					file_names.push_back(column_prefix_ + std::to_string(i) + ".col");
+					writers.emplace_back(new column_file_writer<T>(file_names.back()));
+				}
+			}
+			if (values.size() != writers.size()) {
+				throw neural_exception(csv_file_ + " has an inconsistent number of columns in line " + std::to_string(line_number));
+			}
+			for (size_t i = 0; i < values.size(); ++i) {
+				writers[i]->append(values[i]);
+			}
+		}
+		for (auto &i : writers) {
+			i->close();
+		}
+		return file_names;
+	}
+
+	namespace detail
+	{
+		// Reads a dataset chunk by chunk and calls func_(first_sample, u_chunk, y_chunk) for each chunk.
+		// The next chunk is prefetched while the current one is processed.
+		template <typename dataset_type, typename func>
+		void for_each_chunk(dataset_type const &data_, size_t chunk_size_, func func_)
+		{
+			boost::numeric::ublas::matrix<typename dataset_type::value_type> u, y;
+			size_t sample_count = data_.get_sample_count();
+			chunk_size_ = std::max<size_t>(1, chunk_size_);
+			for (size_t first = 0; first < sample_count; first += chunk_size_) {
+				size_t count = std::min(chunk_size_, sample_count - first);
+				data_.read(first, count, u, y);
+				if (first + count < sample_count) {
+					data_.prefetch(first + count, std::min(chunk_size_, sample_count - first - count));
+				}
+				func_(first, u, y);
+				data_.release(first, count);
+			}
+		}
+
+		// Uniform access to the independent sequences of plain (one sequence) and multi sequence datasets
+		template <typename dataset_type>
+		size_t get_sequence_count(dataset_type const &) { return 1; }
+
+		template <typename dataset_type>
+		dataset_type const &get_sequence(dataset_type const &data_, size_t) { return data_; }
+
+		template <typename dataset_type, typename sys_type>
+		void reset_sequence_state(dataset_type const &, size_t, sys_type &sys_) { sys_.clear_internal_memory(); }
+
+		template <typename dataset_type>
+		size_t get_sequence_count(multi_sequence_dataset<dataset_type> const &data_) { return data_.get_sequence_count(); }
+
+		template <typename dataset_type>
+		dataset_type const &get_sequence(multi_sequence_dataset<dataset_type> const &data_, size_t index_) { return data_.get_sequence(index_); }
+
+		template <typename dataset_type, typename sys_type>
+		void reset_sequence_state(multi_sequence_dataset<dataset_type> const &data_, size_t index_, sys_type &sys_) { data_.reset_state(sys_, index_); }
+
+		// Leading samples of a dataset used as training horizon
+		template <typename dataset_type>
+		dataset_range<dataset_type> make_prefix(dataset_type const &data_, size_t count_)
+		{
+			return dataset_range<dataset_type>(data_, 0, count_);
+		}
+
+		template <typename dataset_type>
+		multi_sequence_dataset<dataset_range<dataset_type>> make_prefix(multi_sequence_dataset<dataset_type> const &data_, size_t count_)
+		{
+			return data_.get_prefix(count_);
+		}
+	}
+}
+
+#endif
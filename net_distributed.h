@@ -0,0 +1,326 @@
+#ifndef NET_DISTRIBUTED_H
+#define NET_DISTRIBUTED_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "neural_nets\neural_exception.h"
+#include "neural_nets\net_training.h"
+#include "neural_nets\detail\distributed_training.h"
+
+// Data parallel Levenberg-Marquardt training on one machine: every process holds a slice of the training
+// sequences. The coordinator accepts the workers with listen_for_workers and trains with train_lm on a
+// distributed_dataset of its own slice, each worker connects with connect_to_coordinator and serves its slice
+// with run_lm_worker until the coordinator stops it. Only the parameters go to the workers and only the
+// normal equations (or squared errors) come back, so the traffic per iteration does not depend on the number
+// of samples.
+
+namespace neural_nets
+{
+	namespace detail
+	{
+#ifdef _WIN32
+		typedef SOCKET socket_handle;
+		static socket_handle const invalid_socket = INVALID_SOCKET;
+
+		inline void close_socket(socket_handle socket_) { ::closesocket(socket_); }
+
+		inline void start_sockets()
+		{
+			struct winsock
+			{
+				winsock()
+				{
+					WSADATA data;
+					if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+						throw neural_exception("Could not start Winsock!");
+					}
+				}
+				~winsock() { WSACleanup(); }
+			};
+			static winsock instance;
+		}
+#else
+		typedef int socket_handle;
+		static socket_handle const invalid_socket = -1;
+
+		inline void close_socket(socket_handle socket_) { ::close(socket_); }
+		inline void start_sockets() {}
+#endif
+
+		// Return false if the connection was lost
+		inline bool send_all(socket_handle socket_, char const *data_, size_t size_)
+		{
+			while (size_) {
+#ifdef _WIN32
+				int sent = ::send(socket_, data_, static_cast<int>(std::min<size_t>(size_, 1 << 30)), 0);
+#else
+#ifdef MSG_NOSIGNAL
+				ssize_t sent = ::send(socket_, data_, size_, MSG_NOSIGNAL);
+#else
+				ssize_t sent = ::send(socket_, data_, size_, 0);
+#endif
+				if (sent < 0 && errno == EINTR) {
+					continue;
+				}
+#endif
+				if (sent <= 0) {
+					return false;
+				}
+				data_ += sent;
+				size_ -= static_cast<size_t>(sent);
+			}
+			return true;
+		}
+
+		inline bool receive_all(socket_handle socket_, char *data_, size_t size_)
+		{
+			while (size_) {
+#ifdef _WIN32
+				int received = ::recv(socket_, data_, static_cast<int>(std::min<size_t>(size_, 1 << 30)), 0);
+#else
+				ssize_t received = ::recv(socket_, data_, size_, 0);
+				if (received < 0 && errno == EINTR) {
+					continue;
+				}
+#endif
+				if (received <= 0) {
+					return false;
+				}
+				data_ += received;
+				size_ -= static_cast<size_t>(received);
+			}
+			return true;
+		}
+
+		inline sockaddr_un make_socket_address(std::string const &path_)
+		{
+			sockaddr_un address;
+			std::memset(&address, 0, sizeof(address));
+			address.sun_family = AF_UNIX;
+			if (path_.empty() || path_.size() >= sizeof(address.sun_path)) {
+				throw neural_exception("Invalid socket path " + path_);
+			}
+			std::memcpy(address.sun_path, path_.c_str(), path_.size());
+			return address;
+		}
+	}
+
+	// Blocking byte streams over Unix domain sockets between the coordinator and its workers (peers are the
+	// workers in rank order, or for a worker the coordinator). Created by listen_for_workers and
+	// connect_to_coordinator.
+	class unix_socket_transport
+	{
+	public:
+		unix_socket_transport() {}
+		unix_socket_transport(unix_socket_transport &&other_) : peers(std::move(other_.peers)) { other_.peers.clear(); }
+		~unix_socket_transport() { close(); }
+
+		unix_socket_transport &operator=(unix_socket_transport &&other_)
+		{
+			if (this != &other_) {
+				close();
+				peers = std::move(other_.peers);
+				other_.peers.clear();
+			}
+			return *this;
+		}
+
+		unix_socket_transport(unix_socket_transport const &) = delete;
+		unix_socket_transport &operator=(unix_socket_transport const &) = delete;
+
+		size_t get_peer_count() const { return peers.size(); }
+
+		void send(size_t peer_, void const *data_, size_t size_);
+		void receive(size_t peer_, void *data_, size_t size_);
+		void close();
+
+	private:
+		std::vector<detail::socket_handle> peers;
+
+		friend unix_socket_transport listen_for_workers(std::string const &path_, size_t worker_count_);
+		friend unix_socket_transport connect_to_coordinator(std::string const &path_, size_t rank_, std::chrono::milliseconds timeout_);
+	};
+
+	// Creates the socket path_ and waits until worker_count_ workers with the ranks 1 to worker_count_ have
+	// connected. The path is removed again once all workers are connected.
+	inline unix_socket_transport listen_for_workers(std::string const &path_, size_t worker_count_)
+	{
+		detail::start_sockets();
+		sockaddr_un address = detail::make_socket_address(path_);
+		std::remove(path_.c_str());
+		detail::socket_handle listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener == detail::invalid_socket) {
+			throw neural_exception("Could not create socket " + path_);
+		}
+		if (::bind(listener, reinterpret_cast<sockaddr const *>(&address), sizeof(address)) != 0 || ::listen(listener, static_cast<int>(worker_count_)) != 0) {
+			detail::close_socket(listener);
+			throw neural_exception("Could not listen on socket " + path_);
+		}
+
+		unix_socket_transport transport;
+		transport.peers.assign(worker_count_, detail::invalid_socket);
+		try {
+			for (size_t i = 0; i < worker_count_; ++i) {
+				detail::socket_handle peer = ::accept(listener, nullptr, nullptr);
+				if (peer == detail::invalid_socket) {
+					throw neural_exception("Could not accept worker on socket " + path_);
+				}
+				std::uint64_t rank = 0;
+				if (!detail::receive_all(peer, reinterpret_cast<char *>(&rank), sizeof(rank)) || rank < 1 || rank > worker_count_ ||
+					transport.peers[rank - 1] != detail::invalid_socket) {
+					detail::close_socket(peer);
+					throw neural_exception("Worker connected with invalid rank " + std::to_string(rank));
+				}
+				transport.peers[rank - 1] = peer;
+			}
+		}
+		catch (...) {
+			detail::close_socket(listener);
+			std::remove(path_.c_str());
+			throw;
+		}
+		detail::close_socket(listener);
+		std::remove(path_.c_str());
+		return transport;
+	}
+
+	// Connects worker rank_ (1 based) to the coordinator listening on path_, retrying until timeout_ if the
+	// coordinator has not started listening yet
+	inline unix_socket_transport connect_to_coordinator(std::string const &path_, size_t rank_, std::chrono::milliseconds timeout_ = std::chrono::seconds(30))
+	{
+		detail::start_sockets();
+		sockaddr_un address = detail::make_socket_address(path_);
+		auto deadline = std::chrono::steady_clock::now() + timeout_;
+		unix_socket_transport transport;
+		while (true) {
+			detail::socket_handle peer = ::socket(AF_UNIX, SOCK_STREAM, 0);
+			if (peer == detail::invalid_socket) {
+				throw neural_exception("Could not create socket " + path_);
+			}
+			if (::connect(peer, reinterpret_cast<sockaddr const *>(&address), sizeof(address)) == 0) {
+				std::uint64_t rank = rank_;
+				if (!detail::send_all(peer, reinterpret_cast<char const *>(&rank), sizeof(rank))) {
+					detail::close_socket(peer);
+					throw neural_exception("Connection to coordinator on socket " + path_ + " lost!");
+				}
+				transport.peers.push_back(peer);
+				return transport;
+			}
+			detail::close_socket(peer);
+			if (std::chrono::steady_clock::now() >= deadline) {
+				throw neural_exception("Could not connect to coordinator on socket " + path_);
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+	}
+
+	inline void unix_socket_transport::send(size_t peer_, void const *data_, size_t size_)
+	{
+		if (!detail::send_all(peers[peer_], static_cast<char const *>(data_), size_)) {
+			throw neural_exception("Connection to peer " + std::to_string(peer_ + 1) + " lost!");
+		}
+	}
+
+	inline void unix_socket_transport::receive(size_t peer_, void *data_, size_t size_)
+	{
+		if (!detail::receive_all(peers[peer_], static_cast<char *>(data_), size_)) {
+			throw neural_exception("Connection to peer " + std::to_string(peer_ + 1) + " lost!");
+		}
+	}
+
+	inline void unix_socket_transport::close()
+	{
+		for (auto i : peers) {
+			if (i != detail::invalid_socket) {
+				detail::close_socket(i);
+			}
+		}
+		peers.clear();
+	}
+
+	// Serves the requests of the coordinator on the local slice data_ until it stops the workers. sys_ must
+	// have the structure of the system trained by the coordinator, its parameters are replaced by those of
+	// each request. Errors during a request are sent to the coordinator, which rethrows them from train_lm.
+	template <typename dynamic_system, typename dataset_type, typename transport_type>
+	void run_lm_worker(dynamic_system const &sys_, dataset_type const &data_, transport_type &transport_,
+		lm_options<typename dataset_type::value_type> const &opts_ = lm_options<typename dataset_type::value_type>())
+	{
+		using namespace detail::distributed;
+		using T = typename dataset_type::value_type;
+
+		worker_hello hello{ data_.get_sample_count(), data_.get_input_count(), data_.get_output_count(), sizeof(T) };
+		transport_.send(0, &hello, sizeof(hello));
+
+		size_t parameter_count = sys_.get_parameter_count();
+		std::vector<T> request, reply;
+		boost::numeric::ublas::matrix<T> hessian_approx;
+		boost::numeric::ublas::vector<T> gradient;
+		while (true) {
+			message_header header;
+			transport_.receive(0, &header, sizeof(header));
+			if (header.code == static_cast<std::uint64_t>(command::stop)) {
+				return;
+			}
+			request.resize(static_cast<size_t>(header.size / sizeof(T)));
+			receive_values(transport_, 0, request);
+
+			try {
+				if (header.size != header.count*parameter_count*sizeof(T)) {
+					throw neural_exception("Parameter count " + std::to_string(parameter_count) + " does not match the coordinator!");
+				}
+				dynamic_system sys(sys_);
+				switch (static_cast<command>(header.code)) {
+				case command::normal_equations: {
+					T squared_error;
+					sys.set_parameters(request.begin(), request.end());
+					detail::calc_normal_equations_numerically(sys, data_, opts_, hessian_approx, gradient, squared_error);
+					pack_normal_equations(hessian_approx, gradient, squared_error, reply);
+					break;
+				}
+				case command::squared_error:
+					sys.set_parameters(request.begin(), request.end());
+					reply.assign(1, detail::calc_squared_error(sys, data_, opts_.chunk_size, opts_.use_parallelization));
+					break;
+				case command::squared_errors: {
+					std::vector<std::vector<T>> parameters(static_cast<size_t>(header.count));
+					for (size_t i = 0; i < parameters.size(); ++i) {
+						parameters[i].assign(request.begin() + i*parameter_count, request.begin() + (i + 1)*parameter_count);
+					}
+					reply = detail::calc_squared_errors(sys, parameters, data_, opts_);
+					break;
+				}
+				default:
+					throw neural_exception("Unknown request " + std::to_string(header.code));
+				}
+			}
+			catch (std::exception const &e) {
+				send_error(transport_, 0, e.what());
+				continue;
+			}
+			send_values(transport_, 0, reply_ok, reply.size(), reply);
+		}
+	}
+}
+
+#endif
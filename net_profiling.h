@@ -0,0 +1,192 @@
+#ifndef NET_PROFILING_H
+#define NET_PROFILING_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Hot path instrumentation of network simulation and training. It is compiled out completely unless
+// NEURAL_NETS_ENABLE_PROFILING is defined before including any header of this library. The report API
+// is always available, without instrumentation all counters simply stay zero.
+
+namespace neural_nets
+{
+	enum class profiling_event : size_t
+	{
+		forward_step,
+		topological_sort,
+		jacobian_column,
+		normal_equations,
+		linear_solve,
+		rejected_step,
+		trial_restart,
+		event_count
+	};
+
+	inline char const *get_profiling_event_name(profiling_event event_)
+	{
+		static char const *names[] = { "forward_step", "topological_sort", "jacobian_column",
+			"normal_equations", "linear_solve", "rejected_step", "trial_restart" };
+		return names[static_cast<size_t>(event_)];
+	}
+
+	struct profiling_counter
+	{
+		unsigned long long count = 0;
+		double seconds = 0.0;
+	};
+
+	struct profiling_report
+	{
+		static size_t const event_count = static_cast<size_t>(profiling_event::event_count);
+
+		bool enabled = false;
+		std::array<profiling_counter, event_count> counters;
+
+		profiling_counter const &operator[](profiling_event event_) const { return counters[static_cast<size_t>(event_)]; }
+		profiling_counter &operator[](profiling_event event_) { return counters[static_cast<size_t>(event_)]; }
+	};
+
+	inline profiling_report operator-(profiling_report left_, profiling_report const &right_)
+	{
+		for (size_t i = 0; i < profiling_report::event_count; ++i) {
+			left_.counters[i].count -= right_.counters[i].count;
+			left_.counters[i].seconds -= right_.counters[i].seconds;
+		}
+		return left_;
+	}
+
+	namespace detail
+	{
+		namespace profiling
+		{
+			// Each thread accumulates into its own buffer, so instrumented code never writes to shared
+			// cache lines. Only the owning thread writes, readers may observe slightly stale values.
+			struct thread_buffer
+			{
+				thread_buffer() {
+					for (size_t i = 0; i < profiling_report::event_count; ++i) {
+						counts[i].store(0, std::memory_order_relaxed);
+						nanoseconds[i].store(0, std::memory_order_relaxed);
+					}
+				}
+				std::atomic<unsigned long long> counts[profiling_report::event_count];
+				std::atomic<unsigned long long> nanoseconds[profiling_report::event_count];
+			};
+
+			struct registry
+			{
+				std::mutex mutex;
+				std::vector<std::shared_ptr<thread_buffer>> buffers;
+			};
+
+			inline registry &get_registry()
+			{
+				static registry instance;
+				return instance;
+			}
+
+			inline thread_buffer &get_thread_buffer()
+			{
+				thread_local std::shared_ptr<thread_buffer> buffer = []() {
+					auto result = std::make_shared<thread_buffer>();
+					std::lock_guard<std::mutex> lock(get_registry().mutex);
+					get_registry().buffers.push_back(result);
+					return result;
+				}();
+				return *buffer;
+			}
+
+			inline void add(profiling_event event_, unsigned long long nanoseconds_)
+			{
+				auto &buffer = get_thread_buffer();
+				size_t i = static_cast<size_t>(event_);
+				buffer.counts[i].store(buffer.counts[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				buffer.nanoseconds[i].store(buffer.nanoseconds[i].load(std::memory_order_relaxed) + nanoseconds_, std::memory_order_relaxed);
+			}
+
+			class scoped_timer
+			{
+			public:
+				explicit scoped_timer(profiling_event event_) : event(event_), start(std::chrono::steady_clock::now()) {}
+				~scoped_timer()
+				{
+					auto elapsed = std::chrono::steady_clock::now() - start;
+					add(event, static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+				}
+
+			private:
+				profiling_event event;
+				std::chrono::steady_clock::time_point start;
+			};
+		}
+	}
+
+	namespace profiling
+	{
+		inline bool is_enabled()
+		{
+#ifdef NEURAL_NETS_ENABLE_PROFILING
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		// Sums the counters of all threads since the start of the program or the last reset
+		inline profiling_report get_report()
+		{
+			profiling_report report;
+			report.enabled = is_enabled();
+			auto &reg = detail::profiling::get_registry();
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			for (auto const &buffer : reg.buffers) {
+				for (size_t i = 0; i < profiling_report::event_count; ++i) {
+					report.counters[i].count += buffer->counts[i].load(std::memory_order_relaxed);
+					report.counters[i].seconds += 1.0e-9*buffer->nanoseconds[i].load(std::memory_order_relaxed);
+				}
+			}
+			return report;
+		}
+
+		// Must not be called while instrumented code is running in another thread
+		inline void reset()
+		{
+			auto &reg = detail::profiling::get_registry();
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			for (auto const &buffer : reg.buffers) {
+				for (size_t i = 0; i < profiling_report::event_count; ++i) {
+					buffer->counts[i].store(0, std::memory_order_relaxed);
+					buffer->nanoseconds[i].store(0, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		// Report of everything that happened during the lifetime of a session, e.g. one training run
+		class session
+		{
+		public:
+			explicit session() : start(profiling::get_report()) {}
+			profiling_report get_report() const { return profiling::get_report() - start; }
+
+		private:
+			profiling_report start;
+		};
+	}
+}
+
+#ifdef NEURAL_NETS_ENABLE_PROFILING
+#define NEURAL_NETS_PROFILE_CONCAT_IMPL(a_, b_) a_##b_
+#define NEURAL_NETS_PROFILE_CONCAT(a_, b_) NEURAL_NETS_PROFILE_CONCAT_IMPL(a_, b_)
+#define NEURAL_NETS_PROFILE_SCOPE(event_) \
+	neural_nets::detail::profiling::scoped_timer NEURAL_NETS_PROFILE_CONCAT(profile_timer_, __LINE__)(neural_nets::profiling_event::event_)
+#define NEURAL_NETS_PROFILE_COUNT(event_) neural_nets::detail::profiling::add(neural_nets::profiling_event::event_, 0)
+#else
+#define NEURAL_NETS_PROFILE_SCOPE(event_) ((void)0)
+#define NEURAL_NETS_PROFILE_COUNT(event_) ((void)0)
+#endif
+
+#endif
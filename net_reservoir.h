@@ -0,0 +1,380 @@
+#ifndef NET_RESERVOIR_H
+#define NET_RESERVOIR_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "neural_nets\general_net.h"
+#include "neural_nets\neural_exception.h"
+#include "neural_nets\training_options.h"
+#include "neural_nets\net_datasets.h"
+#include "neural_nets\net_threading.h"
+#include "neural_nets\detail\net_gradient.h"
+#include "neural_nets\detail\matrix_utils.h"
+#include "neural_nets\detail\random_utils.h"
+
+// Reservoir computing (echo state networks): all non-output neurons form a fixed random recurrent reservoir,
+// only the connections into the output neurons (the readout) are trained by regularized linear least squares.
+
+namespace neural_nets
+{
+	namespace detail
+	{
+		// Growth rate of the linearized autonomous reservoir (activations replaced by their slope at zero,
+		// no inputs and biases), i.e. the spectral radius of its state transition including all delays. Relu
+		// counts with its slope for positive inputs, 1.
+		template <typename T>
+		T estimate_spectral_radius(net_graph<T> const &graph_, std::vector<T> const &parameters_, std::vector<bool> const &reservoir_)
+		{
+			size_t delay = graph_.get_max_delay(), neuron_count = graph_.get_neuron_count();
+			if (!delay) {
+				return 0;
+			}
+			size_t const steps = 1000, burn_in = 200;
+			std::vector<std::vector<T>> history(delay + 1, std::vector<T>(neuron_count, T(0)));
+			for (size_t d = 0; d < delay; ++d) {
+				for (size_t j = 0; j < neuron_count; ++j) {
+					history[(delay + 1 - d) % (delay + 1)][j] = reservoir_[j] ? random_utils::value_in_range<T>(-1, 1) : T(0);
+				}
+			}
+
+			auto const &edges = graph_.get_edges();
+			std::vector<T> slopes;
+			for (auto const &n : graph_.get_nodes()) {
+				slopes.push_back(n.activation == activation_function::relu ? T(1) : activation_derivative(n.activation, T(0)));
+			}
+			T log_growth = 0;
+			for (size_t t = 1; t <= steps; ++t) {
+				// Slot t % (delay + 1) holds step t, slot (t - d) % (delay + 1) the step d before
+				auto &current = history[t % (delay + 1)];
+				std::fill(current.begin(), current.end(), T(0));
+				auto const &nodes = graph_.get_nodes();
+				for (size_t i = 0; i < nodes.size(); ++i) {
+					auto const &n = nodes[i];
+					if (!reservoir_[n.neuron]) {
+						continue;
+					}
+					T sum = 0;
+					for (size_t e = n.first_edge; e < n.last_edge; ++e) {
+						if (reservoir_[edges[e].source]) {
+							sum += graph_.get_weight(parameters_, edges[e].parameter) * history[(t + delay + 1 - edges[e].delay) % (delay + 1)][edges[e].source];
+						}
+					}
+					current[n.neuron] = slopes[i]*sum;
+				}
+
+				T norm = 0;
+				for (size_t d = 0; d < delay; ++d) {
+					for (T v : history[(t + delay + 1 - d) % (delay + 1)]) {
+						norm += v*v;
+					}
+				}
+				norm = std::sqrt(norm);
+				if (norm == T(0)) {
+					return 0;
+				}
+				for (auto &i : history) {
+					for (auto &v : i) {
+						v /= norm;
+					}
+				}
+				if (t > burn_in) {
+					log_growth += std::log(norm);
+				}
+			}
+			return std::exp(log_growth / (steps - burn_in));
+		}
+
+		template <typename T>
+		std::vector<bool> get_reservoir_neurons(general_net<T> const &net_)
+		{
+			std::vector<bool> reservoir(net_.get_neuron_count());
+			for (size_t i = 0; i < reservoir.size(); ++i) {
+				reservoir[i] = !net_.get_neuron(i).is_output();
+			}
+			return reservoir;
+		}
+
+		// Normal equations of the least squares readout of one output neuron: there is one feature per trainable
+		// parameter of its incoming taps (the sum of the source values of tied taps) and 1 for a trainable bias,
+		// which comes last. Frozen taps and biases are subtracted from the target.
+		static size_t const no_readout_feature = std::numeric_limits<size_t>::max();
+
+		template <typename T>
+		struct readout_equations
+		{
+			std::vector<size_t> parameters; // Parameter of every feature
+			std::vector<size_t> edge_features; // Feature of every incoming tap or no_readout_feature
+			boost::numeric::ublas::matrix<T> features_product;
+			boost::numeric::ublas::vector<T> features_target;
+			T target_square = 0;
+			size_t sample_count = 0;
+		};
+
+		// Index into net_graph::get_nodes() of every output neuron, in the order of the outputs
+		template <typename T>
+		std::vector<size_t> get_readout_nodes(net_graph<T> const &graph_)
+		{
+			std::vector<size_t> readout_nodes;
+			for (size_t output : graph_.get_outputs()) {
+				auto const &nodes = graph_.get_nodes();
+				for (size_t i = 0; i < nodes.size(); ++i) {
+					if (nodes[i].neuron == output) {
+						readout_nodes.push_back(i);
+					}
+				}
+			}
+			return readout_nodes;
+		}
+
+		template <typename T>
+		std::vector<readout_equations<T>> make_readout_equations(net_graph<T> const &graph_, std::vector<size_t> const &readout_nodes_)
+		{
+			std::vector<readout_equations<T>> equations(readout_nodes_.size());
+			for (size_t k = 0; k < equations.size(); ++k) {
+				auto const &n = graph_.get_nodes()[readout_nodes_[k]];
+				auto &eq = equations[k];
+				for (size_t e = n.first_edge; e < n.last_edge; ++e) {
+					size_t parameter = graph_.get_edges()[e].parameter;
+					auto feature = std::find(eq.parameters.begin(), eq.parameters.end(), parameter);
+					if (!graph_.is_trainable(parameter)) {
+						eq.edge_features.push_back(no_readout_feature);
+					}
+					else if (feature != eq.parameters.end()) {
+						eq.edge_features.push_back(feature - eq.parameters.begin());
+					}
+					else {
+						eq.edge_features.push_back(eq.parameters.size());
+						eq.parameters.push_back(parameter);
+					}
+				}
+				if (graph_.is_trainable(n.bias)) {
+					eq.parameters.push_back(n.bias);
+				}
+				eq.features_product = boost::numeric::ublas::zero_matrix<T>(eq.parameters.size(), eq.parameters.size());
+				eq.features_target = boost::numeric::ublas::zero_vector<T>(eq.parameters.size());
+			}
+			return equations;
+		}
+
+		// Simulates one sequence from the internal memory of net_ and adds the samples after the washout to equations_
+		template <typename T, typename sequence_type>
+		void accumulate_readout(net_graph<T> const &graph_, std::vector<T> const &parameters_, general_net<T> const &net_, sequence_type const &sequence_,
+			std::vector<size_t> const &readout_nodes_, reservoir_options<T> const &opts_, std::vector<readout_equations<T>> &equations_)
+		{
+			using boost::numeric::ublas::range;
+			size_t delay = graph_.get_max_delay(), sample_count = sequence_.get_sample_count();
+			size_t chunk_size = std::max<size_t>(opts_.chunk_size, 1);
+			auto const &edges = graph_.get_edges();
+
+			boost::numeric::ublas::matrix<T> u, y, states(delay + chunk_size, graph_.get_neuron_count()), history(delay, graph_.get_neuron_count());
+			graph_.load_history(net_, history);
+			std::vector<T> features;
+			for (size_t first = 0; first < sample_count; first += chunk_size) {
+				size_t count = std::min(chunk_size, sample_count - first);
+				sequence_.read(first, count, u, y);
+				project(states, range(0, delay), range(0, states.size2())) = history;
+				for (size_t t = 0; t < count; ++t) {
+					size_t row = delay + t;
+					graph_.forward_step(parameters_, states, row, std::next(u.begin1(), t).begin());
+					if (first + t < opts_.washout) {
+						continue;
+					}
+					for (size_t k = 0; k < readout_nodes_.size(); ++k) {
+						auto const &n = graph_.get_nodes()[readout_nodes_[k]];
+						auto &eq = equations_[k];
+						T target = y(t, k);
+						features.assign(eq.parameters.size(), T(0));
+						for (size_t e = n.first_edge; e < n.last_edge; ++e) {
+							T value = states(row - edges[e].delay, edges[e].source);
+							size_t feature = eq.edge_features[e - n.first_edge];
+							if (feature != no_readout_feature) {
+								features[feature] += value;
+							}
+							else {
+								target -= graph_.get_weight(parameters_, edges[e].parameter)*value;
+							}
+						}
+						if (graph_.is_trainable(n.bias)) {
+							features.back() = T(1);
+						}
+						else {
+							target -= graph_.get_weight(parameters_, n.bias);
+						}
+
+						for (size_t i = 0; i < features.size(); ++i) {
+							for (size_t j = 0; j < features.size(); ++j) {
+								eq.features_product(i, j) += features[i] * features[j];
+							}
+							eq.features_target(i) += features[i] * target;
+						}
+						eq.target_square += target*target;
+						++eq.sample_count;
+					}
+				}
+				history = project(states, range(count, count + delay), range(0, states.size2()));
+			}
+		}
+	}
+
+	// Spectral radius of the delayed connections between the non-output neurons of net_ (the reservoir)
+	template <typename T>
+	T estimate_spectral_radius(general_net<T> net_)
+	{
+		detail::net_graph<T> graph(net_);
+		std::vector<T> parameters(graph.get_parameter_count());
+		net_.get_parameters(parameters.begin(), parameters.end());
+		return detail::estimate_spectral_radius(graph, parameters, detail::get_reservoir_neurons(net_));
+	}
+
+	// Scales the delayed connections between the non-output neurons of net_ to the given spectral radius and
+	// returns the radius before scaling. With several delays the radius is not proportional to the scaling
+	// factor, so the factor is refined iteratively. Frozen connections are not scaled.
+	template <typename T>
+	T scale_spectral_radius(general_net<T> &net_, T radius_)
+	{
+		detail::net_graph<T> graph(net_);
+		auto reservoir = detail::get_reservoir_neurons(net_);
+		std::vector<T> parameters(graph.get_parameter_count());
+		net_.get_parameters(parameters.begin(), parameters.end());
+
+		// Tied taps share a parameter, which must be scaled once
+		std::vector<bool> scaled(parameters.size(), false);
+		for (auto const &n : graph.get_nodes()) {
+			for (size_t e = n.first_edge; e < n.last_edge; ++e) {
+				auto const &current = graph.get_edges()[e];
+				if (current.delay && reservoir[n.neuron] && reservoir[current.source] && graph.is_trainable(current.parameter)) {
+					scaled[current.parameter] = true;
+				}
+			}
+		}
+
+		T initial_radius = detail::estimate_spectral_radius(graph, parameters, reservoir), radius = initial_radius;
+		for (size_t i = 0; i < 20 && radius > T(0) && std::abs(radius - radius_) > T(1.0e-3)*radius_; ++i) {
+			T factor = radius_ / radius;
+			for (size_t j = 0; j < parameters.size(); ++j) {
+				if (scaled[j]) {
+					parameters[j] *= factor;
+				}
+			}
+			radius = detail::estimate_spectral_radius(graph, parameters, reservoir);
+		}
+		net_.set_parameters(parameters.begin(), parameters.end());
+		return initial_radius;
+	}
+
+	// Echo state training: optionally initializes all weights randomly and scales the reservoir to the
+	// configured spectral radius, then simulates data_ once and sets the trainable weights of all connections
+	// into the output neurons and their biases by ridge regression. Output neurons must not feed other neurons.
+	// Returns the mean squared error of the fit (summed over the outputs) after the washout.
+	template <typename T, typename dataset_type>
+	typename std::enable_if<detail::is_dataset<dataset_type>::value, T>::type
+	train_reservoir(general_net<T> &net_, dataset_type const &data_, reservoir_options<T> const &opts_ = reservoir_options<T>())
+	{
+		using namespace boost::numeric::ublas;
+
+		size_t sequence_count = detail::get_sequence_count(data_);
+		if (!sequence_count || !data_.get_sample_count()) {
+			throw neural_exception("No samples given for reservoir training!");
+		}
+		detail::net_graph<T> graph(net_);
+		auto const &outputs = graph.get_outputs();
+		for (auto const &i : graph.get_edges()) {
+			if (std::find(outputs.begin(), outputs.end(), i.source) != outputs.end()) {
+				throw neural_exception("Output neurons must not be connected to other neurons for reservoir training!");
+			}
+		}
+		for (size_t i : outputs) {
+			if (net_.get_neuron_activation(i) != activation_function::linear) {
+				throw neural_exception("Output neurons must be linear for reservoir training!");
+			}
+		}
+
+		auto readout_nodes = detail::get_readout_nodes(graph);
+		auto initial_equations = detail::make_readout_equations(graph, readout_nodes);
+		std::vector<bool> readout_parameters(graph.get_parameter_count(), false);
+		for (auto const &i : initial_equations) {
+			for (size_t j : i.parameters) {
+				if (readout_parameters[j]) {
+					throw neural_exception("Output neurons must not share tied weights for reservoir training!");
+				}
+				readout_parameters[j] = true;
+			}
+		}
+		// Solving the readout must not change the reservoir
+		for (auto const &n : graph.get_nodes()) {
+			for (size_t e = n.first_edge; e < n.last_edge; ++e) {
+				size_t parameter = graph.get_edges()[e].parameter;
+				if (std::find(outputs.begin(), outputs.end(), n.neuron) == outputs.end() && graph.is_trainable(parameter) && readout_parameters[parameter]) {
+					throw neural_exception("Connections into output neurons must not be tied to reservoir connections for reservoir training!");
+				}
+			}
+		}
+
+		if (opts_.init_weights_random) {
+			net_.init_random(opts_.min_random, opts_.max_random);
+		}
+		if (opts_.spectral_radius > T(0)) {
+			scale_spectral_radius(net_, opts_.spectral_radius);
+		}
+		std::vector<T> parameters(graph.get_parameter_count());
+		net_.get_parameters(parameters.begin(), parameters.end());
+
+		std::vector<std::vector<detail::readout_equations<T>>> sequence_equations(sequence_count, initial_equations);
+		detail::parallel_for(0, sequence_count, [&](size_t i) {
+			general_net<T> net(net_);
+			detail::reset_sequence_state(data_, i, net);
+			detail::accumulate_readout(graph, parameters, net, detail::get_sequence(data_, i), readout_nodes, opts_, sequence_equations[i]);
+		}, opts_.use_parallelization);
+
+		T squared_error = 0;
+		size_t sample_count = 0;
+		for (size_t k = 0; k < readout_nodes.size(); ++k) {
+			auto equations = sequence_equations[0][k];
+			for (size_t i = 1; i < sequence_count; ++i) {
+				equations.features_product += sequence_equations[i][k].features_product;
+				equations.features_target += sequence_equations[i][k].features_target;
+				equations.target_square += sequence_equations[i][k].target_square;
+				equations.sample_count += sequence_equations[i][k].sample_count;
+			}
+			if (!equations.sample_count) {
+				throw neural_exception("No samples left after the washout!");
+			}
+
+			auto const &n = graph.get_nodes()[readout_nodes[k]];
+			size_t feature_count = equations.parameters.size();
+			matrix<T> system = equations.features_product;
+			for (size_t i = 0; i < feature_count; ++i) {
+				if (equations.parameters[i] != n.bias) {
+					system(i, i) += opts_.ridge*equations.sample_count;
+				}
+			}
+			vector<T> readout = equations.features_target;
+			if (feature_count) {
+				detail::matrix_utils::solve_linear_equation_system_inplace(system, readout);
+			}
+			for (size_t i = 0; i < feature_count; ++i) {
+				parameters[equations.parameters[i]] = readout(i);
+			}
+
+			// Sum of (y - w^T*x)^2 = y^T*y - 2*w^T*(X^T*y) + w^T*(X^T*X)*w
+			vector<T> product = prod(equations.features_product, readout);
+			squared_error += equations.target_square - 2 * inner_prod(readout, equations.features_target) + inner_prod(readout, product);
+			sample_count = equations.sample_count;
+		}
+		net_.set_parameters(parameters.begin(), parameters.end());
+		net_.clear_internal_memory();
+		return std::max(squared_error, T(0)) / std::max<size_t>(sample_count, 1);
+	}
+
+	template <typename T>
+	T train_reservoir(general_net<T> &net_, boost::numeric::ublas::matrix<T> const &inputs_, boost::numeric::ublas::matrix<T> const &desired_outputs_,
+		reservoir_options<T> const &opts_ = reservoir_options<T>())
+	{
+		return train_reservoir(net_, matrix_dataset<T>(inputs_, desired_outputs_), opts_);
+	}
+}
+
+#endif
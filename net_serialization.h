@@ -0,0 +1,315 @@
+#ifndef NET_SERIALIZATION_H
+#define NET_SERIALIZATION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "neural_nets\general_net.h"
+#include "neural_nets\neural_exception.h"
+#include "neural_nets\detail\memory_mapped_file.h"
+
+// Versioned binary format for general_net. All sections are aligned to 8 bytes, so a memory mapped file
+// is read in place without any parsing of numbers:
+//
+//   file_header
+//   neuron_record[neuron_count]          input/output declaration, frozen bias flag and activation of every neuron
+//   T[neuron_count]                      biases
+//   connection_record[connection_count]  target, source and taps of every connection
+//   uint64_t[tap_count]                  delay of every tap
+//   T[tap_count]                         weight of every tap
+//   uint64_t[tap_count]                  flags of every tap (frozen weight)
+//   uint64_t[tap_count]                  tap whose weight every tap shares or no_tap
+//   T[memory_size]                       optional snapshot of the internal memory (delay states)
+
+namespace neural_nets
+{
+	namespace detail
+	{
+		namespace serialization
+		{
+			static std::uint32_t const format_version = 1;
+			static std::uint32_t const endianness_marker = 0x01020304;
+			static std::uint64_t const no_input = std::numeric_limits<std::uint64_t>::max();
+			static std::uint64_t const no_tap = std::numeric_limits<std::uint64_t>::max();
+
+			enum file_flags : std::uint64_t
+			{
+				has_internal_memory = 1
+			};
+
+			enum neuron_flags : std::uint64_t
+			{
+				input_neuron = 1,
+				output_neuron = 2,
+				frozen_bias = 4,
+				activation_mask = 0xff00 // activation_function << activation_shift
+			};
+
+			static std::uint64_t const activation_shift = 8;
+
+			enum tap_flags : std::uint64_t
+			{
+				frozen_weight = 1
+			};
+
+			struct file_header
+			{
+				char magic[8];
+				std::uint32_t version;
+				std::uint32_t endianness;
+				std::uint32_t scalar_size;
+				std::uint32_t scalar_digits;
+				std::uint64_t flags;
+				std::uint64_t neuron_count;
+				std::uint64_t connection_count;
+				std::uint64_t tap_count;
+				std::uint64_t memory_size;
+			};
+
+			struct neuron_record
+			{
+				std::uint64_t flags;
+				std::uint64_t input_index;
+			};
+
+			struct connection_record
+			{
+				std::uint64_t target;
+				std::uint64_t source;
+				std::uint64_t first_tap;
+				std::uint64_t tap_count;
+			};
+
+			inline char const *get_magic() { return "GDNNBIN"; }
+
+			inline size_t aligned_size(size_t size_) { return (size_ + 7) / 8 * 8; }
+
+			// Whether count_ elements of element_size_ bytes fit into file_size_ bytes
+			inline bool fits_in(size_t file_size_, std::uint64_t count_, size_t element_size_) { return count_ <= file_size_ / element_size_; }
+
+			template <typename U>
+			void write_section(std::ostream &stream_, std::vector<U> const &values_)
+			{
+				static char const padding[8] = {};
+				size_t size = values_.size()*sizeof(U);
+				if (size) {
+					stream_.write(reinterpret_cast<char const *>(values_.data()), size);
+				}
+				stream_.write(padding, aligned_size(size) - size);
+			}
+
+			template <typename U>
+			U const *read_section(char const *&position_, size_t count_)
+			{
+				U const *section = reinterpret_cast<U const *>(position_);
+				position_ += aligned_size(count_*sizeof(U));
+				return section;
+			}
+		}
+	}
+
+	template <typename T>
+	void save_binary(general_net<T> const &net_, std::string const &file_name_, bool include_internal_memory_ = false)
+	{
+		using namespace detail::serialization;
+
+		size_t neuron_count = net_.get_neuron_count();
+		std::vector<neuron_record> neuron_records(neuron_count);
+		std::vector<T> biases(neuron_count);
+		for (size_t i = 0; i < neuron_count; ++i) {
+			auto const &n = net_.get_neuron(i);
+			neuron_records[i].flags = (n.is_input() ? static_cast<std::uint64_t>(input_neuron) : 0) | (n.is_output() ? static_cast<std::uint64_t>(output_neuron) : 0) |
+				(net_.is_neuron_bias_trainable(i) ? 0 : static_cast<std::uint64_t>(frozen_bias)) | static_cast<std::uint64_t>(n.get_declared_activation()) << activation_shift;
+			neuron_records[i].input_index = n.is_input() ? net_.get_input_index(i) : no_input;
+			biases[i] = net_.get_neuron_bias_weight(i);
+		}
+
+		std::vector<connection_record> connection_records;
+		std::vector<std::uint64_t> delays, flags, shared_taps;
+		std::vector<T> weights;
+		std::map<size_t, std::uint64_t> weight_taps;
+		for (size_t i = 0; i < neuron_count; ++i) {
+			for (size_t j = 0; j < neuron_count; ++j) {
+				auto const &tdl = net_.get_connections()(j, i);
+				if (tdl.is_connected()) {
+					connection_record record = { j, i, delays.size(), tdl.get_delay_count() };
+					connection_records.push_back(record);
+					for (size_t k = 0; k < tdl.get_delay_count(); ++k) {
+						if (!net_.is_connection_tied(j, i, k)) {
+							weight_taps[net_.get_weight_index(j, i, k)] = delays.size();
+						}
+						delays.push_back(tdl.get_delay_line()[k].delay_index);
+						weights.push_back(net_.get_connection_weight(j, i, k));
+						flags.push_back(net_.is_connection_trainable(j, i, k) ? 0 : static_cast<std::uint64_t>(frozen_weight));
+					}
+				}
+			}
+		}
+		for (auto const &record : connection_records) {
+			for (size_t k = 0; k < record.tap_count; ++k) {
+				bool tied = net_.is_connection_tied(record.target, record.source, k);
+				shared_taps.push_back(tied ? weight_taps[net_.get_weight_index(record.target, record.source, k)] : no_tap);
+			}
+		}
+
+		std::vector<T> memory;
+		if (include_internal_memory_) {
+			memory.resize(net_.get_internal_memory_size());
+			net_.get_internal_memory(memory.begin(), memory.end());
+		}
+
+		file_header header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, get_magic(), sizeof(header.magic));
+		header.version = format_version;
+		header.endianness = endianness_marker;
+		header.scalar_size = sizeof(T);
+		header.scalar_digits = std::numeric_limits<T>::digits;
+		header.flags = include_internal_memory_ ? static_cast<std::uint64_t>(has_internal_memory) : 0;
+		header.neuron_count = neuron_count;
+		header.connection_count = connection_records.size();
+		header.tap_count = delays.size();
+		header.memory_size = memory.size();
+
+		std::ofstream file(file_name_, std::ios::binary);
+		if (!file) {
+			throw neural_exception("Could not open file " + file_name_ + " for writing");
+		}
+		write_section(file, std::vector<file_header>{header});
+		write_section(file, neuron_records);
+		write_section(file, biases);
+		write_section(file, connection_records);
+		write_section(file, delays);
+		write_section(file, weights);
+		write_section(file, flags);
+		write_section(file, shared_taps);
+		write_section(file, memory);
+		if (!file) {
+			throw neural_exception("Could not write file " + file_name_);
+		}
+	}
+
+	template <typename T>
+	general_net<T> load_binary(std::string const &file_name_)
+	{
+		using namespace detail::serialization;
+
+		detail::memory_mapped_file file(file_name_);
+		if (file.get_size() < sizeof(file_header)) {
+			throw neural_exception(file_name_ + " is not a binary network file");
+		}
+		char const *position = file.get_data();
+		file_header const &header = *read_section<file_header>(position, 1);
+
+		if (std::memcmp(header.magic, get_magic(), sizeof(header.magic)) != 0) {
+			throw neural_exception(file_name_ + " is not a binary network file");
+		}
+		if (header.version != format_version) {
+			throw neural_exception(file_name_ + " has an unsupported format version");
+		}
+		if (header.endianness != endianness_marker) {
+			throw neural_exception(file_name_ + " was written on a machine with different byte order");
+		}
+		if (header.scalar_size != sizeof(T) || header.scalar_digits != std::numeric_limits<T>::digits) {
+			throw neural_exception(file_name_ + " was written for a different floating point type");
+		}
+		// Every section lies within the file, which also keeps the size computation below from overflowing
+		if (!fits_in(file.get_size(), header.neuron_count, sizeof(neuron_record)) || !fits_in(file.get_size(), header.connection_count, sizeof(connection_record)) ||
+			!fits_in(file.get_size(), header.tap_count, sizeof(std::uint64_t)) || !fits_in(file.get_size(), header.memory_size, sizeof(T))) {
+			throw neural_exception(file_name_ + " is truncated or corrupt");
+		}
+		size_t expected_size = aligned_size(sizeof(file_header)) + aligned_size(header.neuron_count*sizeof(neuron_record))
+			+ aligned_size(header.neuron_count*sizeof(T)) + aligned_size(header.connection_count*sizeof(connection_record))
+			+ 3*aligned_size(header.tap_count*sizeof(std::uint64_t)) + aligned_size(header.tap_count*sizeof(T)) + aligned_size(header.memory_size*sizeof(T));
+		if (file.get_size() != expected_size) {
+			throw neural_exception(file_name_ + " is truncated or corrupt");
+		}
+
+		size_t neuron_count = static_cast<size_t>(header.neuron_count);
+		auto neuron_records = read_section<neuron_record>(position, neuron_count);
+		auto biases = read_section<T>(position, neuron_count);
+		auto connection_records = read_section<connection_record>(position, static_cast<size_t>(header.connection_count));
+		auto delays = read_section<std::uint64_t>(position, static_cast<size_t>(header.tap_count));
+		auto weights = read_section<T>(position, static_cast<size_t>(header.tap_count));
+		auto flags = read_section<std::uint64_t>(position, static_cast<size_t>(header.tap_count));
+		auto shared_taps = read_section<std::uint64_t>(position, static_cast<size_t>(header.tap_count));
+		auto memory = read_section<T>(position, static_cast<size_t>(header.memory_size));
+
+		general_net<T> net(neuron_count);
+		std::vector<detail::tapped_delay<T>> taps;
+		std::vector<size_t> tap_connections(static_cast<size_t>(header.tap_count), static_cast<size_t>(header.connection_count));
+		for (size_t c = 0; c < header.connection_count; ++c) {
+			auto const &record = connection_records[c];
+			if (record.target >= neuron_count || record.source >= neuron_count || !record.tap_count ||
+				record.tap_count > header.tap_count || record.first_tap > header.tap_count - record.tap_count) {
+				throw neural_exception(file_name_ + " contains an invalid connection");
+			}
+			taps.clear();
+			for (size_t k = 0; k < record.tap_count; ++k) {
+				taps.emplace_back(static_cast<size_t>(delays[record.first_tap + k]), weights[record.first_tap + k]);
+			}
+			net.connect_neurons(static_cast<size_t>(record.source), static_cast<size_t>(record.target), tapped_delay_line<T>(taps));
+			for (size_t k = 0; k < record.tap_count; ++k) {
+				tap_connections[static_cast<size_t>(record.first_tap) + k] = c;
+			}
+			for (size_t k = 0; k < record.tap_count; ++k) {
+				if (flags[record.first_tap + k] & frozen_weight) {
+					net.set_connection_trainable(static_cast<size_t>(record.target), static_cast<size_t>(record.source), k, false);
+				}
+			}
+		}
+		for (size_t i = 0; i < header.tap_count; ++i) {
+			if (shared_taps[i] == no_tap) {
+				continue;
+			}
+			if (shared_taps[i] >= header.tap_count || tap_connections[i] == header.connection_count || tap_connections[static_cast<size_t>(shared_taps[i])] == header.connection_count) {
+				throw neural_exception(file_name_ + " contains an invalid tied weight");
+			}
+			auto const &record = connection_records[tap_connections[i]];
+			auto const &shared = connection_records[tap_connections[static_cast<size_t>(shared_taps[i])]];
+			net.tie_connection_weight(static_cast<size_t>(record.target), static_cast<size_t>(record.source), i - static_cast<size_t>(record.first_tap),
+				static_cast<size_t>(shared.target), static_cast<size_t>(shared.source), static_cast<size_t>(shared_taps[i] - shared.first_tap));
+		}
+
+		size_t input_count = static_cast<size_t>(std::count_if(neuron_records, neuron_records + neuron_count, [](neuron_record const &r_) { return (r_.flags & input_neuron) != 0; }));
+		std::vector<size_t> inputs(input_count, neuron_count);
+		for (size_t i = 0; i < neuron_count; ++i) {
+			net.set_neuron_bias_weight(i, biases[i]);
+			net.set_neuron_bias_trainable(i, !(neuron_records[i].flags & frozen_bias));
+			std::uint64_t activation = (neuron_records[i].flags & activation_mask) >> activation_shift;
+			if (activation > static_cast<std::uint64_t>(activation_function::fast_tanh)) {
+				throw neural_exception(file_name_ + " contains an invalid activation function");
+			}
+			net.set_neuron_activation(i, static_cast<activation_function>(activation));
+			if (neuron_records[i].flags & input_neuron) {
+				// Input indices are 0 to input_count - 1, each used once
+				if (neuron_records[i].input_index >= input_count || inputs[static_cast<size_t>(neuron_records[i].input_index)] < neuron_count) {
+					throw neural_exception(file_name_ + " contains an invalid input declaration");
+				}
+				inputs[static_cast<size_t>(neuron_records[i].input_index)] = i;
+			}
+			if (neuron_records[i].flags & output_neuron) {
+				net.declare_as_output(i);
+			}
+		}
+		for (auto const &i : inputs) {
+			net.declare_as_input(i);
+		}
+
+		if (header.flags & has_internal_memory) {
+			if (header.memory_size != net.get_internal_memory_size()) {
+				throw neural_exception(file_name_ + " contains an internal memory snapshot not matching its topology");
+			}
+			net.set_internal_memory(memory, memory + header.memory_size);
+		}
+		return net;
+	}
+}
+
+#endif
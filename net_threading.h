@@ -0,0 +1,93 @@
+#ifndef NET_THREADING_H
+#define NET_THREADING_H
+
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost\numeric\ublas\matrix.hpp>
+
+#include "neural_nets\detail\thread_pool.h"
+
+// All parallel work of the library (Jacobian columns, sequences, trial screening, batched simulation) runs on
+// one shared pool of worker threads, so nested parallel loops never start more threads than configured.
+
+namespace neural_nets
+{
+	struct thread_pool_options
+	{
+		size_t thread_count = 0; // Including the calling thread, 0 uses all hardware threads
+		bool pin_threads = false; // Binds every worker thread to one core
+	};
+
+	namespace detail
+	{
+		struct thread_pool_holder
+		{
+			std::mutex mutex;
+			thread_pool_options options;
+			std::unique_ptr<thread_pool> pool;
+		};
+
+		inline thread_pool_holder &get_thread_pool_holder()
+		{
+			static thread_pool_holder holder;
+			return holder;
+		}
+
+		inline thread_pool &get_thread_pool()
+		{
+			auto &holder = get_thread_pool_holder();
+			std::lock_guard<std::mutex> lock(holder.mutex);
+			if (!holder.pool) {
+				size_t thread_count = holder.options.thread_count ? holder.options.thread_count : std::thread::hardware_concurrency();
+				holder.pool.reset(new thread_pool(thread_count, holder.options.pin_threads));
+			}
+			return *holder.pool;
+		}
+
+		// Runs func_(i) for all i in [first_, last_) on the shared pool, or serially if parallel_ is false
+		template <typename func>
+		void parallel_for(size_t first_, size_t last_, func const &func_, bool parallel_ = true)
+		{
+			if (parallel_) {
+				get_thread_pool().parallel_for(first_, last_, func_);
+			}
+			else {
+				for (size_t i = first_; i < last_; ++i) {
+					func_(i);
+				}
+			}
+		}
+	}
+
+	// Replaces the shared pool, must not be called while the library is running work on it
+	inline void set_thread_pool_options(thread_pool_options const &options_)
+	{
+		auto &holder = detail::get_thread_pool_holder();
+		std::lock_guard<std::mutex> lock(holder.mutex);
+		holder.options = options_;
+		holder.pool.reset();
+	}
+
+	inline size_t get_thread_count()
+	{
+		return detail::get_thread_pool().get_thread_count();
+	}
+
+	// Simulates sys_ on several independent input sequences in parallel, each starting from cleared internal memory
+	template <typename dynamic_system, typename T>
+	std::vector<boost::numeric::ublas::matrix<T>> simulate_batch(dynamic_system const &sys_, std::vector<boost::numeric::ublas::matrix<T>> const &inputs_)
+	{
+		std::vector<boost::numeric::ublas::matrix<T>> outputs(inputs_.size());
+		detail::parallel_for(0, inputs_.size(), [&](size_t i) {
+			dynamic_system sys(sys_);
+			sys.clear_internal_memory();
+			outputs[i] = sys(inputs_[i]);
+		});
+		return outputs;
+	}
+}
+
+#endif
@@ -2,169 +2,273 @@
 #define NET_TRAINING_H
 
 #include <algorithm>
+#include <chrono>
+#include <numeric>
 
 #include "neural_nets\general_net.h"
 #include "neural_nets\detail\net_initialization.h"
 #include "neural_nets\detail\jacobian_calculation.h"
+#include "neural_nets\detail\distributed_training.h"
+#include "neural_nets\detail\lm_damping.h"
+#include "neural_nets\detail\net_gradient.h"
 #include "neural_nets\training_options.h"
+#include "neural_nets\net_profiling.h"
+#include "neural_nets\net_datasets.h"
+#include "neural_nets\net_threading.h"
 
 
 namespace neural_nets
 {
-	template <typename T, typename dynamic_system>
-	T train_lm(dynamic_system sys_, boost::numeric::ublas::matrix<T> const &inputs_, boost::numeric::ublas::matrix<T> const &outputs_, std::vector<T> &best_weights_)
+	namespace detail
 	{
-		return train_lm(sys_, inputs_, outputs_, best_weights_, lm_options<T>());
-	}
-
-	template <typename T, typename dynamic_system>
-	T train_lm(dynamic_system sys_, boost::numeric::ublas::matrix<T> const &inputs_, boost::numeric::ublas::matrix<T> const &desired_outputs_, std::vector<T> &best_weights_, lm_options<T> const &opts_)
-	{
-		using namespace boost::numeric::ublas;
-		T lambda = 1.0;
-
-		std::vector<T> paras(sys_.get_parameter_count());
-		sys_.get_parameters(paras.begin(), paras.end());
-		std::vector<T> best_paras = paras;
-
-		size_t iterations = 0, n = inputs_.size1()*sys_.get_output_count();
-		bool new_weights = true;
-		matrix<T> jacobian, left_side, hessian_approx;
-		vector<T> solution_vector(n), output(desired_outputs_.size2());
-		T min_error = std::numeric_limits<T>::max(), current_error;
-		std::deque<T> error_history(opts_.rel_tol_horizont, min_error/opts_.rel_tol_horizont);
-
-		while (true) {
-			sys_.set_parameters(paras.begin(), paras.end());
+		// With a horizon_state_, normal equations are continued from it if it was computed for the initial
+		// weights on a prefix of data_. On return it holds the state of the returned weights. stopped_ (if given)
+		// is set when the iteration callback asked to stop.
+		template <typename dynamic_system, typename dataset_type>
+		typename dataset_type::value_type train_lm(dynamic_system sys_, dataset_type const &data_, std::vector<typename dataset_type::value_type> &best_weights_,
+			lm_options<typename dataset_type::value_type> const &opts_, normal_equations_state<dynamic_system, typename dataset_type::value_type> *horizon_state_,
+			bool *stopped_ = nullptr)
+		{
+			using namespace boost::numeric::ublas;
+			using T = typename dataset_type::value_type;
+			T lambda = 1.0;
+
+			std::vector<T> paras(sys_.get_parameter_count());
+			sys_.get_parameters(paras.begin(), paras.end());
+			std::vector<T> best_paras = paras;
+
+			size_t iterations = 0, sample_count = data_.get_sample_count();
+			bool new_weights = true;
+			matrix<T> left_side, hessian_approx;
+			vector<T> solution_vector, scaling, scaled_gradient;
+			matrix_utils::symmetric_tridiagonal_form<T> damping_form;
+			T min_error = std::numeric_limits<T>::max(), current_error;
+			std::deque<T> error_history(opts_.rel_tol_horizont, min_error/opts_.rel_tol_horizont);
+			auto start_time = std::chrono::steady_clock::now(), callback_time = start_time;
+
+			while (true) {
+				sys_.set_parameters(paras.begin(), paras.end());
+
+				if (new_weights) {
+					if (horizon_state_) {
+						if (!can_extend_normal_equations(*horizon_state_, sys_, data_)) {
+							start_normal_equations(sys_, *horizon_state_, opts_);
+						}
+						extend_normal_equations(*horizon_state_, data_, opts_);
+						hessian_approx = horizon_state_->hessian_approx;
+						solution_vector = horizon_state_->gradient;
+						current_error = horizon_state_->squared_error;
+					}
+					else {
+						calc_normal_equations_numerically(sys_, data_, opts_, hessian_approx, solution_vector, current_error);
+					}
+					sys_.clear_internal_memory();
+					left_side = hessian_approx;
 
-			if (new_weights) {
+					current_error /= sample_count;
+					if (std::isnan(current_error) || std::isinf(current_error)) {
+						current_error = std::numeric_limits<T>::max();
+					}
+					if (!iterations) {
+						min_error = current_error;
+					}
+				}
 
-				jacobian = detail::calc_jacobian_numerically(sys_, inputs_, opts_);
-				hessian_approx = prod(trans(jacobian), jacobian);
-				left_side = hessian_approx;
+				for (size_t i = 0; i < left_side.size1(); ++i) {
+					left_side(i, i) = hessian_approx(i, i) + lambda*hessian_approx(i, i);
+				}
+				error_history.pop_front();
+				error_history.push_back(current_error);
+				T error_change = math_utils::maximum_change(error_history.begin(), error_history.end());
 
-				current_error = 0;
-				solution_vector = boost::numeric::ublas::vector<T>(n);
-				size_t cnt = 0;
-				for (size_t i = 0; i < inputs_.size1(); ++i) {
+				if (opts_.display_iterations) {
+					std::cout << iterations << '\t' << current_error << "\t\t" << lambda << "\t\t" << error_change << '\n';
+				}
 
-					sys_(std::next(inputs_.begin1(), i).begin(), std::next(inputs_.begin1(), i).end(), 
-						output.begin(), output.end());
-					for (size_t j = 0; j < output.size(); ++j) {
-						solution_vector(cnt) = desired_outputs_(i, j) - output(j);
-						current_error += solution_vector(cnt)*solution_vector(cnt);
-						++cnt;
+				if (opts_.iteration_callback) {
+					auto now = std::chrono::steady_clock::now();
+					lm_iteration_info<T> info;
+					info.iteration = iterations;
+					info.error = current_error;
+					info.lambda = lambda;
+					info.error_change = error_change;
+					info.iteration_seconds = std::chrono::duration<double>(now - callback_time).count();
+					info.elapsed_seconds = std::chrono::duration<double>(now - start_time).count();
+					callback_time = now;
+					if (opts_.iteration_callback(info) == training_action::stop) {
+						if (stopped_) {
+							*stopped_ = true;
+						}
+						break;
 					}
 				}
-				current_error /= inputs_.size1();
-				if (std::isnan(current_error) || std::isinf(current_error)) {
-					current_error = std::numeric_limits<T>::max();
+
+				if (current_error < opts_.abs_tol || iterations >= opts_.max_iterations || error_change < opts_.rel_tol) {
+					break;
 				}
-				if (!iterations) {
-					min_error = current_error;
+				if (std::chrono::steady_clock::now() >= opts_.deadline) {
+					break;
 				}
-				sys_.clear_internal_memory();
-				solution_vector = prod(trans(jacobian), solution_vector);
-			}
 
-			for (size_t i = 0; i < left_side.size1(); ++i) {
-				left_side(i, i) = hessian_approx(i, i) + lambda*hessian_approx(i, i);
-			}
-			error_history.pop_front();
-			error_history.push_back(current_error);
-			T error_change = detail::math_utils::maximum_change(error_history.begin(), error_history.end());
+				std::vector<T> new_paras;
+				T new_error, step_lambda = lambda, last_lambda = lambda;
+				if (opts_.speculative_lambdas > 1) {
+					if (new_weights) {
+						NEURAL_NETS_PROFILE_SCOPE(linear_solve);
+						damping_form = calc_damping_form(hessian_approx, solution_vector, scaling, scaled_gradient);
+					}
+					std::vector<T> lambdas(opts_.speculative_lambdas, lambda);
+					for (size_t i = 1; i < lambdas.size(); ++i) {
+						lambdas[i] = lambdas[i - 1] <= opts_.max_lambda ? lambdas[i - 1] * opts_.lambda_inc_factor : lambdas[i - 1];
+					}
 
-			if (opts_.display_iterations) {
-				std::cout << iterations << '\t' << current_error << "\t\t" << lambda << "\t\t" << error_change << '\n';
-			}
+					std::vector<std::vector<T>> candidates(lambdas.size());
+					parallel_for(0, lambdas.size(), [&](size_t i) {
+						boost::numeric::ublas::vector<T> delta;
+						{
+							NEURAL_NETS_PROFILE_SCOPE(linear_solve);
+							delta = matrix_utils::solve_shifted_system(damping_form, lambdas[i], scaled_gradient);
+						}
+						candidates[i] = paras;
+						for (size_t j = 0; j < paras.size(); ++j) {
+							candidates[i][j] += scaling(j)*delta(j);
+						}
+					}, opts_.use_parallelization);
+					std::vector<T> errors = calc_squared_errors(sys_, candidates, data_, opts_);
+					for (auto &i : errors) {
+						i /= sample_count;
+						if (std::isnan(i) || std::isinf(i)) {
+							i = std::numeric_limits<T>::max();
+						}
+					}
 
-			if (current_error < opts_.abs_tol || iterations >= opts_.max_iterations || error_change < opts_.rel_tol) {
-				break;
-			}
+					size_t best = std::min_element(errors.begin(), errors.end()) - errors.begin();
+					new_paras = candidates[best];
+					new_error = errors[best];
+					step_lambda = lambdas[best];
+					last_lambda = lambdas.back();
+				}
+				else {
+					boost::numeric::ublas::vector<T> delta;
+					{
+						NEURAL_NETS_PROFILE_SCOPE(linear_solve);
+						delta = linear_algebra::solve_symmetric(left_side, solution_vector, opts_.use_parallelization);
+					}
 
-			auto delta = detail::matrix_utils::solve_linear_equation_system(left_side, solution_vector);
+					new_paras.reserve(paras.size());
+					for (size_t i = 0; i < paras.size(); ++i) {
+						new_paras.push_back(paras[i] + delta(i));
+					}
 
-			std::vector<T> new_paras;
-			new_paras.reserve(paras.size());
-			for (size_t i = 0; i < paras.size(); ++i) {
-				new_paras.push_back(paras[i] + delta(i));
-			}
+					sys_.set_parameters(new_paras.begin(), new_paras.end());
+					new_error = calc_squared_error(sys_, data_, opts_.chunk_size, opts_.use_parallelization) / sample_count;
+					if (std::isnan(new_error) || std::isinf(new_error)) {
+						new_error = std::numeric_limits<T>::max();
+					}
+				}
 
-			T new_error = 0;
-			sys_.set_parameters(new_paras.begin(), new_paras.end());
-			for (size_t i = 0; i < inputs_.size1(); ++i) {
-				sys_(std::next(inputs_.begin1(), i).begin(), std::next(inputs_.begin1(), i).end(), 
-					output.begin(), output.end());
-				T tmp = 0;
-				for (size_t j = 0; j < output.size(); ++j) {
-					tmp += (desired_outputs_(i, j) - output(j))*(desired_outputs_(i, j) - output(j));
+				if (!std::isnan(new_error) && new_error < current_error) {
+					lambda = step_lambda / opts_.lambda_dec_factor;
+					paras = new_paras;
+					if (new_error < min_error) {
+						best_paras = paras;
+						min_error = new_error;
+					}
+					new_weights = true;
 				}
-				new_error += tmp;
-			}
-			new_error /= inputs_.size1();
-			if (std::isnan(new_error) || std::isinf(new_error)) {
-				new_error = std::numeric_limits<T>::max();
+				else {
+					NEURAL_NETS_PROFILE_COUNT(rejected_step);
+					lambda = last_lambda;
+					if (lambda <= opts_.max_lambda)
+						lambda *= opts_.lambda_inc_factor;
+					new_weights = false;
+				}
+
+				++iterations;
 			}
 			sys_.clear_internal_memory();
+			sys_.set_parameters(best_paras.begin(), best_paras.end());
+			best_weights_ = best_paras;
+			return min_error;
+		}
+	}
 
-			if (!std::isnan(new_error) && new_error < current_error) {
-				lambda /= opts_.lambda_dec_factor;
-				paras = new_paras;
-				if (new_error < min_error) {
-					best_paras = paras;
-					min_error = new_error;
-				}
-				new_weights = true;
-			}
-			else {
-				if (lambda <= opts_.max_lambda)
-					lambda *= opts_.lambda_inc_factor;
-				new_weights = false;
-			}
+	template <typename dynamic_system, typename dataset_type>
+	typename std::enable_if<detail::is_dataset<dataset_type>::value, typename dataset_type::value_type>::type
+	train_lm(dynamic_system sys_, dataset_type const &data_, std::vector<typename dataset_type::value_type> &best_weights_, 
+		lm_options<typename dataset_type::value_type> const &opts_)
+	{
+		return detail::train_lm(sys_, data_, best_weights_, opts_, static_cast<detail::normal_equations_state<dynamic_system, typename dataset_type::value_type> *>(nullptr));
+	}
 
-			++iterations;
-		}
-		sys_.clear_internal_memory();
-		sys_.set_parameters(best_paras.begin(), best_paras.end());
-		best_weights_ = best_paras;
-		return min_error;
+	template <typename T, typename dynamic_system>
+	T train_lm(dynamic_system sys_, boost::numeric::ublas::matrix<T> const &inputs_, boost::numeric::ublas::matrix<T> const &outputs_, std::vector<T> &best_weights_)
+	{
+		return train_lm(sys_, inputs_, outputs_, best_weights_, lm_options<T>());
 	}
 
+	template <typename T, typename dynamic_system>
+	T train_lm(dynamic_system sys_, boost::numeric::ublas::matrix<T> const &inputs_, boost::numeric::ublas::matrix<T> const &desired_outputs_, std::vector<T> &best_weights_, lm_options<T> const &opts_)
+	{
+		return train_lm(sys_, matrix_dataset<T>(inputs_, desired_outputs_), best_weights_, opts_);
+	}
 
-	template <typename dynamic_system, typename T>
-	T train_lm_stepwise(dynamic_system &sys_, boost::numeric::ublas::matrix<T> const &u_, 
-		boost::numeric::ublas::matrix<T> const &y_, 
-		boost::numeric::ublas::matrix<T> const &u_valid_, 
-		boost::numeric::ublas::matrix<T> const &y_valid_, 
-		lm_step_options<T> const &step_opts_ = lm_step_options<T>())
+
+	template <typename dynamic_system, typename dataset_type, typename validation_dataset_type>
+	typename std::enable_if<detail::is_dataset<dataset_type>::value, typename dataset_type::value_type>::type
+	train_lm_stepwise(dynamic_system &sys_, dataset_type const &data_, validation_dataset_type const &valid_, 
+		lm_step_options<typename dataset_type::value_type> const &step_opts_)
 	{
 		using namespace boost::numeric::ublas;
+		using T = typename dataset_type::value_type;
 
-		size_t step_size = std::min(u_.size1(), static_cast<size_t>(std::abs(step_opts_.step_percentage)*static_cast<T>(u_.size1())));
+		size_t sample_count = data_.get_sample_count();
+		size_t step_size = std::min(sample_count, static_cast<size_t>(std::abs(step_opts_.step_percentage)*static_cast<T>(sample_count)));
 
-		detail::output_neuron_initializer<dynamic_system, T> output_initializer(sys_, y_);
+		detail::output_neuron_initializer<dynamic_system, T> output_initializer(sys_, detail::calc_output_ranges(data_, step_opts_.lm_opts.chunk_size));
 
 		std::vector<T> weights, best_weights, tmp_best_weights;
 		size_t longest_trial = 0, best_trial = 0;
 		T err_total_best = std::numeric_limits<T>::max();
 
+		// Horizons of multi sequence datasets are not prefixes of each other per sequence, so they are not continued
+		bool continue_horizons = step_opts_.continue_horizons && !detail::is_multi_sequence_dataset<dataset_type>::value;
+		detail::normal_equations_state<dynamic_system, T> horizon_state;
+
+		lm_options<T> lm_opts = step_opts_.lm_opts;
+		lm_opts.deadline = std::min(lm_opts.deadline, step_opts_.deadline);
+		auto start_time = std::chrono::steady_clock::now();
+
 		for (size_t i = 1; i <= step_opts_.max_iterations; ++i) {
+			if (std::chrono::steady_clock::now() >= step_opts_.deadline) {
+				break;
+			}
+			NEURAL_NETS_PROFILE_COUNT(trial_restart);
+			auto trial_start_time = std::chrono::steady_clock::now();
 
 			// Todo: make seperate function in detail
 			if (step_opts_.init_weights_random) {
-				T err_weight_init = std::numeric_limits<T>::max();
-				std::vector<T> best_init_weights(sys_.get_parameter_count());
-				for (size_t j = 0; j < step_opts_.random_samples_per_iteration; ++j) {
+				// Candidates are drawn serially, so the random sequence does not depend on the thread count
+				std::vector<std::vector<T>> init_weights(step_opts_.random_samples_per_iteration, std::vector<T>(sys_.get_parameter_count()));
+				for (auto &j : init_weights) {
 					sys_.init_random(step_opts_.min_random, step_opts_.max_random);
 
 					if (step_opts_.init_output_weights_special) {
 						output_initializer.perform_init_on(sys_);
 					}
-					T err_weight_init_cur = detail::calculate_weight_error(sys_, u_, y_);
-					sys_.clear_internal_memory();
-					if (err_weight_init_cur < err_weight_init) {
-						err_weight_init = err_weight_init_cur;
-						sys_.get_parameters(best_init_weights.begin(), best_init_weights.end());
+					sys_.get_parameters(j.begin(), j.end());
+				}
+				std::vector<T> init_errors = detail::calc_squared_errors(sys_, init_weights, data_, lm_opts);
+				for (auto &j : init_errors) {
+					j /= sample_count;
+				}
+
+				T err_weight_init = std::numeric_limits<T>::max();
+				std::vector<T> best_init_weights(sys_.get_parameter_count());
+				for (size_t j = 0; j < init_weights.size(); ++j) {
+					if (init_errors[j] < err_weight_init) {
+						err_weight_init = init_errors[j];
+						best_init_weights = init_weights[j];
 					}
 				}
 				sys_.set_parameters(best_init_weights.begin(), best_init_weights.end());
@@ -172,23 +276,16 @@ namespace neural_nets
 			// end todo
 
 			T err_best = std::numeric_limits<T>::max(), err_valid = std::numeric_limits<T>::max();
+			horizon_state.batches.clear();
 
 			size_t j;
-			for (j = std::min(step_size, u_.size1()); j <= u_.size1(); j = std::min(u_.size1(), j + step_size)) {
-				matrix<T> u_tmp(j, u_.size2()), y_tmp(j, y_.size2());
-				for (size_t k = 0; k < j; ++k) {
-					for (size_t h = 0; h < u_.size2(); ++h) {
-						u_tmp(k, h) = u_(k, h);
-					}
-					for (size_t h = 0; h < y_.size2(); ++h) {
-						y_tmp(k, h) = y_(k, h);
-					}
-				}
-				T err_cur = train_lm(sys_, u_tmp, y_tmp, weights, step_opts_.lm_opts);
+			bool stopped = false;
+			for (j = std::min(step_size, sample_count); j <= sample_count; j = std::min(sample_count, j + step_size)) {
+				T err_cur = detail::train_lm(sys_, detail::make_prefix(data_, j), weights, lm_opts, continue_horizons ? &horizon_state : nullptr, &stopped);
 
 				sys_.clear_internal_memory();
 				sys_.set_parameters(weights.begin(), weights.end());
-				if (err_cur < err_best && j == u_.size1()) {
+				if (err_cur < err_best && j == sample_count) {
 					err_best = err_cur;
 					tmp_best_weights = weights;
 					break;
@@ -196,15 +293,19 @@ namespace neural_nets
 				if (err_cur > std::numeric_limits<T>::max()/100) {
 					break;
 				}
+				if (stopped || std::chrono::steady_clock::now() >= step_opts_.deadline) {
+					break;
+				}
 			}
 			T err_train = err_best;
-			if (u_valid_.size1() > 0) {
+			if (valid_.get_sample_count() > 0) {
 				dynamic_system sys_tmp(sys_);
-				err_valid = detail::math_utils::normalized_error(sys_tmp(u_valid_), y_valid_);
+				err_valid = detail::calc_normalized_error(sys_tmp, valid_, lm_opts.chunk_size, lm_opts.use_parallelization);
 				err_best += err_valid;
 			}
 
-			if (err_best < err_total_best && j >= longest_trial) {
+			bool new_best = err_best < err_total_best && j >= longest_trial;
+			if (new_best) {
 
 				err_total_best = err_best;
 				longest_trial = j;
@@ -213,14 +314,11 @@ namespace neural_nets
 
 				if (step_opts_.display_iterations) {
 					std::cout << "\rTrial Nr. " << i << ", Training Error: " << err_train;
-					if (u_valid_.size1() > 0) {
+					if (valid_.get_sample_count() > 0) {
 						std::cout << ", Validation Error: " << err_valid;
 					}
 					std::cout << '\n';
 				}
-				if (err_total_best < step_opts_.abs_tol) {
-					break;
-				}
 			}
 			else {
 				if (step_opts_.display_iterations) {
@@ -228,24 +326,312 @@ namespace neural_nets
 				}
 			}
 
+			if (step_opts_.trial_callback) {
+				auto now = std::chrono::steady_clock::now();
+				lm_trial_info<T> info;
+				info.trial = i;
+				info.max_trials = step_opts_.max_iterations;
+				info.samples_used = j;
+				info.sample_count = sample_count;
+				info.training_error = err_train;
+				info.validation_error = err_valid;
+				info.best_error = err_total_best;
+				info.new_best = new_best;
+				info.trial_seconds = std::chrono::duration<double>(now - trial_start_time).count();
+				info.elapsed_seconds = std::chrono::duration<double>(now - start_time).count();
+				if (step_opts_.trial_callback(info) == training_action::stop) {
+					break;
+				}
+			}
+			if (stopped || (new_best && err_total_best < step_opts_.abs_tol)) {
+				break;
+			}
 		}
 		if (best_weights.empty()) {
 			best_weights = weights;
 		}
-		sys_.set_parameters(best_weights.begin(), best_weights.end());
+		if (!best_weights.empty()) {
+			sys_.set_parameters(best_weights.begin(), best_weights.end());
+		}
 		if (step_opts_.display_iterations) {
-			std::cout << "\nBest Trial: " << best_trial << " with total error: " << err_total_best << " after " << longest_trial << " of " << u_.size1() << " samples\n";
+			std::cout << "\nBest Trial: " << best_trial << " with total error: " << err_total_best << " after " << longest_trial << " of " << sample_count << " samples\n";
 		}
 		return err_total_best;
 	}
 
+	template <typename dynamic_system, typename dataset_type>
+	typename std::enable_if<detail::is_dataset<dataset_type>::value, typename dataset_type::value_type>::type
+	train_lm_stepwise(dynamic_system &sys_, dataset_type const &data_, 
+		lm_step_options<typename dataset_type::value_type> const &step_opts_ = lm_step_options<typename dataset_type::value_type>())
+	{
+		return train_lm_stepwise(sys_, data_, matrix_dataset<typename dataset_type::value_type>(), step_opts_);
+	}
+
+	template <typename dynamic_system, typename T>
+	T train_lm_stepwise(dynamic_system &sys_, boost::numeric::ublas::matrix<T> const &u_, 
+		boost::numeric::ublas::matrix<T> const &y_, 
+		boost::numeric::ublas::matrix<T> const &u_valid_, 
+		boost::numeric::ublas::matrix<T> const &y_valid_, 
+		lm_step_options<T> const &step_opts_ = lm_step_options<T>())
+	{
+		return train_lm_stepwise(sys_, matrix_dataset<T>(u_, y_), matrix_dataset<T>(u_valid_, y_valid_), step_opts_);
+	}
+
 	template <typename dynamic_system, typename T>
 	T train_lm_stepwise(dynamic_system &sys_, 
 		boost::numeric::ublas::matrix<T> const &u_, 
 		boost::numeric::ublas::matrix<T> const &y_, 
 		lm_step_options<T> const &step_opts_ = lm_step_options<T>())
 	{
-		return train_lm_stepwise(sys_, u_, y_, boost::numeric::ublas::matrix<T>(), boost::numeric::ublas::matrix<T>(), step_opts_);
+		return train_lm_stepwise(sys_, matrix_dataset<T>(u_, y_), step_opts_);
+	}
+
+
+	namespace detail
+	{
+		enum class gradient_method
+		{
+			sgd,
+			rmsprop,
+			adam
+		};
+
+		struct training_window
+		{
+			size_t sequence;
+			size_t first;
+			size_t count;
+		};
+
+		// Gradient of one window: the warm up samples before it are simulated from the initial state of its sequence
+		template <typename T, typename sequence_type>
+		T calc_window_gradient(net_graph<T> const &graph_, general_net<T> net_, std::vector<T> const &parameters_,
+			sequence_type const &sequence_, training_window const &window_, size_t warmup_length_, std::vector<T> &gradient_)
+		{
+			size_t warmup = std::min(window_.first, warmup_length_);
+			boost::numeric::ublas::matrix<T> u, y;
+			sequence_.read(window_.first - warmup, warmup + window_.count, u, y);
+			std::vector<T> output(net_.get_output_count());
+			for (size_t i = 0; i < warmup; ++i) {
+				net_(std::next(u.begin1(), i).begin(), std::next(u.begin1(), i).end(), output.begin(), output.end());
+			}
+			return calc_window_gradient(graph_, net_, parameters_, u, y, warmup, window_.count, gradient_);
+		}
+
+		// Minibatch training with truncated backpropagation through time. The data is cut into windows which
+		// are shuffled every epoch, the gradients of the windows of a batch are computed in parallel.
+		template <typename dynamic_system, typename dataset_type>
+		typename dataset_type::value_type train_first_order(dynamic_system sys_, dataset_type const &data_, std::vector<typename dataset_type::value_type> &best_weights_,
+			gradient_options<typename dataset_type::value_type> const &opts_, gradient_method method_)
+		{
+			using T = typename dataset_type::value_type;
+
+			if (!opts_.batch_size) {
+				throw neural_exception("Batch size must not be zero!");
+			}
+			net_graph<T> graph(sys_);
+			size_t parameter_count = graph.get_parameter_count();
+			std::vector<T> paras(parameter_count);
+			sys_.get_parameters(paras.begin(), paras.end());
+			std::vector<T> best_paras = paras;
+
+			std::vector<training_window> windows;
+			for (size_t s = 0; s < get_sequence_count(data_); ++s) {
+				size_t length = get_sequence(data_, s).get_sample_count();
+				size_t window_length = opts_.window_length ? opts_.window_length : length;
+				for (size_t first = 0; first < length; first += window_length) {
+					windows.push_back(training_window{ s, first, std::min(window_length, length - first) });
+				}
+			}
+
+			std::vector<T> first_moment(parameter_count, 0), second_moment(parameter_count, 0), gradient(parameter_count);
+			std::vector<std::vector<T>> window_gradients(opts_.batch_size, std::vector<T>(parameter_count));
+			std::vector<T> window_errors(opts_.batch_size);
+			T min_error = std::numeric_limits<T>::max(), first_correction = 1, second_correction = 1;
+			auto start_time = std::chrono::steady_clock::now(), epoch_time = start_time;
+
+			for (size_t epoch = 1; epoch <= opts_.max_epochs; ++epoch) {
+				if (opts_.shuffle_windows) {
+					for (size_t i = windows.size(); i > 1; --i) {
+						std::swap(windows[i - 1], windows[random_utils::value_in_range<size_t>(0, i - 1)]);
+					}
+				}
+
+				T epoch_error = 0, gradient_norm = 0;
+				size_t epoch_samples = 0;
+				for (size_t batch = 0; batch < windows.size(); batch += opts_.batch_size) {
+					size_t batch_windows = std::min(opts_.batch_size, windows.size() - batch);
+					sys_.set_parameters(paras.begin(), paras.end());
+					parallel_for(0, batch_windows, [&](size_t i) {
+						auto const &window = windows[batch + i];
+						std::fill(window_gradients[i].begin(), window_gradients[i].end(), T(0));
+						dynamic_system sys(sys_);
+						reset_sequence_state(data_, window.sequence, sys);
+						if (opts_.window_length) {
+							window_errors[i] = calc_window_gradient(graph, sys, paras, get_sequence(data_, window.sequence), window, opts_.warmup_length, window_gradients[i]);
+						}
+						else {
+							window_errors[i] = calc_sequence_gradient(graph, sys, paras, get_sequence(data_, window.sequence), opts_.memory_budget, window_gradients[i]);
+						}
+					}, opts_.use_parallelization);
+
+					size_t batch_samples = 0;
+					std::fill(gradient.begin(), gradient.end(), T(0));
+					for (size_t i = 0; i < batch_windows; ++i) {
+						batch_samples += windows[batch + i].count;
+						epoch_error += window_errors[i];
+						for (size_t j = 0; j < parameter_count; ++j) {
+							gradient[j] += window_gradients[i][j];
+						}
+					}
+					epoch_samples += batch_samples;
+
+					gradient_norm = 0;
+					first_correction *= opts_.momentum;
+					second_correction *= opts_.decay;
+					for (size_t j = 0; j < parameter_count; ++j) {
+						T g = gradient[j] / batch_samples;
+						gradient_norm += g*g;
+						switch (method_) {
+						case gradient_method::sgd:
+							first_moment[j] = opts_.momentum*first_moment[j] - opts_.learning_rate*g;
+							paras[j] += first_moment[j];
+							break;
+						case gradient_method::rmsprop:
+							second_moment[j] = opts_.decay*second_moment[j] + (1 - opts_.decay)*g*g;
+							paras[j] -= opts_.learning_rate*g / (std::sqrt(second_moment[j]) + opts_.epsilon);
+							break;
+						case gradient_method::adam:
+							first_moment[j] = opts_.momentum*first_moment[j] + (1 - opts_.momentum)*g;
+							second_moment[j] = opts_.decay*second_moment[j] + (1 - opts_.decay)*g*g;
+							paras[j] -= opts_.learning_rate*(first_moment[j] / (1 - first_correction)) /
+								(std::sqrt(second_moment[j] / (1 - second_correction)) + opts_.epsilon);
+							break;
+						}
+					}
+					gradient_norm = std::sqrt(gradient_norm);
+				}
+
+				epoch_error /= std::max<size_t>(epoch_samples, 1);
+				if (std::isnan(epoch_error) || std::isinf(epoch_error)) {
+					epoch_error = std::numeric_limits<T>::max();
+				}
+				if (epoch_error < min_error) {
+					min_error = epoch_error;
+					best_paras = paras;
+				}
+
+				if (opts_.display_iterations) {
+					std::cout << epoch << '\t' << epoch_error << "\t\t" << gradient_norm << '\n';
+				}
+				if (opts_.epoch_callback) {
+					auto now = std::chrono::steady_clock::now();
+					gradient_epoch_info<T> info;
+					info.epoch = epoch;
+					info.error = epoch_error;
+					info.gradient_norm = gradient_norm;
+					info.epoch_seconds = std::chrono::duration<double>(now - epoch_time).count();
+					info.elapsed_seconds = std::chrono::duration<double>(now - start_time).count();
+					epoch_time = now;
+					if (opts_.epoch_callback(info) == training_action::stop) {
+						break;
+					}
+				}
+				if (epoch_error < opts_.abs_tol || std::chrono::steady_clock::now() >= opts_.deadline) {
+					break;
+				}
+			}
+			sys_.clear_internal_memory();
+			sys_.set_parameters(best_paras.begin(), best_paras.end());
+			best_weights_ = best_paras;
+			return min_error;
+		}
+	}
+
+	// Gradient of the summed squared output error on data_ with respect to the parameters of net_ (in the order
+	// of get_parameters), without truncation. Every sequence starts from its initial state. Long sequences are
+	// handled by checkpointing, recomputing states so that at most memory_budget_ bytes are used per sequence.
+	// The sequences run on the shared thread pool unless parallel_ is false.
+	template <typename T, typename dataset_type>
+	typename std::enable_if<detail::is_dataset<dataset_type>::value, T>::type
+	calc_gradient(general_net<T> net_, dataset_type const &data_, std::vector<T> &gradient_, size_t memory_budget_ = gradient_options<T>().memory_budget,
+		bool parallel_ = true)
+	{
+		detail::net_graph<T> graph(net_);
+		std::vector<T> parameters(graph.get_parameter_count());
+		net_.get_parameters(parameters.begin(), parameters.end());
+
+		size_t sequence_count = detail::get_sequence_count(data_);
+		std::vector<std::vector<T>> gradients(sequence_count, std::vector<T>(parameters.size(), T(0)));
+		std::vector<T> errors(sequence_count);
+		detail::parallel_for(0, sequence_count, [&](size_t i) {
+			general_net<T> net(net_);
+			detail::reset_sequence_state(data_, i, net);
+			errors[i] = detail::calc_sequence_gradient(graph, net, parameters, detail::get_sequence(data_, i), memory_budget_, gradients[i]);
+		}, parallel_);
+
+		gradient_.assign(parameters.size(), T(0));
+		for (auto const &i : gradients) {
+			for (size_t j = 0; j < i.size(); ++j) {
+				gradient_[j] += i[j];
+			}
+		}
+		return std::accumulate(errors.begin(), errors.end(), T(0));
+	}
+
+	template <typename T>
+	T calc_gradient(general_net<T> net_, boost::numeric::ublas::matrix<T> const &inputs_, boost::numeric::ublas::matrix<T> const &desired_outputs_,
+		std::vector<T> &gradient_, size_t memory_budget_ = gradient_options<T>().memory_budget, bool parallel_ = true)
+	{
+		return calc_gradient(net_, matrix_dataset<T>(inputs_, desired_outputs_), gradient_, memory_budget_, parallel_);
+	}
+
+	// First order training methods for networks too large for train_lm. Their cost per epoch is linear in the
+	// number of weights. Gradients are computed by truncated backpropagation through time, which requires
+	// dynamic_system to be a general_net.
+	template <typename dynamic_system, typename dataset_type>
+	typename std::enable_if<detail::is_dataset<dataset_type>::value, typename dataset_type::value_type>::type
+	train_sgd(dynamic_system sys_, dataset_type const &data_, std::vector<typename dataset_type::value_type> &best_weights_,
+		gradient_options<typename dataset_type::value_type> const &opts_)
+	{
+		return detail::train_first_order(sys_, data_, best_weights_, opts_, detail::gradient_method::sgd);
+	}
+
+	template <typename dynamic_system, typename dataset_type>
+	typename std::enable_if<detail::is_dataset<dataset_type>::value, typename dataset_type::value_type>::type
+	train_rmsprop(dynamic_system sys_, dataset_type const &data_, std::vector<typename dataset_type::value_type> &best_weights_,
+		gradient_options<typename dataset_type::value_type> const &opts_)
+	{
+		return detail::train_first_order(sys_, data_, best_weights_, opts_, detail::gradient_method::rmsprop);
+	}
+
+	template <typename dynamic_system, typename dataset_type>
+	typename std::enable_if<detail::is_dataset<dataset_type>::value, typename dataset_type::value_type>::type
+	train_adam(dynamic_system sys_, dataset_type const &data_, std::vector<typename dataset_type::value_type> &best_weights_,
+		gradient_options<typename dataset_type::value_type> const &opts_)
+	{
+		return detail::train_first_order(sys_, data_, best_weights_, opts_, detail::gradient_method::adam);
+	}
+
+	template <typename T, typename dynamic_system>
+	T train_sgd(dynamic_system sys_, boost::numeric::ublas::matrix<T> const &inputs_, boost::numeric::ublas::matrix<T> const &desired_outputs_, std::vector<T> &best_weights_,
+		gradient_options<T> const &opts_ = gradient_options<T>())
+	{
+		return train_sgd(sys_, matrix_dataset<T>(inputs_, desired_outputs_), best_weights_, opts_);
+	}
+
+	template <typename T, typename dynamic_system>
+	T train_rmsprop(dynamic_system sys_, boost::numeric::ublas::matrix<T> const &inputs_, boost::numeric::ublas::matrix<T> const &desired_outputs_, std::vector<T> &best_weights_,
+		gradient_options<T> const &opts_ = gradient_options<T>())
+	{
+		return train_rmsprop(sys_, matrix_dataset<T>(inputs_, desired_outputs_), best_weights_, opts_);
+	}
+
+	template <typename T, typename dynamic_system>
+	T train_adam(dynamic_system sys_, boost::numeric::ublas::matrix<T> const &inputs_, boost::numeric::ublas::matrix<T> const &desired_outputs_, std::vector<T> &best_weights_,
+		gradient_options<T> const &opts_ = gradient_options<T>())
+	{
+		return train_adam(sys_, matrix_dataset<T>(inputs_, desired_outputs_), best_weights_, opts_);
 	}
 }
 
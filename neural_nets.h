@@ -2,7 +2,14 @@
 #define NEURAL_NETS_H
 
 #include "neural_nets\general_net.h"
+#include "neural_nets\net_builder.h"
 #include "neural_nets\net_training.h"
 #include "neural_nets\net_signals.h"
+#include "neural_nets\net_serialization.h"
+#include "neural_nets\net_threading.h"
+#include "neural_nets\net_reservoir.h"
+#include "neural_nets\compiled_net.h"
+#include "neural_nets\quantized_net.h"
+#include "neural_nets\batched_net.h"
 
 #endif
\ No newline at end of file
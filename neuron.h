@@ -1,7 +1,10 @@
 #ifndef NEURON_H
 #define NEURON_H
 
-#include <deque>
+#include <algorithm>
+#include <vector>
+
+#include "neural_nets\activation_functions.h"
 
 namespace neural_nets
 {
@@ -9,29 +12,53 @@ namespace neural_nets
 	class neuron
 	{
 	public:
-		explicit neuron(size_t index_) : index(index_), input(false), output(false) {}
+		explicit neuron(size_t index_) : index(index_), input(false), output(false), activation(activation_function::automatic), memory_size(0), newest(0) {}
 
 		size_t get_index() const { return index; }
-		size_t get_memory_size() const { return memory.size(); }
+		size_t get_memory_size() const { return memory_size; }
 
 		bool is_input() const { return input; }
 		bool is_output() const { return output; }
-		bool has_memory() const { return !memory.empty(); }
+		bool has_memory() const { return memory_size != 0; }
+
+		// get_activation() resolves automatic (linear for input and output neurons, tanh otherwise)
+		activation_function get_declared_activation() const { return activation; }
+		activation_function get_activation() const
+		{
+			if (activation != activation_function::automatic)
+				return activation;
+			return input || output ? activation_function::linear : activation_function::tanh;
+		}
 
 		void set_as_input(bool input_) { input = input_; }
 		void set_as_output(bool output_) { output = output_; }
-		void set_memory_size(size_t size_) { memory.resize(size_); clear_internal_memory(); }
+		void set_activation(activation_function activation_) { activation = activation_; }
+		void set_memory_size(size_t size_) { memory_size = size_; newest = 0; memory.resize(2*size_); clear_internal_memory(); }
 		void clear_internal_memory() { std::fill(memory.begin(), memory.end(), T(0)); }
-		void add_to_memory(T const &value_) { memory.pop_back();  memory.push_front(value_); }
+		void add_to_memory(T const &value_)
+		{
+			newest = newest ? newest - 1 : memory_size - 1;
+			memory[newest] = memory[newest + memory_size] = value_;
+		}
+		void write_to_memory(size_t time_step_, T const &value_)
+		{
+			size_t position = (newest + time_step_) % memory_size;
+			memory[position] = memory[position + memory_size] = value_;
+		}
 
-		T read_from_memory(size_t time_step_) const { return memory[time_step_]; }
-		T output_function(T const &input_) const { return input || output ? input_ : std::tanh(input_); }
+		T read_from_memory(size_t time_step_) const { return memory[newest + time_step_]; }
+		// Contiguous view of the memory, newest value first: get_memory_window()[k] == read_from_memory(k)
+		T const *get_memory_window() const { return memory.data() + newest; }
+		T output_function(T const &input_) const { return apply_activation(get_activation(), input_); }
 
 	private:
-		T logistic_function(T const &input_) const { return T(1)/(T(1) + std::exp(-input_)); }
 		size_t index;
 		bool input, output;
-		std::deque<T> memory;
+		activation_function activation;
+		// Mirrored ring: every value is stored at newest + k and newest + k + memory_size, so the last
+		// memory_size values are always contiguous from newest on
+		size_t memory_size, newest;
+		std::vector<T> memory;
 	};
 }
 
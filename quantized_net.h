@@ -0,0 +1,430 @@
+#ifndef QUANTIZED_NET_H
+#define QUANTIZED_NET_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+
+#include <boost\numeric\ublas\matrix.hpp>
+
+#include "neural_nets\compiled_net.h"
+#include "neural_nets\neural_exception.h"
+#include "neural_nets\detail\net_gradient.h"
+
+// Fixed point inference of a trained general_net, for targets where floating point throughput or memory bandwidth
+// is tight. Neuron outputs and their delay histories are int16 values with a scale per neuron, weights are int8
+// (or int16) values with a scale per connection, and the taps of a connection are accumulated in int32 (int64
+// for int16 weights). Delay lines with more taps than the accumulator can sum without overflow (516 for int8
+// weights) are split into several connections. The sum of every connection is rescaled to the net input of its target by a fixed point
+// multiplier, bounded activations are read from interpolated lookup tables. All scales come from the value
+// ranges seen on a representative input sequence (calibrate_quantization).
+
+namespace neural_nets
+{
+	// Largest absolute values seen during calibration
+	template <typename T>
+	struct quantization_ranges
+	{
+		std::vector<T> inputs;     // Per network input
+		std::vector<T> net_inputs; // Per neuron, argument of the activation
+		std::vector<T> outputs;    // Per neuron
+	};
+
+	// Errors of a quantized network against the floating point network, per output
+	template <typename T>
+	struct quantization_report
+	{
+		std::vector<T> max_error, rms_error;
+		std::vector<T> reference_rms; // RMS of the floating point outputs
+	};
+
+	namespace detail
+	{
+		namespace quantization
+		{
+			static std::int64_t const state_limit = 32767;        // int16 neuron outputs
+			static std::int64_t const net_input_limit = 1 << 20;  // Net inputs of table and softsign activations
+			static int const net_input_bits = 21;                 // log2 of the net input interval
+			static int const table_bits = 12;                     // 2^table_bits intervals per lookup table
+
+			inline std::int64_t saturate(std::int64_t value_, std::int64_t limit_) { return std::min(limit_, std::max(-limit_, value_)); }
+
+			inline bool uses_table(activation_function activation_)
+			{
+				return activation_ == activation_function::tanh || activation_ == activation_function::rational_tanh ||
+					activation_ == activation_function::fast_tanh || activation_ == activation_function::logistic;
+			}
+
+			// Net inputs beyond this are saturated by the lookup table
+			inline double table_range(activation_function activation_) { return activation_ == activation_function::logistic ? 16.0 : 8.0; }
+
+			// value_ ~ multiplier_ * 2^-shift_, with multiplier_ small enough that values up to bound_ can be multiplied
+			// by it in 64 bits
+			inline void make_multiplier(double value_, double bound_, std::int64_t &multiplier_, int &shift_)
+			{
+				int bound_bits = bound_ < 1.0 ? 0 : static_cast<int>(std::ceil(std::log2(bound_ + 1.0)));
+				int mantissa_bits = std::max(1, std::min(30, 62 - bound_bits));
+				int exponent;
+				double fraction = std::frexp(value_, &exponent);
+				multiplier_ = std::llround(std::ldexp(fraction, mantissa_bits));
+				shift_ = mantissa_bits - exponent;
+				if (shift_ < 0) {
+					multiplier_ = std::llround(std::min(value_, std::ldexp(1.0, mantissa_bits)));
+					shift_ = 0;
+				}
+				else if (shift_ > 62) {
+					multiplier_ = 0;
+					shift_ = 0;
+				}
+			}
+
+			inline std::int64_t rescale(std::int64_t value_, std::int64_t multiplier_, int shift_)
+			{
+				return shift_ ? (value_*multiplier_ + (std::int64_t(1) << (shift_ - 1))) >> shift_ : value_*multiplier_;
+			}
+
+			template <typename T>
+			T range_or_one(T const &range_) { return range_ > T(0) ? range_ : T(1); }
+		}
+	}
+
+	template <typename T>
+	quantization_ranges<T> calibrate_quantization(general_net<T> net_, boost::numeric::ublas::matrix<T> const &u_)
+	{
+		if (u_.size2() != net_.get_input_count()) {
+			throw neural_exception("Number of calibration input columns does not match the input count of the network!");
+		}
+		detail::net_graph<T> graph(net_);
+		std::vector<T> parameters(graph.get_parameter_count());
+		net_.get_parameters(parameters.begin(), parameters.end());
+		size_t delay = graph.get_max_delay();
+		boost::numeric::ublas::matrix<T> states(delay + u_.size1(), graph.get_neuron_count());
+		graph.load_history(net_, states);
+
+		quantization_ranges<T> ranges;
+		ranges.inputs.assign(u_.size2(), T(0));
+		ranges.net_inputs.assign(graph.get_neuron_count(), T(0));
+		ranges.outputs.assign(graph.get_neuron_count(), T(0));
+		for (size_t t = 0; t < u_.size1(); ++t) {
+			for (size_t k = 0; k < u_.size2(); ++k) {
+				ranges.inputs[k] = std::max(ranges.inputs[k], std::abs(u_(t, k)));
+			}
+			for (auto const &n : graph.get_nodes()) {
+				T sum = graph.calc_net_input(n, parameters, states, delay + t, std::next(u_.begin1(), t).begin());
+				states(delay + t, n.neuron) = apply_activation(n.activation, sum);
+				ranges.net_inputs[n.neuron] = std::max(ranges.net_inputs[n.neuron], std::abs(sum));
+				ranges.outputs[n.neuron] = std::max(ranges.outputs[n.neuron], std::abs(states(delay + t, n.neuron)));
+			}
+		}
+		return ranges;
+	}
+
+	template <typename T, typename W = std::int8_t>
+	class quantized_net
+	{
+		static_assert(std::is_same<W, std::int8_t>::value || std::is_same<W, std::int16_t>::value, "Weights of a quantized_net must be int8_t or int16_t");
+
+	public:
+		using accumulator_type = typename std::conditional<sizeof(W) == 1, std::int32_t, std::int64_t>::type;
+
+		// Quantizes net_ including its current internal memory with the scales of ranges_ (see compiled_net for
+		// optimize_)
+		quantized_net(general_net<T> net_, quantization_ranges<T> const &ranges_, bool optimize_ = true);
+		// Calibrates the scales on the input sequence calibration_inputs_ first
+		quantized_net(general_net<T> const &net_, boost::numeric::ublas::matrix<T> const &calibration_inputs_, bool optimize_ = true)
+			: quantized_net(net_, calibrate_quantization(net_, calibration_inputs_), optimize_) {}
+
+		size_t get_input_count() const { return input_scales.size(); }
+		size_t get_output_count() const { return outputs.size(); }
+		size_t get_neuron_count() const { return nodes.size(); }
+		size_t get_weight_bytes() const { return taps.size()*sizeof(W); }
+
+		void clear_internal_memory() { history = boost::numeric::ublas::zero_matrix<std::int16_t>(history.size1(), history.size2()); }
+
+		template<typename iter1, typename iter2> void operator()(iter1 input_begin_, iter1 input_end_, iter2 output_begin_, iter2 output_end_);
+		boost::numeric::ublas::matrix<T> operator()(boost::numeric::ublas::matrix<T> const &u_);
+
+	private:
+		enum class output_stage { saturate, relu, softsign, table };
+
+		struct node
+		{
+			output_stage stage;
+			size_t table;
+			std::int64_t bias, one; // one: 1.0 in net input units (softsign)
+			size_t first_connection, last_connection;
+		};
+
+		// Taps of one source (neuron or network input) with a common weight scale
+		struct connection
+		{
+			size_t source;
+			bool input;
+			size_t first_tap, last_tap;
+			std::int64_t multiplier; // Fixed point factor from the tap sum to the net input of the target
+			int shift;
+		};
+
+		struct tap
+		{
+			size_t delay;
+			W weight;
+		};
+
+		std::vector<node> nodes;
+		std::vector<connection> connections;
+		std::vector<tap> taps;
+		std::vector<std::vector<std::int16_t>> tables;
+		std::vector<T> input_scales, output_scales;
+		std::vector<size_t> outputs;
+		std::vector<std::int16_t> quantized_inputs;
+		size_t current_row;
+
+		// Ring of the quantized node outputs, as in compiled_net
+		boost::numeric::ublas::matrix<std::int16_t> history;
+		std::vector<size_t> delay_rows;
+
+		std::int16_t activate(node const &n_, std::int64_t sum_) const;
+	};
+
+
+
+
+	template <typename T, typename W>
+	quantized_net<T, W>::quantized_net(general_net<T> net_, quantization_ranges<T> const &ranges_, bool optimize_) : current_row(0)
+	{
+		using namespace detail::quantization;
+
+		size_t neuron_count = net_.get_neuron_count();
+		if (ranges_.inputs.size() != net_.get_input_count() || ranges_.net_inputs.size() != neuron_count || ranges_.outputs.size() != neuron_count) {
+			throw neural_exception("Quantization ranges do not match the network!");
+		}
+		auto const &order = net_.get_evaluation_order();
+		auto plan = detail::make_plan_nodes(net_);
+		if (optimize_) {
+			detail::remove_dead_neurons(plan);
+			detail::fold_linear_neurons(plan, order);
+			detail::merge_parallel_taps(plan);
+		}
+
+		for (auto const &r : ranges_.inputs) {
+			input_scales.push_back(range_or_one(r) / T(state_limit));
+		}
+		quantized_inputs.resize(input_scales.size());
+
+		// Scales of the outputs and net inputs of every neuron
+		std::vector<double> state_scales(neuron_count), net_input_scales(neuron_count);
+		std::vector<activation_function> table_activations;
+		std::vector<size_t> node_indices(neuron_count);
+		for (size_t i : order) {
+			if (plan[i].removed) {
+				continue;
+			}
+			auto activation = plan[i].activation;
+			node n = { output_stage::saturate, 0, 0, 0, 0, 0 };
+			if (uses_table(activation)) {
+				n.stage = output_stage::table;
+				state_scales[i] = 1.0 / state_limit;
+				net_input_scales[i] = table_range(activation) / net_input_limit;
+				n.table = std::find(table_activations.begin(), table_activations.end(), activation) - table_activations.begin();
+				if (n.table == table_activations.size()) {
+					table_activations.push_back(activation);
+					std::vector<std::int16_t> table((size_t(1) << table_bits) + 1);
+					for (size_t k = 0; k < table.size(); ++k) {
+						double x = table_range(activation)*(2.0*k / (table.size() - 1) - 1.0);
+						table[k] = static_cast<std::int16_t>(std::llround(apply_activation(activation, x)*state_limit));
+					}
+					tables.push_back(table);
+				}
+			}
+			else if (activation == activation_function::softsign) {
+				n.stage = output_stage::softsign;
+				state_scales[i] = 1.0 / state_limit;
+				net_input_scales[i] = range_or_one(static_cast<double>(ranges_.net_inputs[i])) / net_input_limit;
+				n.one = std::llround(1.0 / net_input_scales[i]);
+			}
+			else {
+				n.stage = activation == activation_function::relu ? output_stage::relu : output_stage::saturate;
+				state_scales[i] = range_or_one(static_cast<double>(ranges_.outputs[i])) / state_limit;
+				net_input_scales[i] = state_scales[i];
+			}
+			n.bias = std::llround(plan[i].bias / net_input_scales[i]);
+			node_indices[i] = nodes.size();
+			nodes.push_back(n);
+			output_scales.push_back(static_cast<T>(state_scales[i]));
+		}
+
+		// Connections with one weight scale each: every input use and every run of edges from one source, split so
+		// that the sum of a connection fits into the accumulator
+		double weight_limit = std::numeric_limits<W>::max();
+		size_t const max_taps = static_cast<size_t>(std::numeric_limits<accumulator_type>::max() / (std::numeric_limits<W>::max()*state_limit));
+		size_t max_delay = 0;
+		for (size_t i : order) {
+			if (plan[i].removed) {
+				continue;
+			}
+			auto &n = nodes[node_indices[i]];
+			n.first_connection = connections.size();
+			for (auto const &input : plan[i].inputs) {
+				if (input.second == T(0)) {
+					continue;
+				}
+				double weight_scale = std::abs(static_cast<double>(input.second)) / weight_limit;
+				connection c = { input.first, true, taps.size(), taps.size() + 1, 0, 0 };
+				make_multiplier(weight_scale*input_scales[input.first] / net_input_scales[i], weight_limit*state_limit, c.multiplier, c.shift);
+				taps.push_back(tap{ 0, static_cast<W>(input.second > T(0) ? weight_limit : -weight_limit) });
+				connections.push_back(c);
+			}
+			auto const &edges = plan[i].edges;
+			for (size_t first = 0, last = 0; first < edges.size(); first = last) {
+				double largest = 0.0;
+				for (last = first; last < edges.size() && last - first < max_taps && edges[last].source == edges[first].source; ++last) {
+					largest = std::max(largest, std::abs(static_cast<double>(edges[last].weight)));
+				}
+				if (largest == 0.0) {
+					continue;
+				}
+				double weight_scale = largest / weight_limit, bound = 0.0;
+				connection c = { node_indices[edges[first].source], false, taps.size(), taps.size() + (last - first), 0, 0 };
+				for (size_t e = first; e < last; ++e) {
+					W weight = static_cast<W>(std::llround(edges[e].weight / weight_scale));
+					taps.push_back(tap{ edges[e].delay, weight });
+					bound += std::abs(static_cast<double>(weight))*state_limit;
+					max_delay = std::max(max_delay, edges[e].delay);
+				}
+				make_multiplier(weight_scale*state_scales[edges[first].source] / net_input_scales[i], bound, c.multiplier, c.shift);
+				connections.push_back(c);
+			}
+			n.last_connection = connections.size();
+		}
+		for (size_t i = 0; i < plan.size(); ++i) {
+			if (plan[i].output) {
+				outputs.push_back(node_indices[i]);
+			}
+		}
+
+		history = boost::numeric::ublas::zero_matrix<std::int16_t>(max_delay + 1, nodes.size());
+		delay_rows.resize(max_delay + 1);
+		for (size_t i : order) {
+			auto const &current = net_.get_neuron(i);
+			for (size_t d = 1; !plan[i].removed && d <= std::min(max_delay, current.get_memory_size()); ++d) {
+				history(history.size1() - d, node_indices[i]) = static_cast<std::int16_t>(saturate(std::llround(current.read_from_memory(d - 1) / state_scales[i]), state_limit));
+			}
+		}
+	}
+
+	template <typename T, typename W>
+	std::int16_t quantized_net<T, W>::activate(node const &n_, std::int64_t sum_) const
+	{
+		using namespace detail::quantization;
+		switch (n_.stage) {
+		case output_stage::relu:
+			return static_cast<std::int16_t>(saturate(std::max(std::int64_t(0), sum_), state_limit));
+		case output_stage::softsign:
+			sum_ = saturate(sum_, std::int64_t(1) << 40);
+			return static_cast<std::int16_t>(sum_*state_limit / (n_.one + std::abs(sum_)));
+		case output_stage::table: {
+			// Linear interpolation between the entries around the saturated net input
+			auto const &table = tables[n_.table];
+			std::int64_t position = saturate(sum_, net_input_limit) + net_input_limit;
+			size_t index = static_cast<size_t>(position >> (net_input_bits - table_bits));
+			std::int64_t fraction = position & ((std::int64_t(1) << (net_input_bits - table_bits)) - 1);
+			if (index + 1 >= table.size()) {
+				return table.back();
+			}
+			std::int64_t step = table[index + 1] - table[index];
+			return static_cast<std::int16_t>(table[index] + ((step*fraction + (std::int64_t(1) << (net_input_bits - table_bits - 1))) >> (net_input_bits - table_bits)));
+		}
+		default:
+			return static_cast<std::int16_t>(saturate(sum_, state_limit));
+		}
+	}
+
+	template <typename T, typename W>
+	template<typename iter1, typename iter2> void quantized_net<T, W>::operator()(iter1 input_begin_, iter1 input_end_, iter2 output_begin_, iter2 output_end_)
+	{
+		using namespace detail::quantization;
+		NEURAL_NETS_PROFILE_SCOPE(forward_step);
+		size_t rows = history.size1();
+		for (size_t d = 0; d < rows; ++d) {
+			delay_rows[d] = (current_row + rows - d) % rows;
+		}
+		for (size_t k = 0; k < quantized_inputs.size(); ++k) {
+			quantized_inputs[k] = static_cast<std::int16_t>(saturate(std::llround(*std::next(input_begin_, k) / input_scales[k]), state_limit));
+		}
+		std::int16_t *current = history.data().begin() + current_row*history.size2(); // Row major, so the row is contiguous
+		for (size_t k = 0; k < nodes.size(); ++k) {
+			auto const &n = nodes[k];
+			std::int64_t sum = n.bias;
+			for (size_t c = n.first_connection; c < n.last_connection; ++c) {
+				auto const &current_connection = connections[c];
+				accumulator_type partial = 0;
+				if (current_connection.input) {
+					partial = accumulator_type(taps[current_connection.first_tap].weight) * quantized_inputs[current_connection.source];
+				}
+				else {
+					for (size_t t = current_connection.first_tap; t < current_connection.last_tap; ++t) {
+						partial += accumulator_type(taps[t].weight) * history(delay_rows[taps[t].delay], current_connection.source);
+					}
+				}
+				sum += rescale(partial, current_connection.multiplier, current_connection.shift);
+			}
+			current[k] = activate(n, sum);
+		}
+		for (size_t i : outputs) {
+			*output_begin_ = current[i] * output_scales[i];
+			++output_begin_;
+		}
+		current_row = (current_row + 1) % rows;
+	}
+
+	template <typename T, typename W>
+	boost::numeric::ublas::matrix<T> quantized_net<T, W>::operator()(boost::numeric::ublas::matrix<T> const &u_)
+	{
+		boost::numeric::ublas::matrix<T> y(u_.size1(), outputs.size());
+		for (size_t i = 0; i < u_.size1(); ++i) {
+			(*this)(std::next(u_.begin1(), i).begin(), std::next(u_.begin1(), i).end(),
+				std::next(y.begin1(), i).begin(), std::next(y.begin1(), i).end());
+		}
+		return y;
+	}
+
+	// Simulates both networks on u_, starting from their current internal memories
+	template <typename T, typename W>
+	quantization_report<T> compare_quantized(general_net<T> net_, quantized_net<T, W> quantized_, boost::numeric::ublas::matrix<T> const &u_)
+	{
+		auto reference = net_(u_);
+		auto result = quantized_(u_);
+		quantization_report<T> report;
+		report.max_error.assign(reference.size2(), T(0));
+		report.rms_error.assign(reference.size2(), T(0));
+		report.reference_rms.assign(reference.size2(), T(0));
+		for (size_t k = 0; k < reference.size2(); ++k) {
+			for (size_t t = 0; t < reference.size1(); ++t) {
+				T error = std::abs(result(t, k) - reference(t, k));
+				report.max_error[k] = std::max(report.max_error[k], error);
+				report.rms_error[k] += error*error;
+				report.reference_rms[k] += reference(t, k)*reference(t, k);
+			}
+			report.rms_error[k] = std::sqrt(report.rms_error[k] / std::max(reference.size1(), size_t(1)));
+			report.reference_rms[k] = std::sqrt(report.reference_rms[k] / std::max(reference.size1(), size_t(1)));
+		}
+		return report;
+	}
+
+	template <typename T>
+	std::ostream &operator<<(std::ostream &stream, quantization_report<T> const &report)
+	{
+		for (size_t k = 0; k < report.max_error.size(); ++k) {
+			stream << "Output " << k << ": max. error " << report.max_error[k] << ", RMS error " << report.rms_error[k]
+				<< ", RMS of the output " << report.reference_rms[k] << '\n';
+		}
+		return stream;
+	}
+}
+
+#endif
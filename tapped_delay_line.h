@@ -15,6 +15,12 @@ namespace neural_nets
 			size_t delay_index;
 			T delay_weight;
 		};
+
+		// Taps first_tap .. first_tap + tap_count - 1 of a delay line with consecutive delays
+		struct tap_run
+		{
+			size_t first_tap, tap_count;
+		};
 	}
 
 	template <class T>
@@ -28,6 +34,18 @@ namespace neural_nets
 			delay_line = delay_line_;
 			if (!delay_line.front().delay_index)
 				instant = true;
+			for (size_t k = 0; k < delay_line.size(); ++k) {
+				if (!delay_line[k].delay_index)
+					continue;
+				if (!delay_runs.empty()) {
+					auto &last = delay_runs.back();
+					if (last.first_tap + last.tap_count == k && delay_line[k - 1].delay_index + 1 == delay_line[k].delay_index) {
+						++last.tap_count;
+						continue;
+					}
+				}
+				delay_runs.push_back(detail::tap_run{ k, 1 });
+			}
 		}
 
 		bool is_connected() const { return connected; }
@@ -41,12 +59,26 @@ namespace neural_nets
 		T get_delay_weight(size_t time_step_) const { return delay_line[time_step_].delay_weight; }
 
 		std::vector<detail::tapped_delay<T>> const &get_delay_line() const { return delay_line; }
+		std::vector<detail::tap_run> const &get_delay_runs() const { return delay_runs; } // Delayed taps only
 
 	private:
 		bool connected, instant;
 		std::vector<detail::tapped_delay<T>> delay_line;
+		std::vector<detail::tap_run> delay_runs;
 	};
 
+	// Taps with the delays first_delay_ to last_delay_, all starting at weight_
+	template <class T>
+	tapped_delay_line<T> make_tapped_delay_line(size_t first_delay_, size_t last_delay_, T const &weight_ = 1)
+	{
+		std::vector<detail::tapped_delay<T>> taps;
+		taps.reserve(last_delay_ - first_delay_ + 1);
+		for (size_t d = first_delay_; d <= last_delay_; ++d) {
+			taps.emplace_back(d, weight_);
+		}
+		return tapped_delay_line<T>(taps);
+	}
+
 	template <typename T>
 	std::ostream &operator<<(std::ostream &stream, tapped_delay_line<T> const &tdl)
 	{
@@ -0,0 +1,123 @@
+#include <iostream> // For output
+#include <algorithm> // For std::max
+#include <cmath> // For std::abs
+
+#include "neural_nets\neural_nets.h" // All relevant headers for full neural network usage
+
+// Checks that checkpointed gradients (calc_gradient with a memory budget) equal the plain backpropagation
+// through time over the whole sequence and central finite differences of the summed squared error.
+// Returns a non-zero exit code on failure.
+
+namespace
+{
+	using namespace neural_nets;
+	using namespace boost::numeric::ublas;
+
+	double calc_error(general_net<double> net_, matrix<double> const &u_, matrix<double> const &y_)
+	{
+		auto outputs = net_(u_);
+		double error = 0;
+		for (size_t i = 0; i < outputs.size1(); ++i) {
+			for (size_t j = 0; j < outputs.size2(); ++j) {
+				error += (outputs(i, j) - y_(i, j))*(outputs(i, j) - y_(i, j));
+			}
+		}
+		return error;
+	}
+
+	double calc_relative_deviation(std::vector<double> const &gradient_, std::vector<double> const &reference_)
+	{
+		double deviation = 0, scale = 0;
+		for (size_t i = 0; i < gradient_.size(); ++i) {
+			deviation = std::max(deviation, std::abs(gradient_[i] - reference_[i]));
+			scale = std::max(scale, std::abs(reference_[i]));
+		}
+		return deviation / scale;
+	}
+}
+
+int main()
+{
+	// Recurrent network with delays of up to 3 time steps, a frozen tap, tied taps and a start state
+	general_net<double> net(6);
+	net.connect_neurons(0, 2);
+	net.connect_neurons(1, 2);
+	net.connect_neurons(0, 3);
+	net.connect_neurons(2, 4);
+	net.connect_neurons(3, 4);
+	net.connect_neurons(4, 5);
+	net.connect_neurons(5, 2, tapped_delay_line<double>(3));
+	net.connect_neurons(5, 3, tapped_delay_line<double>(3));
+	net.connect_neurons(4, 4, tapped_delay_line<double>(1));
+	net.declare_as_input(0);
+	net.declare_as_input(1);
+	net.declare_as_output(5);
+	net.declare_as_output(4);
+	net.init_random(-0.5, 0.5);
+	net.set_neuron_activation(3, activation_function::logistic);
+	net.set_connection_trainable(4, 2, 0, false);
+	net.tie_connection_weights(3, 5, 2, 5);
+	std::vector<double> memory(net.get_internal_memory_size());
+	for (size_t i = 0; i < memory.size(); ++i) {
+		memory[i] = 0.1*std::sin(1.0 + i);
+	}
+	net.set_internal_memory(memory.begin(), memory.end());
+
+	size_t const sample_count = 2000;
+	matrix<double> u(sample_count, 2), y(sample_count, 2);
+	for (size_t i = 0; i < sample_count; ++i) {
+		u(i, 0) = std::sin(0.05*i);
+		u(i, 1) = std::cos(0.011*i*i);
+		y(i, 0) = 0.5*std::sin(0.05*i - 0.4);
+		y(i, 1) = 0.1;
+	}
+
+	// The references start from the net's internal memory, calc_gradient from the initial state of the sequence
+	matrix_dataset<double> sequence(u, y);
+	multi_sequence_dataset<matrix_dataset<double>> data;
+	data.add_sequence(sequence, memory);
+
+	// Plain backpropagation through the whole sequence with all states in memory
+	neural_nets::detail::net_graph<double> graph(net);
+	std::vector<double> parameters(net.get_parameter_count()), reference(parameters.size(), 0.0);
+	net.get_parameters(parameters.begin(), parameters.end());
+	neural_nets::detail::calc_window_gradient(graph, net, parameters, u, y, 0, sample_count, reference);
+
+	bool passed = true;
+	std::cout << "Budget [bytes]\tMax. deviation from full BPTT (relative)\n";
+	for (size_t budget : { size_t(1) << 30, size_t(4096), size_t(600) }) {
+		std::vector<double> gradient, serial_gradient;
+		calc_gradient(net, data, gradient, budget);
+		calc_gradient(net, data, serial_gradient, budget, false);
+		double deviation = calc_relative_deviation(gradient, reference);
+		passed = passed && deviation < 1.0e-12 && serial_gradient == gradient;
+		std::cout << budget << "\t\t" << deviation << '\n';
+	}
+
+	// Central finite differences on a shorter sequence
+	matrix<double> u_short(subrange(u, 0, 300, 0, 2)), y_short(subrange(y, 0, 300, 0, 2));
+	matrix_dataset<double> short_sequence(u_short, y_short);
+	multi_sequence_dataset<matrix_dataset<double>> short_data;
+	short_data.add_sequence(short_sequence, memory);
+	std::vector<double> differences(parameters.size());
+	for (size_t i = 0; i < parameters.size(); ++i) {
+		double step = 1.0e-6*std::max(1.0, std::abs(parameters[i]));
+		general_net<double> plus(net), minus(net);
+		auto shifted = parameters;
+		shifted[i] = parameters[i] + step;
+		plus.set_parameters(shifted.begin(), shifted.end());
+		shifted[i] = parameters[i] - step;
+		minus.set_parameters(shifted.begin(), shifted.end());
+		differences[i] = (calc_error(plus, u_short, y_short) - calc_error(minus, u_short, y_short)) / (2 * step);
+	}
+	for (size_t budget : { size_t(1) << 30, size_t(4096), size_t(600) }) {
+		std::vector<double> gradient;
+		calc_gradient(net, short_data, gradient, budget);
+		double deviation = calc_relative_deviation(gradient, differences);
+		passed = passed && deviation < 1.0e-5;
+		std::cout << budget << "\t\t" << deviation << " (from finite differences)\n";
+	}
+
+	std::cout << (passed ? "passed\n" : "FAILED\n");
+	return passed ? 0 : 1;
+}
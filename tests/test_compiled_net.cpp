@@ -0,0 +1,124 @@
+#include <iostream> // For output
+#include <algorithm> // For std::max
+#include <cmath> // For std::abs
+#include <random> // For the random topologies
+
+#include "neural_nets\neural_nets.h" // All relevant headers for full neural network usage
+#include "neural_nets\compiled_net.h" // Optimized inference plans
+
+// Checks that compiled_net (with and without the optimization passes) gives the outputs of the general_net it was
+// compiled from, for random recurrent topologies with delays, frozen and tied weights, several activations and a
+// nonzero internal memory. Returns a non-zero exit code on failure.
+
+namespace
+{
+	using namespace neural_nets;
+	using namespace boost::numeric::ublas;
+
+	// Instant connections lead from lower to higher indices (the chain i -> i + 1 leaves no unused neurons),
+	// delayed connections also lead backwards and to the neuron itself
+	general_net<double> make_test_net(std::mt19937 &engine_)
+	{
+		std::uniform_int_distribution<size_t> neuron_count_distribution(3, 12), delay(1, 4), activation(0, 7);
+		std::uniform_real_distribution<double> weight(-0.8, 0.8), probability(0.0, 1.0);
+		size_t neuron_count = neuron_count_distribution(engine_);
+
+		general_net<double> net(neuron_count);
+		for (size_t i = 0; i < neuron_count; ++i) {
+			for (size_t j = 0; j < neuron_count; ++j) {
+				std::vector<neural_nets::detail::tapped_delay<double>> taps;
+				if (j == i + 1 || (j > i && probability(engine_) < 0.3)) {
+					taps.emplace_back(0, weight(engine_));
+				}
+				if (probability(engine_) < 0.2) {
+					size_t first = delay(engine_), count = delay(engine_);
+					for (size_t d = first; d < first + count; ++d) {
+						taps.emplace_back(d, probability(engine_) < 0.1 ? 0.0 : weight(engine_));
+					}
+				}
+				if (!taps.empty()) {
+					net.connect_neurons(i, j, tapped_delay_line<double>(taps));
+				}
+			}
+		}
+		net.declare_as_input(0);
+		if (probability(engine_) < 0.5) {
+			net.declare_as_input(1);
+		}
+		net.declare_as_output(neuron_count - 1);
+		for (size_t i = 1; i + 1 < neuron_count; ++i) {
+			if (probability(engine_) < 0.2) {
+				net.declare_as_output(i);
+			}
+		}
+		for (size_t i = 0; i < neuron_count; ++i) {
+			net.set_neuron_activation(i, static_cast<activation_function>(activation(engine_)));
+			net.set_neuron_bias_weight(i, weight(engine_));
+		}
+
+		// Freeze and tie some taps, connections are indexed by target and source
+		std::vector<std::pair<size_t, size_t>> connections;
+		for (size_t i = 0; i < neuron_count; ++i) {
+			for (size_t j = 0; j < neuron_count; ++j) {
+				if (net.get_connections()(i, j).is_connected()) {
+					connections.emplace_back(i, j);
+				}
+			}
+		}
+		for (auto const &c : connections) {
+			for (size_t k = 0; k < net.get_connections()(c.first, c.second).get_delay_count(); ++k) {
+				if (probability(engine_) < 0.2) {
+					net.set_connection_trainable(c.first, c.second, k, false);
+				}
+			}
+		}
+		for (size_t a = 0; a < connections.size(); ++a) {
+			for (size_t b = a + 1; b < connections.size(); ++b) {
+				auto const &first = connections[a], &second = connections[b];
+				if (net.get_connections()(first.first, first.second).get_delay_count() == net.get_connections()(second.first, second.second).get_delay_count() &&
+					probability(engine_) < 0.1) {
+					net.tie_connection_weights(second.first, second.second, first.first, first.second);
+				}
+			}
+		}
+		std::vector<double> parameters(net.get_parameter_count());
+		for (auto &p : parameters) {
+			p = weight(engine_);
+		}
+		net.set_parameters(parameters.begin(), parameters.end());
+
+		std::vector<double> memory(net.get_internal_memory_size());
+		for (auto &m : memory) {
+			m = weight(engine_);
+		}
+		net.set_internal_memory(memory.begin(), memory.end());
+		return net;
+	}
+}
+
+int main()
+{
+	std::mt19937 engine(7);
+	std::uniform_real_distribution<double> input(-1.0, 1.0);
+	size_t const net_count = 200, step_count = 100;
+	double max_deviation = 0;
+	for (size_t n = 0; n < net_count; ++n) {
+		general_net<double> net = make_test_net(engine);
+		matrix<double> u(step_count, net.get_input_count());
+		for (auto i = u.data().begin(); i != u.data().end(); ++i) {
+			*i = input(engine);
+		}
+		compiled_net<double> optimized(net), plain(net, false);
+		matrix<double> y = net(u), y_optimized = optimized(u), y_plain = plain(u);
+		for (size_t i = 0; i < y.size1(); ++i) {
+			for (size_t k = 0; k < y.size2(); ++k) {
+				double scale = std::max(1.0, std::abs(y(i, k))); // Linear and relu neurons are unbounded
+				max_deviation = std::max({ max_deviation, std::abs(y_optimized(i, k) - y(i, k)) / scale, std::abs(y_plain(i, k) - y(i, k)) / scale });
+			}
+		}
+	}
+
+	bool passed = max_deviation < 1.0e-10;
+	std::cout << net_count << " random networks, max. relative deviation of the compiled outputs: " << max_deviation << (passed ? " - passed\n" : " - FAILED\n");
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+#include <iostream> // For output
+#include "neural_nets\neural_nets.h" // All relevant headers for full neural network usage
+
+// Checks that training never changes frozen weights, also when the output weights are initialized specially
+// (lm_step_options::init_output_weights_special). Returns a non-zero exit code on failure.
+
+int main()
+{
+	using namespace neural_nets; // Neural network library
+	using namespace boost::numeric::ublas; // Boost vector and matrix libraries
+
+	general_net<double> net(4);
+	net.connect_neurons(0, 1);
+	net.connect_neurons(0, 2);
+	net.connect_neurons(1, 3);
+	net.connect_neurons(2, 3);
+	net.connect_neurons(3, 1, tapped_delay_line<double>(1));
+	net.declare_as_input(0);
+	net.declare_as_output(3);
+
+	// Freeze one input tap and the bias of the output neuron
+	net.set_connection_weight(3, 1, 0, 0.123);
+	net.set_connection_trainable(3, 1, 0, false);
+	net.set_neuron_bias_weight(3, -0.456);
+	net.set_neuron_bias_trainable(3, false);
+
+	auto t = net_signals::linspace(0.0, 100.0, 100);
+	auto u = net_signals::amp_pseudo_random_binary_sequence(t, 10.0, -1.0, 1.0);
+	auto y = net_signals::low_pass_filter(t, u, 2.0, 3.0);
+
+	lm_step_options<double> step_opts;
+	step_opts.display_iterations = false;
+	step_opts.init_output_weights_special = true;
+	step_opts.max_iterations = 5;
+	step_opts.lm_opts.max_iterations = 20;
+	step_opts.lm_opts.display_iterations = false;
+	train_lm_stepwise(net, u, y, step_opts);
+
+	bool passed = net.get_connection_weight(3, 1, 0) == 0.123 && net.get_neuron_bias_weight(3) == -0.456;
+	std::cout << "Frozen weight: " << net.get_connection_weight(3, 1, 0) << ", frozen bias: " << net.get_neuron_bias_weight(3)
+		<< (passed ? " - passed\n" : " - FAILED\n");
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+#ifndef INFERENCE_PROTOCOL_H
+#define INFERENCE_PROTOCOL_H
+
+#include <cstdint>
+
+// Messages between inference_server and its clients over a Unix domain socket. Every request is a
+// request_header followed by its values, every reply a reply_header followed by size bytes. Values are doubles
+// in the native representation. A connection is one session: it keeps its own recurrent state per model until
+// it is reset or the connection is closed. Requests of one connection are answered in order.
+
+namespace inference_protocol
+{
+	enum class request_type : std::uint32_t
+	{
+		describe = 1, // -> one model_description per loaded model
+		run, // steps rows of input values -> steps rows of output values, continuing the state of the session
+		reset, // Returns the session state of model to the initial state of the network
+		stats // -> text with the server metrics
+	};
+
+	struct request_header
+	{
+		std::uint32_t type, model;
+		std::uint64_t steps;
+	};
+
+	static std::uint32_t const status_ok = 0;
+	static std::uint32_t const status_error = 1; // The reply is a message
+
+	struct reply_header
+	{
+		std::uint32_t status, reserved;
+		std::uint64_t size;
+	};
+
+	struct model_description
+	{
+		std::uint64_t input_count, output_count;
+	};
+}
+
+#endif
@@ -0,0 +1,523 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+#include "neural_nets\general_net.h"
+#include "neural_nets\batched_net.h"
+#include "neural_nets\net_serialization.h"
+#include "neural_nets\net_distributed.h" // Unix domain socket helpers
+#include "inference_protocol.h"
+
+// Local inference server for networks saved with save_binary. Clients connect to a Unix domain socket and send
+// step or sequence requests (see inference_protocol.h); every connection keeps its own recurrent state per
+// model on the server. Requests for the same model that arrive within the latency budget of the oldest waiting
+// request are run together as one batched_net forward pass, one lane per request. Sequences longer than
+// --max-steps continue in the next batch, so they do not hold back short requests. Throughput, batch
+// occupancy and latency percentiles are printed every --report seconds and answered to stats requests.
+//
+//   inference_server [--lanes N] [--latency-budget MICROSECONDS] [--max-steps N] [--report SECONDS] <socket path> <model file>...
+//
+// POSIX only, stopped by SIGINT or SIGTERM.
+
+namespace
+{
+	using clock_type = std::chrono::steady_clock;
+	using namespace neural_nets;
+	using namespace inference_protocol;
+
+	std::atomic<bool> stop_requested(false);
+
+	extern "C" void handle_signal(int)
+	{
+		stop_requested = true;
+	}
+
+	struct server_options
+	{
+		size_t lanes = 16; // Requests per forward pass
+		std::chrono::microseconds latency_budget = std::chrono::microseconds(500); // Wait for further requests after the oldest one
+		size_t max_steps = 64; // Steps per batch
+		std::chrono::seconds report_interval = std::chrono::seconds(5); // 0 disables the periodic report
+	};
+
+	// Counts with a latency histogram of buckets growing by 10%
+	class request_statistics
+	{
+	public:
+		request_statistics() : requests(0), steps(0), batches(0), batched_requests(0), max_latency(0), histogram(bucket_count, 0), start(clock_type::now()) {}
+
+		void add_batch(size_t requests_)
+		{
+			++batches;
+			batched_requests += requests_;
+		}
+
+		void add_request(size_t steps_, clock_type::duration latency_)
+		{
+			double microseconds = std::chrono::duration<double, std::micro>(latency_).count();
+			++requests;
+			steps += steps_;
+			max_latency = std::max(max_latency, microseconds);
+			size_t bucket = microseconds > 1.0 ? static_cast<size_t>(std::log(microseconds) / std::log(growth)) + 1 : 0;
+			++histogram[std::min(bucket, bucket_count - 1)];
+		}
+
+		std::string get_report() const
+		{
+			double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+			std::ostringstream stream;
+			stream << "requests " << requests << " (" << requests / seconds << "/s), steps " << steps << " (" << steps / seconds << "/s), batches " << batches
+				<< " (" << (batches ? static_cast<double>(batched_requests) / batches : 0.0) << " requests per batch), latency [us] p50 " << get_percentile(0.5)
+				<< " p95 " << get_percentile(0.95) << " p99 " << get_percentile(0.99) << " p99.9 " << get_percentile(0.999) << " max " << max_latency;
+			return stream.str();
+		}
+
+	private:
+		static size_t const bucket_count = 256;
+		static constexpr double growth = 1.1;
+
+		size_t requests, steps, batches, batched_requests;
+		double max_latency;
+		std::vector<size_t> histogram;
+		clock_type::time_point start;
+
+		// Upper bound of the bucket holding the given fraction of the requests
+		double get_percentile(double fraction_) const
+		{
+			size_t count = 0, rank = static_cast<size_t>(std::ceil(fraction_*requests));
+			for (size_t i = 0; i < bucket_count && requests; ++i) {
+				count += histogram[i];
+				if (count >= rank) {
+					return std::min(max_latency, std::pow(growth, static_cast<double>(i)));
+				}
+			}
+			return max_latency;
+		}
+	};
+
+	class server_metrics
+	{
+	public:
+		void add_batch(size_t requests_)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			interval.add_batch(requests_);
+			total.add_batch(requests_);
+		}
+
+		void add_request(size_t steps_, clock_type::duration latency_)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			interval.add_request(steps_, latency_);
+			total.add_request(steps_, latency_);
+		}
+
+		// Report of the interval since the last call
+		std::string get_interval_report()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			std::string report = interval.get_report();
+			interval = request_statistics();
+			return report;
+		}
+
+		std::string get_total_report()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return total.get_report();
+		}
+
+	private:
+		std::mutex mutex;
+		request_statistics interval, total;
+	};
+
+	// One run request, owned by the waiting connection
+	struct job
+	{
+		std::vector<double> *state; // Session state of the connection
+		std::vector<double> inputs, outputs;
+		size_t steps, done_steps;
+		clock_type::time_point arrival;
+		std::string error;
+		bool finished;
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+
+	void finish_job(job &job_, std::string const &error_ = std::string())
+	{
+		std::lock_guard<std::mutex> lock(job_.mutex);
+		job_.error = error_;
+		job_.finished = true;
+		job_.done.notify_one();
+	}
+
+	struct model
+	{
+		std::string file_name;
+		size_t input_count, output_count;
+		std::vector<batched_net<double>> batches; // 1, 2, 4, ... lanes
+		std::deque<job *> queue;
+		bool stopping;
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::thread batcher;
+	};
+
+	// Runs one batch of jobs for up to max_steps steps, returns the jobs with steps left
+	std::vector<job *> run_batch(model &model_, std::vector<job *> const &jobs_, server_options const &options_)
+	{
+		auto &net = *std::find_if(model_.batches.begin(), model_.batches.end(), [&](batched_net<double> const &i_) { return i_.get_lane_count() >= jobs_.size(); });
+		std::vector<size_t> steps(jobs_.size());
+		size_t max_steps = 0;
+		for (size_t m = 0; m < jobs_.size(); ++m) {
+			net.load_state(m, jobs_[m]->state->begin());
+			steps[m] = std::min(options_.max_steps, jobs_[m]->steps - jobs_[m]->done_steps);
+			max_steps = std::max(max_steps, steps[m]);
+		}
+
+		boost::numeric::ublas::matrix<double> u(boost::numeric::ublas::zero_matrix<double>(net.get_lane_count(), model_.input_count)), y;
+		for (size_t s = 0; s < max_steps; ++s) {
+			for (size_t m = 0; m < jobs_.size(); ++m) {
+				if (s < steps[m]) {
+					auto input = jobs_[m]->inputs.begin() + (jobs_[m]->done_steps + s)*model_.input_count;
+					std::copy(input, input + model_.input_count, std::next(u.begin1(), m).begin());
+				}
+			}
+			net(u, y);
+			for (size_t m = 0; m < jobs_.size(); ++m) {
+				if (s < steps[m]) {
+					std::copy(std::next(y.begin1(), m).begin(), std::next(y.begin1(), m).end(), jobs_[m]->outputs.begin() + (jobs_[m]->done_steps + s)*model_.output_count);
+				}
+				if (s + 1 == steps[m]) {
+					net.store_state(m, jobs_[m]->state->begin());
+				}
+			}
+		}
+
+		std::vector<job *> unfinished;
+		for (size_t m = 0; m < jobs_.size(); ++m) {
+			jobs_[m]->done_steps += steps[m];
+			if (jobs_[m]->done_steps < jobs_[m]->steps) {
+				unfinished.push_back(jobs_[m]);
+			}
+			else {
+				finish_job(*jobs_[m]);
+			}
+		}
+		return unfinished;
+	}
+
+	void run_batcher(model &model_, server_options const &options_, server_metrics &metrics_)
+	{
+		std::unique_lock<std::mutex> lock(model_.mutex);
+		while (true) {
+			model_.changed.wait(lock, [&]() { return !model_.queue.empty() || model_.stopping; });
+			if (model_.stopping) {
+				break;
+			}
+			model_.changed.wait_until(lock, model_.queue.front()->arrival + options_.latency_budget, [&]() { return model_.queue.size() >= options_.lanes || model_.stopping; });
+			if (model_.stopping) {
+				break;
+			}
+			size_t count = std::min(options_.lanes, model_.queue.size());
+			std::vector<job *> jobs(model_.queue.begin(), model_.queue.begin() + count);
+			model_.queue.erase(model_.queue.begin(), model_.queue.begin() + count);
+			lock.unlock();
+
+			std::vector<job *> unfinished;
+			try {
+				unfinished = run_batch(model_, jobs, options_);
+			}
+			catch (std::exception const &e) {
+				for (auto i : jobs) {
+					finish_job(*i, e.what());
+				}
+			}
+			metrics_.add_batch(jobs.size());
+
+			lock.lock();
+			model_.queue.insert(model_.queue.begin(), unfinished.begin(), unfinished.end());
+		}
+		for (auto i : model_.queue) {
+			finish_job(*i, "The server is shutting down");
+		}
+		model_.queue.clear();
+	}
+
+	struct connection
+	{
+		detail::socket_handle socket; // Closed by the server once the thread is joined
+		std::vector<std::vector<double>> states; // Per model
+		std::atomic<bool> finished;
+		std::thread thread;
+	};
+
+	// Joins and closes the connections whose clients are gone
+	void reap_connections(std::list<std::unique_ptr<connection>> &connections_)
+	{
+		for (auto i = connections_.begin(); i != connections_.end();) {
+			if ((*i)->finished) {
+				(*i)->thread.join();
+				detail::close_socket((*i)->socket);
+				i = connections_.erase(i);
+			}
+			else {
+				++i;
+			}
+		}
+	}
+
+	bool send_reply(detail::socket_handle socket_, std::uint32_t status_, void const *data_, size_t size_)
+	{
+		reply_header header{ status_, 0, size_ };
+		return detail::send_all(socket_, reinterpret_cast<char const *>(&header), sizeof(header)) && detail::send_all(socket_, static_cast<char const *>(data_), size_);
+	}
+
+	bool send_error(detail::socket_handle socket_, std::string const &message_)
+	{
+		return send_reply(socket_, status_error, message_.data(), message_.size());
+	}
+
+	void serve_connection(connection &connection_, std::vector<std::unique_ptr<model>> &models_, server_metrics &metrics_)
+	{
+		request_header header;
+		while (detail::receive_all(connection_.socket, reinterpret_cast<char *>(&header), sizeof(header))) {
+			auto type = static_cast<request_type>(header.type);
+			if (type == request_type::describe) {
+				std::vector<model_description> descriptions;
+				for (auto const &i : models_) {
+					descriptions.push_back(model_description{ i->input_count, i->output_count });
+				}
+				if (!send_reply(connection_.socket, status_ok, descriptions.data(), descriptions.size()*sizeof(model_description))) {
+					break;
+				}
+				continue;
+			}
+			if (type == request_type::stats) {
+				std::string report = metrics_.get_total_report();
+				if (!send_reply(connection_.socket, status_ok, report.data(), report.size())) {
+					break;
+				}
+				continue;
+			}
+			if ((type != request_type::run && type != request_type::reset) || header.model >= models_.size()) {
+				// The size of the request is unknown, so the connection can not continue
+				send_error(connection_.socket, "Invalid request type or model index");
+				break;
+			}
+			auto &current = *models_[header.model];
+			if (type == request_type::reset) {
+				connection_.states[header.model] = current.batches.front().get_initial_state();
+				if (!send_reply(connection_.socket, status_ok, nullptr, 0)) {
+					break;
+				}
+				continue;
+			}
+
+			if (!header.steps || header.steps > (std::uint64_t(1) << 30) / std::max<size_t>(1, current.input_count + current.output_count)) {
+				send_error(connection_.socket, "Invalid number of steps");
+				break;
+			}
+			job request;
+			request.state = &connection_.states[header.model];
+			request.steps = static_cast<size_t>(header.steps);
+			request.done_steps = 0;
+			request.finished = false;
+			request.inputs.resize(request.steps*current.input_count);
+			request.outputs.resize(request.steps*current.output_count);
+			if (!detail::receive_all(connection_.socket, reinterpret_cast<char *>(request.inputs.data()), request.inputs.size()*sizeof(double))) {
+				break;
+			}
+			request.arrival = clock_type::now();
+			{
+				// The batcher may already have drained its queue and exited
+				std::lock_guard<std::mutex> lock(current.mutex);
+				if (current.stopping) {
+					finish_job(request, "The server is shutting down");
+				}
+				else {
+					current.queue.push_back(&request);
+					current.changed.notify_one();
+				}
+			}
+			{
+				std::unique_lock<std::mutex> lock(request.mutex);
+				request.done.wait(lock, [&]() { return request.finished; });
+			}
+			bool sent = request.error.empty() ? send_reply(connection_.socket, status_ok, request.outputs.data(), request.outputs.size()*sizeof(double)) :
+				send_error(connection_.socket, request.error);
+			if (request.error.empty()) {
+				metrics_.add_request(request.steps, clock_type::now() - request.arrival);
+			}
+			if (!sent) {
+				break;
+			}
+		}
+		connection_.finished = true;
+	}
+
+	void print_usage()
+	{
+		std::cerr << "Usage: inference_server [--lanes N] [--latency-budget MICROSECONDS] [--max-steps N] [--report SECONDS] <socket path> <model file>...\n";
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	server_options options;
+	std::vector<std::string> arguments;
+	try {
+		for (int i = 1; i < argc; ++i) {
+			std::string argument = argv[i];
+			if (argument.compare(0, 2, "--") != 0) {
+				arguments.push_back(argument);
+				continue;
+			}
+			if (i + 1 == argc) {
+				print_usage();
+				return 1;
+			}
+			size_t value = std::stoul(argv[++i]);
+			if (argument == "--lanes" && value) {
+				options.lanes = value;
+			}
+			else if (argument == "--latency-budget") {
+				options.latency_budget = std::chrono::microseconds(value);
+			}
+			else if (argument == "--max-steps" && value) {
+				options.max_steps = value;
+			}
+			else if (argument == "--report") {
+				options.report_interval = std::chrono::seconds(value);
+			}
+			else {
+				print_usage();
+				return 1;
+			}
+		}
+	}
+	catch (std::exception const &) {
+		print_usage();
+		return 1;
+	}
+	if (arguments.size() < 2) {
+		print_usage();
+		return 1;
+	}
+	std::string const socket_path = arguments[0];
+
+	std::vector<std::unique_ptr<model>> models;
+	detail::socket_handle listener = detail::invalid_socket;
+	try {
+		for (size_t i = 1; i < arguments.size(); ++i) {
+			auto net = load_binary<double>(arguments[i]);
+			std::unique_ptr<model> current(new model());
+			current->file_name = arguments[i];
+			current->input_count = net.get_input_count();
+			current->output_count = net.get_output_count();
+			current->stopping = false;
+			for (size_t lanes = 1; ; lanes *= 2) {
+				current->batches.emplace_back(net, std::min(lanes, options.lanes));
+				if (lanes >= options.lanes) {
+					break;
+				}
+			}
+			std::cout << "Model " << i - 1 << ": " << arguments[i] << " (" << current->input_count << " inputs, " << current->output_count << " outputs)\n";
+			models.push_back(std::move(current));
+		}
+
+		sockaddr_un address = detail::make_socket_address(socket_path);
+		std::remove(socket_path.c_str());
+		listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener == detail::invalid_socket || ::bind(listener, reinterpret_cast<sockaddr const *>(&address), sizeof(address)) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+			throw neural_exception("Could not listen on socket " + socket_path);
+		}
+	}
+	catch (std::exception const &e) {
+		if (listener != detail::invalid_socket) {
+			detail::close_socket(listener);
+		}
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+
+	std::signal(SIGINT, handle_signal);
+	std::signal(SIGTERM, handle_signal);
+	std::signal(SIGPIPE, SIG_IGN);
+
+	server_metrics metrics;
+	for (auto &i : models) {
+		model &current = *i;
+		current.batcher = std::thread([&]() { run_batcher(current, options, metrics); });
+	}
+	std::thread reporter([&]() {
+		auto next = clock_type::now() + options.report_interval;
+		while (!stop_requested) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if (options.report_interval.count() && clock_type::now() >= next) {
+				std::cout << metrics.get_interval_report() << std::endl;
+				next += options.report_interval;
+			}
+		}
+	});
+	std::cout << "Listening on " << socket_path << " (" << options.lanes << " lanes, latency budget " << options.latency_budget.count() << " us)" << std::endl;
+
+	std::list<std::unique_ptr<connection>> connections;
+	while (!stop_requested) {
+		reap_connections(connections);
+		pollfd listening{ listener, POLLIN, 0 };
+		if (::poll(&listening, 1, 200) <= 0) {
+			continue;
+		}
+		detail::socket_handle socket = ::accept(listener, nullptr, nullptr);
+		if (socket == detail::invalid_socket) {
+			continue;
+		}
+		std::unique_ptr<connection> current(new connection());
+		current->socket = socket;
+		current->finished = false;
+		for (auto const &i : models) {
+			current->states.push_back(i->batches.front().get_initial_state());
+		}
+		connection &added = *current;
+		connections.push_back(std::move(current));
+		added.thread = std::thread([&]() { serve_connection(added, models, metrics); });
+	}
+
+	detail::close_socket(listener);
+	std::remove(socket_path.c_str());
+	for (auto const &i : connections) {
+		::shutdown(i->socket, SHUT_RDWR);
+	}
+	for (auto &i : models) {
+		{
+			std::lock_guard<std::mutex> lock(i->mutex);
+			i->stopping = true;
+			i->changed.notify_one();
+		}
+		i->batcher.join();
+	}
+	for (auto &i : connections) {
+		i->thread.join();
+		detail::close_socket(i->socket);
+	}
+	reporter.join();
+	std::cout << "Total: " << metrics.get_total_report() << std::endl;
+}
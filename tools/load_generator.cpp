@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "neural_nets\general_net.h"
+#include "neural_nets\net_serialization.h"
+#include "neural_nets\net_distributed.h" // Unix domain socket helpers
+#include "inference_protocol.h"
+
+// Load generator for inference_server. Every client is one connection (one server side session) sending
+// requests of random inputs one after another and measuring the latency until the reply. With --verify, every
+// client also runs a local copy of the model file and reports the largest deviation of the server outputs.
+//
+//   load_generator [--model INDEX] [--clients N] [--requests N] [--steps N] [--think MICROSECONDS] [--verify MODEL FILE] <socket path>
+//
+// POSIX only.
+
+namespace
+{
+	using clock_type = std::chrono::steady_clock;
+	using namespace neural_nets;
+	using namespace inference_protocol;
+
+	struct load_options
+	{
+		std::string socket_path;
+		size_t model = 0;
+		size_t clients = 8;
+		size_t requests = 1000; // Per client
+		size_t steps = 1; // Per request, more than one sends sequences
+		std::chrono::microseconds think_time = std::chrono::microseconds(0); // Pause between the requests of a client
+		std::string verify_file;
+	};
+
+	struct client_result
+	{
+		std::vector<double> latencies; // Microseconds
+		double max_deviation = 0;
+		std::string error;
+	};
+
+	class client_connection
+	{
+	public:
+		explicit client_connection(std::string const &path_) : socket(::socket(AF_UNIX, SOCK_STREAM, 0))
+		{
+			sockaddr_un address = detail::make_socket_address(path_);
+			if (socket == detail::invalid_socket || ::connect(socket, reinterpret_cast<sockaddr const *>(&address), sizeof(address)) != 0) {
+				close();
+				throw neural_exception("Could not connect to server on socket " + path_);
+			}
+		}
+
+		~client_connection() { close(); }
+
+		client_connection(client_connection const &) = delete;
+		client_connection &operator=(client_connection const &) = delete;
+
+		// Sends a request and returns the payload of the reply, throws the message of an error reply
+		std::vector<char> request(request_type type_, size_t model_, size_t steps_, std::vector<double> const &values_)
+		{
+			request_header header{ static_cast<std::uint32_t>(type_), static_cast<std::uint32_t>(model_), steps_ };
+			if (!detail::send_all(socket, reinterpret_cast<char const *>(&header), sizeof(header)) ||
+				!detail::send_all(socket, reinterpret_cast<char const *>(values_.data()), values_.size()*sizeof(double))) {
+				throw neural_exception("Connection to server lost!");
+			}
+			reply_header reply;
+			if (!detail::receive_all(socket, reinterpret_cast<char *>(&reply), sizeof(reply))) {
+				throw neural_exception("Connection to server lost!");
+			}
+			std::vector<char> payload(static_cast<size_t>(reply.size));
+			if (!detail::receive_all(socket, payload.data(), payload.size())) {
+				throw neural_exception("Connection to server lost!");
+			}
+			if (reply.status != status_ok) {
+				throw neural_exception("Server error: " + std::string(payload.begin(), payload.end()));
+			}
+			return payload;
+		}
+
+	private:
+		detail::socket_handle socket;
+
+		void close()
+		{
+			if (socket != detail::invalid_socket) {
+				detail::close_socket(socket);
+				socket = detail::invalid_socket;
+			}
+		}
+	};
+
+	void run_client(load_options const &options_, model_description const &model_, general_net<double> const *reference_, unsigned seed_, client_result &result_)
+	{
+		try {
+			client_connection connection(options_.socket_path);
+			general_net<double> net = reference_ ? *reference_ : general_net<double>();
+			std::mt19937 engine(seed_);
+			std::uniform_real_distribution<double> input(-1.0, 1.0);
+			std::vector<double> inputs(options_.steps*model_.input_count), outputs(model_.output_count);
+			result_.latencies.reserve(options_.requests);
+			for (size_t r = 0; r < options_.requests; ++r) {
+				for (auto &i : inputs) {
+					i = input(engine);
+				}
+				auto start = clock_type::now();
+				auto payload = connection.request(request_type::run, options_.model, options_.steps, inputs);
+				result_.latencies.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - start).count());
+				if (payload.size() != options_.steps*model_.output_count*sizeof(double)) {
+					throw neural_exception("Reply of unexpected size!");
+				}
+				if (reference_) {
+					double const *received = reinterpret_cast<double const *>(payload.data());
+					for (size_t s = 0; s < options_.steps; ++s) {
+						net(inputs.begin() + s*model_.input_count, inputs.begin() + (s + 1)*model_.input_count, outputs.begin(), outputs.end());
+						for (size_t k = 0; k < outputs.size(); ++k) {
+							result_.max_deviation = std::max(result_.max_deviation, std::abs(outputs[k] - received[s*outputs.size() + k]));
+						}
+					}
+				}
+				if (options_.think_time.count()) {
+					std::this_thread::sleep_for(options_.think_time);
+				}
+			}
+		}
+		catch (std::exception const &e) {
+			result_.error = e.what();
+		}
+	}
+
+	double get_percentile(std::vector<double> const &sorted_, double fraction_)
+	{
+		return sorted_.empty() ? 0.0 : sorted_[std::min(sorted_.size() - 1, static_cast<size_t>(std::ceil(fraction_*sorted_.size())) - (fraction_ > 0.0 ? 1 : 0))];
+	}
+
+	void print_usage()
+	{
+		std::cerr << "Usage: load_generator [--model INDEX] [--clients N] [--requests N] [--steps N] [--think MICROSECONDS] [--verify MODEL FILE] <socket path>\n";
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	load_options options;
+	try {
+		for (int i = 1; i < argc; ++i) {
+			std::string argument = argv[i];
+			if (argument.compare(0, 2, "--") != 0) {
+				options.socket_path = argument;
+				continue;
+			}
+			if (i + 1 == argc) {
+				print_usage();
+				return 1;
+			}
+			std::string value = argv[++i];
+			if (argument == "--verify") {
+				options.verify_file = value;
+			}
+			else if (argument == "--model") {
+				options.model = std::stoul(value);
+			}
+			else if (argument == "--clients" && std::stoul(value)) {
+				options.clients = std::stoul(value);
+			}
+			else if (argument == "--requests") {
+				options.requests = std::stoul(value);
+			}
+			else if (argument == "--steps" && std::stoul(value)) {
+				options.steps = std::stoul(value);
+			}
+			else if (argument == "--think") {
+				options.think_time = std::chrono::microseconds(std::stoul(value));
+			}
+			else {
+				print_usage();
+				return 1;
+			}
+		}
+	}
+	catch (std::exception const &) {
+		print_usage();
+		return 1;
+	}
+	if (options.socket_path.empty()) {
+		print_usage();
+		return 1;
+	}
+
+	model_description model;
+	general_net<double> reference;
+	try {
+		client_connection connection(options.socket_path);
+		auto payload = connection.request(request_type::describe, 0, 0, std::vector<double>());
+		if (options.model >= payload.size() / sizeof(model_description)) {
+			throw neural_exception("The server has no model " + std::to_string(options.model));
+		}
+		model = reinterpret_cast<model_description const *>(payload.data())[options.model];
+		if (!options.verify_file.empty()) {
+			reference = load_binary<double>(options.verify_file);
+			if (reference.get_input_count() != model.input_count || reference.get_output_count() != model.output_count) {
+				throw neural_exception("The model file does not match model " + std::to_string(options.model) + " of the server!");
+			}
+		}
+	}
+	catch (std::exception const &e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+
+	std::vector<client_result> results(options.clients);
+	std::vector<std::thread> clients;
+	auto start = clock_type::now();
+	for (size_t i = 0; i < options.clients; ++i) {
+		clients.emplace_back(run_client, std::cref(options), std::cref(model), options.verify_file.empty() ? nullptr : &reference, static_cast<unsigned>(i + 1), std::ref(results[i]));
+	}
+	for (auto &i : clients) {
+		i.join();
+	}
+	double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+	std::vector<double> latencies;
+	double max_deviation = 0;
+	for (auto const &i : results) {
+		if (!i.error.empty()) {
+			std::cerr << "Client failed: " << i.error << '\n';
+		}
+		latencies.insert(latencies.end(), i.latencies.begin(), i.latencies.end());
+		max_deviation = std::max(max_deviation, i.max_deviation);
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	std::cout << options.clients << " clients, " << latencies.size() << " requests of " << options.steps << " steps in " << seconds << " s\n";
+	std::cout << "Throughput: " << latencies.size() / seconds << " requests/s, " << latencies.size()*options.steps / seconds << " steps/s\n";
+	std::cout << "Latency [us]: p50 " << get_percentile(latencies, 0.5) << " p95 " << get_percentile(latencies, 0.95) << " p99 " << get_percentile(latencies, 0.99)
+		<< " p99.9 " << get_percentile(latencies, 0.999) << " max " << (latencies.empty() ? 0.0 : latencies.back()) << '\n';
+	if (!options.verify_file.empty()) {
+		std::cout << "Largest deviation from the local model: " << max_deviation << '\n';
+	}
+	try {
+		client_connection connection(options.socket_path);
+		auto payload = connection.request(request_type::stats, 0, 0, std::vector<double>());
+		std::cout << "Server: " << std::string(payload.begin(), payload.end()) << '\n';
+	}
+	catch (std::exception const &e) {
+		std::cerr << e.what() << '\n';
+	}
+	for (auto const &i : results) {
+		if (!i.error.empty()) {
+			return 1;
+		}
+	}
+}
@@ -1,8 +1,54 @@
 #ifndef TRAINING_OPTIONS_H
 #define TRAINING_OPTIONS_H
 
+#include <chrono>
+#include <functional>
+
 namespace neural_nets
 {
+	// Returned by progress callbacks to continue or to end a training run early
+	enum class training_action
+	{
+		proceed,
+		stop
+	};
+
+	template <typename T>
+	struct lm_iteration_info
+	{
+		size_t iteration;
+		T error;
+		T lambda;
+		T error_change;
+		double iteration_seconds; // Time since the previous callback
+		double elapsed_seconds; // Time since the start of the run
+	};
+
+	template <typename T>
+	struct lm_trial_info
+	{
+		size_t trial;
+		size_t max_trials;
+		size_t samples_used;
+		size_t sample_count;
+		T training_error;
+		T validation_error;
+		T best_error;
+		bool new_best;
+		double trial_seconds;
+		double elapsed_seconds;
+	};
+
+	template <typename T>
+	struct gradient_epoch_info
+	{
+		size_t epoch;
+		T error; // Mean squared error of the epoch, accumulated while the weights change
+		T gradient_norm; // Of the last update
+		double epoch_seconds;
+		double elapsed_seconds;
+	};
+
 	template <typename T>
 	struct lm_options
 	{
@@ -14,7 +60,47 @@ namespace neural_nets
 		T lambda_inc_factor = 2.0;
 		T lambda_dec_factor = 10.0;
 		bool display_iterations = true;
-		bool use_parallelization = true;
+		bool use_parallelization = true; // Runs work on the shared thread pool (net_threading.h)
+		size_t speculative_lambdas = 1; // Damping values tried in parallel per step, 1 tries one at a time
+		size_t chunk_size = 4096; // Samples simulated at once, bounds the memory used for Jacobian rows
+		size_t lockstep_lanes = 16; // Parameter vectors of general nets simulated together (Jacobian columns, candidates)
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(); // Training stops once reached
+		std::function<training_action(lm_iteration_info<T> const &)> iteration_callback; // Called once per iteration if set
+	};
+
+	// Options of the first order methods train_sgd, train_rmsprop and train_adam
+	template <typename T>
+	struct gradient_options
+	{
+		size_t max_epochs = 100;
+		size_t window_length = 50; // Samples per window, gradients are truncated at the start of a window. 0 uses whole sequences
+		size_t warmup_length = 20; // Samples simulated before each window to build up the internal memory
+		size_t batch_size = 8; // Windows per weight update
+		size_t memory_budget = 256 << 20; // Bytes for the states of one whole sequence, exceeding it recomputes states from snapshots
+		T learning_rate = 1.0e-3;
+		T momentum = 0.9; // Momentum of SGD, decay of the mean gradient of Adam
+		T decay = 0.999; // Decay of the mean squared gradient of RMSProp and Adam
+		T epsilon = 1.0e-8;
+		T abs_tol = 1.0e-6;
+		bool shuffle_windows = true;
+		bool display_iterations = true;
+		bool use_parallelization = true; // Windows of a batch run on the shared thread pool
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+		std::function<training_action(gradient_epoch_info<T> const &)> epoch_callback; // Called once per epoch if set
+	};
+
+	// Options of train_reservoir
+	template <typename T>
+	struct reservoir_options
+	{
+		bool init_weights_random = true;
+		T min_random = -0.5;
+		T max_random = 0.5;
+		T spectral_radius = 0.9; // Of the delayed connections between non-output neurons, 0 keeps them unscaled
+		T ridge = 1.0e-6; // Regularization of the output weights (not of the output biases)
+		size_t washout = 100; // Samples at the start of every sequence excluded from the fit
+		size_t chunk_size = 4096;
+		bool use_parallelization = true; // Sequences of multi sequence datasets run on the shared thread pool
 	};
 
 	template <typename T>
@@ -30,7 +116,10 @@ namespace neural_nets
 		T min_random = -0.5;
 		T max_random = 0.5;
 		lm_options<T> lm_opts;
+		bool continue_horizons = false; // Each horizon continues the normal equations of the previous one instead of starting at sample zero
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(); // Also applies to each trial
+		std::function<training_action(lm_trial_info<T> const &)> trial_callback; // Called once per trial if set
 	};
 }
 
-#endif
\ No newline at end of file
+#endif